@@ -0,0 +1,61 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+/* Memory allocation hooks.  The containers take a pointer to one of these
+ * in their _init_alloc functions, and do all of their allocation through
+ * it.  A NULL allocator means the C library's malloc, calloc, realloc,
+ * and free.  The hooks have the same semantics as those functions, and
+ * get the allocator's context as their last argument.
+ */
+struct allocator {
+	void *(*malloc) (size_t size, void *context);
+	void *(*calloc) (size_t nmemb, size_t size, void *context);
+	void *(*realloc) (void *ptr, size_t size, void *context);
+	void (*free) (void *ptr, void *context);
+	void *context;
+};
+
+static inline void *allocator_malloc(const struct allocator *a, size_t size)
+{
+	return a ? (a->malloc)(size, a->context) : malloc(size);
+}
+
+static inline void *allocator_calloc(const struct allocator *a, size_t nmemb,
+				     size_t size)
+{
+	return a ? (a->calloc)(nmemb, size, a->context) : calloc(nmemb, size);
+}
+
+static inline void *allocator_realloc(const struct allocator *a, void *ptr,
+				      size_t size)
+{
+	return a ? (a->realloc)(ptr, size, a->context) : realloc(ptr, size);
+}
+
+static inline void allocator_free(const struct allocator *a, void *ptr)
+{
+	if (a) {
+		(a->free)(ptr, a->context);
+	} else {
+		free(ptr);
+	}
+}
+
+#endif // ALLOCATOR_H
@@ -0,0 +1,625 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "allocator.h"
+#include "cuckooset.h"
+
+/* Minimum size we're willing to let tables be; must be a power of two */
+#define CK_MIN_BUCKETS	2
+
+#define CK_MAX_BUCKETS	((size_t)1 << (CHAR_BIT * sizeof(size_t) - 3))
+
+/* Number of elements a table with n buckets has room for: 90% of its
+ * slots.  Two-choice tables with four slots a bucket fill to about 95%
+ * before insertions start to fail.
+ */
+#define CK_USABLE(n)	((n) * CUCKOOSET_SLOTS - (n) * CUCKOOSET_SLOTS / 10)
+
+#define CK_NOT_FOUND	SIZE_MAX
+#define CK_NONE		SIZE_MAX
+
+/* Buckets an insertion looks at for a path to an empty slot */
+#define CK_MAX_SEARCH	256
+
+/* Tags are the high bit plus 7 bits of a multiplicative mix of the hash,
+ * as in hashset; the low bits of the hash pick the first bucket.
+ */
+#if SIZE_MAX > 0xffffffffUL
+# define CK_TAG_MULT	((size_t)0x9e3779b97f4a7c15ULL)
+#else
+# define CK_TAG_MULT	((size_t)0x9e3779b9UL)
+#endif
+#define CK_TAG_SHIFT	(CHAR_BIT * sizeof(size_t) - 7)
+
+/* Odd, so distinct tags give distinct offsets in tables of 256 buckets
+ * or more */
+#define CK_ALT_MULT	((size_t)0x5bd1e995UL)
+
+/* Elements in a bucket are aligned to the largest power of two dividing
+ * their width, up to this */
+union ck_max_align {
+	long double ld;
+	long long ll;
+	void *p;
+};
+#define CK_MAX_ALIGN	sizeof(union ck_max_align)
+
+/* Tables start on a cache line, and buckets that fit in a line are padded
+ * to a power of two, so that no bucket straddles two lines */
+#define CK_LINE		64
+
+#ifdef __GNUC__
+# define CK_PREFETCH(addr) __builtin_prefetch((addr), 0)
+#else
+# define CK_PREFETCH(addr) ((void)(addr))
+#endif
+
+/* A bucket on an insertion's search; the element in slot of the parent
+ * bucket can move here */
+struct ck_node {
+	size_t bucket;
+	size_t parent;
+	size_t slot;
+};
+
+
+static size_t ck_min_buckets(size_t count, size_t nbucket0)
+{
+	size_t n = CK_MIN_BUCKETS;
+
+	assert(count <= CK_USABLE(CK_MAX_BUCKETS));
+
+	while (n < nbucket0 || count > CK_USABLE(n)) {
+		assert(2 * n > n);
+		n *= 2;
+	}
+
+	return n;
+}
+
+/* The bytes a bucket takes up, given the bytes its tags and elements need */
+static size_t ck_stride(size_t size)
+{
+	size_t stride = 1;
+
+	if (size > CK_LINE) {
+		return (size + CK_LINE - 1) / CK_LINE * CK_LINE;
+	}
+	while (stride < size) {
+		stride *= 2;
+	}
+	return stride;
+}
+
+static inline unsigned char ck_tag(size_t hash)
+{
+	return 0x80 | (unsigned char)((hash * CK_TAG_MULT) >> CK_TAG_SHIFT);
+}
+
+/* The other bucket for an element with the given tag.  Since this needs
+ * only the tag, moving an element doesn't rehash it.  Applying it twice
+ * gets back the first bucket.  The price is that a bucket's elements have
+ * only 128 possible alternates, one per tag.
+ */
+static inline size_t ck_alt(size_t bucket, unsigned char tag, size_t mask)
+{
+	return (bucket ^ ((size_t)tag * CK_ALT_MULT)) & mask;
+}
+
+static inline unsigned char *cuckooset_tags(const struct cuckooset *s,
+					    size_t bucket)
+{
+	return (unsigned char *)s->buckets + bucket * s->stride;
+}
+
+/* Slot i is slot i % CUCKOOSET_SLOTS of bucket i / CUCKOOSET_SLOTS */
+static inline unsigned char *cuckooset_tag(const struct cuckooset *s,
+					   size_t i)
+{
+	return cuckooset_tags(s, i / CUCKOOSET_SLOTS) + i % CUCKOOSET_SLOTS;
+}
+
+static inline void *cuckooset_slot(const struct cuckooset *s, size_t i)
+{
+	return (cuckooset_tags(s, i / CUCKOOSET_SLOTS) + s->offset
+		+ i % CUCKOOSET_SLOTS * s->width);
+}
+
+static size_t cuckooset_bucket_find(const struct cuckooset *s,
+				    const void *key, size_t bucket,
+				    unsigned char tag)
+{
+	const unsigned char *tags = cuckooset_tags(s, bucket);
+	size_t j;
+
+	for (j = 0; j < CUCKOOSET_SLOTS; j++) {
+		if (tags[j] == tag
+		    && !s->compar(key, tags + s->offset + j * s->width,
+				  s->context)) {
+			return bucket * CUCKOOSET_SLOTS + j;
+		}
+	}
+
+	return CK_NOT_FOUND;
+}
+
+/* Look for key, whose hash is given, in its two buckets.  Returns its
+ * slot, or CK_NOT_FOUND.
+ */
+static size_t cuckooset_probe(const struct cuckooset *s, const void *key,
+			      size_t hash)
+{
+	const size_t mask = s->nbucket - 1;
+	const unsigned char tag = ck_tag(hash);
+	size_t b1 = hash & mask;
+	size_t b2 = ck_alt(b1, tag, mask);
+	size_t i;
+
+	CK_PREFETCH(cuckooset_tags(s, b2));
+
+	i = cuckooset_bucket_find(s, key, b1, tag);
+	if (i == CK_NOT_FOUND && b2 != b1) {
+		i = cuckooset_bucket_find(s, key, b2, tag);
+	}
+
+	return i;
+}
+
+static int ck_on_path(const struct ck_node *queue, size_t k, size_t bucket)
+{
+	for (; k != CK_NONE; k = queue[k].parent) {
+		if (queue[k].bucket == bucket) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Get an empty slot in one of the two buckets for hash.  If both are
+ * full, search breadth-first for the shortest path of elements that can
+ * each move to their other bucket, ending at an empty slot, and make the
+ * moves.  Returns the slot, or CK_NOT_FOUND, leaving s unchanged, if the
+ * search gives up.
+ */
+static size_t cuckooset_make_room(struct cuckooset *s, size_t hash)
+{
+	struct ck_node queue[CK_MAX_SEARCH];
+	const size_t mask = s->nbucket - 1;
+	const unsigned char tag = ck_tag(hash);
+	const size_t width = s->width;
+	size_t n, k, p, j, i, b, src;
+
+	queue[0].bucket = hash & mask;
+	queue[0].parent = CK_NONE;
+	queue[1].bucket = ck_alt(queue[0].bucket, tag, mask);
+	queue[1].parent = CK_NONE;
+	n = (queue[1].bucket == queue[0].bucket) ? 1 : 2;
+
+	for (k = 0; k < n; k++) {
+		for (j = 0; j < CUCKOOSET_SLOTS; j++) {
+			i = queue[k].bucket * CUCKOOSET_SLOTS + j;
+			if (!*cuckooset_tag(s, i)) {
+				goto found;
+			}
+		}
+
+		// no path visits a bucket twice, so the moves don't collide
+		for (j = 0; j < CUCKOOSET_SLOTS && n < CK_MAX_SEARCH; j++) {
+			i = queue[k].bucket * CUCKOOSET_SLOTS + j;
+			b = ck_alt(queue[k].bucket, *cuckooset_tag(s, i), mask);
+			if (!ck_on_path(queue, k, b)) {
+				queue[n].bucket = b;
+				queue[n].parent = k;
+				queue[n].slot = j;
+				n++;
+			}
+		}
+	}
+
+	return CK_NOT_FOUND;
+
+found:
+	// move the elements along the path, starting at the empty end
+	while ((p = queue[k].parent) != CK_NONE) {
+		src = queue[p].bucket * CUCKOOSET_SLOTS + queue[k].slot;
+		memcpy(cuckooset_slot(s, i), cuckooset_slot(s, src), width);
+		*cuckooset_tag(s, i) = *cuckooset_tag(s, src);
+		*cuckooset_tag(s, src) = 0;
+		i = src;
+		k = p;
+	}
+
+	return i;
+}
+
+/* Allocate nbucket empty buckets for s, starting on a cache line.  The
+ * block gets CK_LINE - 1 bytes of slack, and s->mem keeps it for freeing.
+ */
+static int cuckooset_alloc_buckets(struct cuckooset *s, size_t nbucket)
+{
+	char *mem;
+
+	if (nbucket > (SIZE_MAX - CK_LINE) / s->stride
+	    || !(mem = allocator_calloc(s->alloc, nbucket * s->stride
+					+ CK_LINE - 1, 1))) {
+		return ENOMEM;
+	}
+	s->mem = mem;
+	s->buckets = mem + (-(uintptr_t)mem & (CK_LINE - 1));
+	return 0;
+}
+
+/* Move the elements to a table with at least nbucket buckets, doubling
+ * that until they all fit.  On failure, s is unchanged.
+ */
+static int cuckooset_rehash(struct cuckooset *s, size_t nbucket)
+{
+	struct cuckooset snew = *s;
+	const size_t nslot = s->nbucket * CUCKOOSET_SLOTS;
+	size_t i, j, hash;
+
+	assert(s->count <= CK_USABLE(nbucket));
+
+	for (;;) {
+		if (cuckooset_alloc_buckets(&snew, nbucket)) {
+			return ENOMEM;
+		}
+		snew.nbucket = nbucket;
+		snew.count = 0;
+		snew.count_max = CK_USABLE(nbucket);
+
+		for (i = 0; i < nslot; i++) {
+			if (!*cuckooset_tag(s, i)) {
+				continue;
+			}
+			hash = s->hash(cuckooset_slot(s, i), s->context);
+			if ((j = cuckooset_make_room(&snew, hash))
+			    == CK_NOT_FOUND) {
+				break;
+			}
+			memcpy(cuckooset_slot(&snew, j), cuckooset_slot(s, i),
+			       s->width);
+			*cuckooset_tag(&snew, j) = ck_tag(hash);
+			snew.count++;
+		}
+
+		if (snew.count == s->count) {
+			break;
+		}
+
+		allocator_free(s->alloc, snew.mem);
+
+		// elements that don't fit a quarter-full table have a bad hash
+		if (s->count < snew.count_max / 4
+		    || nbucket == CK_MAX_BUCKETS) {
+			return ERANGE;
+		}
+		nbucket *= 2;
+	}
+
+	allocator_free(s->alloc, s->mem);
+	*s = snew;
+	return 0;
+}
+
+int cuckooset_init(struct cuckooset *s, size_t width,
+		   size_t (*hash) (const void *, void *),
+		   int (*compar) (const void *, const void *, void *),
+		   void *context)
+{
+	return cuckooset_init_alloc(s, width, hash, compar, context, NULL);
+}
+
+int cuckooset_init_alloc(struct cuckooset *s, size_t width,
+			 size_t (*hash) (const void *, void *),
+			 int (*compar) (const void *, const void *, void *),
+			 void *context, const struct allocator *alloc)
+{
+	assert(s);
+	assert(hash);
+	assert(compar);
+
+	size_t align = width & -width;
+
+	if (!align || align > CK_MAX_ALIGN) {
+		align = CK_MAX_ALIGN;
+	}
+
+	s->width = width;
+	s->hash = hash;
+	s->compar = compar;
+	s->context = context;
+	s->alloc = alloc;
+	s->mem = NULL;
+	s->buckets = NULL;
+	s->offset = (CUCKOOSET_SLOTS + align - 1) / align * align;
+	s->stride = ck_stride(s->offset + CUCKOOSET_SLOTS * width);
+	s->nbucket = 0;
+	s->count = 0;
+	s->count_max = 0;
+	return 0;
+}
+
+int cuckooset_init_copy(struct cuckooset *s, const struct cuckooset *src)
+{
+	assert(s);
+	assert(src);
+	assert(s != src);
+
+	cuckooset_init_alloc(s, src->width, src->hash, src->compar,
+			     src->context, src->alloc);
+	if (!src->nbucket) {
+		return 0;
+	}
+
+	if (cuckooset_alloc_buckets(s, src->nbucket)) {
+		return ENOMEM;
+	}
+
+	memcpy(s->buckets, src->buckets, src->nbucket * src->stride);
+	s->nbucket = src->nbucket;
+	s->count = src->count;
+	s->count_max = src->count_max;
+	return 0;
+}
+
+int cuckooset_assign_copy(struct cuckooset *s, const struct cuckooset *src)
+{
+	struct cuckooset snew;
+	int err;
+
+	assert(s);
+	assert(src);
+
+	if ((err = cuckooset_init_copy(&snew, src))) {
+		return err;
+	}
+
+	cuckooset_destroy(s);
+	*s = snew;
+	return 0;
+}
+
+void cuckooset_destroy(struct cuckooset *s)
+{
+	assert(s);
+
+	allocator_free(s->alloc, s->mem);
+}
+
+int cuckooset_ensure_capacity(struct cuckooset *s, size_t n)
+{
+	assert(s);
+	assert(n >= s->count);
+	assert(n <= CK_USABLE(CK_MAX_BUCKETS));
+
+	if (n > s->count_max) {
+		return cuckooset_rehash(s, ck_min_buckets(n, s->nbucket));
+	}
+
+	return 0;
+}
+
+void *cuckooset_item(const struct cuckooset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	size_t i;
+
+	if (!s->count) {
+		return NULL;
+	}
+
+	i = cuckooset_probe(s, key, s->hash(key, s->context));
+	if (i == CK_NOT_FOUND) {
+		return NULL;
+	}
+
+	return cuckooset_slot(s, i);
+}
+
+int cuckooset_set_item(struct cuckooset *s, const void *val)
+{
+	assert(s);
+	assert(val);
+
+	struct cuckooset_pos pos;
+	void *item;
+
+	if ((item = cuckooset_find(s, val, &pos))) {
+		memcpy(item, val, s->width);
+		return 0;
+	}
+
+	return cuckooset_insert(s, &pos, val);
+}
+
+int cuckooset_clear(struct cuckooset *s)
+{
+	assert(s);
+
+	size_t b;
+
+	for (b = 0; b < s->nbucket; b++) {
+		memset(cuckooset_tags(s, b), 0, CUCKOOSET_SLOTS);
+	}
+	s->count = 0;
+	return 0;
+}
+
+int cuckooset_contains(const struct cuckooset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	return cuckooset_item(s, key) != NULL;
+}
+
+int cuckooset_remove(struct cuckooset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	struct cuckooset_pos pos;
+
+	if (!cuckooset_find(s, key, &pos)) {
+		return 0;
+	}
+
+	cuckooset_remove_at(s, &pos);
+	return 1;
+}
+
+int cuckooset_trim_excess(struct cuckooset *s)
+{
+	assert(s);
+
+	return cuckooset_rehash(s, ck_min_buckets(s->count, 0));
+}
+
+size_t cuckooset_copy_to(const struct cuckooset *s, void *dst)
+{
+	assert(s);
+	assert(dst || !s->count);
+
+	const size_t width = s->width;
+	const size_t nslot = s->nbucket * CUCKOOSET_SLOTS;
+	char *out = dst;
+	size_t i;
+
+	for (i = 0; i < nslot; i++) {
+		if (*cuckooset_tag(s, i)) {
+			memcpy(out, cuckooset_slot(s, i), width);
+			out += width;
+		}
+	}
+
+	return s->count;
+}
+
+void *cuckooset_find(const struct cuckooset *s, const void *key,
+		     struct cuckooset_pos *pos)
+{
+	assert(s);
+	assert(key);
+	assert(pos);
+
+	pos->hash = s->hash(key, s->context);
+	pos->existing = (s->count ? cuckooset_probe(s, key, pos->hash)
+			 : CK_NOT_FOUND);
+
+	if (pos->existing == CK_NOT_FOUND) {
+		return NULL;
+	}
+
+	return cuckooset_slot(s, pos->existing);
+}
+
+int cuckooset_insert(struct cuckooset *s, struct cuckooset_pos *pos,
+		     const void *val)
+{
+	assert(s);
+	assert(pos);
+	assert(pos->existing == CK_NOT_FOUND);
+	assert(val);
+
+	size_t i;
+	int err;
+
+	for (;;) {
+		if (s->count < s->count_max
+		    && (i = cuckooset_make_room(s, pos->hash))
+		       != CK_NOT_FOUND) {
+			break;
+		}
+
+		// no room in a table at most half full means a bad hash
+		if (s->count < s->count_max / 2) {
+			return ERANGE;
+		}
+
+		if ((err = cuckooset_rehash(s, ck_min_buckets(s->count + 1,
+							       2 * s->nbucket))))
+		{
+			return err;
+		}
+	}
+
+	memcpy(cuckooset_slot(s, i), val, s->width);
+	*cuckooset_tag(s, i) = ck_tag(pos->hash);
+	s->count++;
+	pos->existing = i;
+	return 0;
+}
+
+int cuckooset_remove_at(struct cuckooset *s, struct cuckooset_pos *pos)
+{
+	assert(s);
+	assert(pos);
+	assert(pos->existing != CK_NOT_FOUND);
+
+	*cuckooset_tag(s, pos->existing) = 0;
+	s->count--;
+	pos->existing = CK_NOT_FOUND;
+	return 0;
+}
+
+struct cuckooset_iter cuckooset_iter_make(const struct cuckooset *s)
+{
+	assert(s);
+
+	struct cuckooset_iter it;
+
+	it.s = s;
+	cuckooset_iter_reset(&it);
+	return it;
+}
+
+void cuckooset_iter_reset(struct cuckooset_iter *it)
+{
+	assert(it);
+
+	it->i = 0;
+	it->val = NULL;
+}
+
+void *cuckooset_iter_advance(struct cuckooset_iter *it)
+{
+	assert(it);
+
+	const struct cuckooset *s = it->s;
+	const size_t nslot = s->nbucket * CUCKOOSET_SLOTS;
+	size_t i = it->i;
+
+	while (i < nslot && !*cuckooset_tag(s, i)) {
+		i++;
+	}
+
+	if (i < nslot) {
+		it->val = cuckooset_slot(s, i);
+		it->i = i + 1;
+		return it->val;
+	}
+
+	it->val = NULL;
+	it->i = i;
+	return NULL;
+}
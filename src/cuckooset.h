@@ -0,0 +1,134 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef CUCKOOSET_H
+#define CUCKOOSET_H
+
+#include <stddef.h>
+
+struct allocator;
+
+/* Slots in a bucket */
+#define CUCKOOSET_SLOTS 4
+
+/* A bucketized cuckoo hash set.  Each element lives in one of two buckets
+ * of CUCKOOSET_SLOTS slots: the first is picked by the hash, and the
+ * second by the first and a 7-bit tag taken from the hash.  A bucket keeps
+ * its slots' tags in front of its elements.  Tables start on a 64-byte
+ * cache line, and a bucket that fits in a line is padded to a power of
+ * two bytes, so it never straddles two; for elements of up to 15 bytes, a
+ * lookup reads at most two cache lines, one per bucket, however many
+ * insertions and removals came before.  It compares only the elements
+ * whose tags match.  Removal just clears a tag; there are no tombstones.
+ *
+ * Since the second bucket depends on the hash only through the tag, the
+ * elements whose first bucket is the same have at most 128 second buckets
+ * between them, and elements that share both first bucket and tag share
+ * both buckets, so at most 2 * CUCKOOSET_SLOTS of them fit.
+ *
+ * An insertion that finds both buckets full searches breadth-first for a
+ * short path of elements to move to their other buckets, and grows the
+ * table if there is none.  A hash so poor that the elements pile into the
+ * same two buckets makes insertion fail with ERANGE, leaving the set as
+ * it was.
+ */
+struct cuckooset {
+	size_t width;
+	size_t (*hash) (const void *, void *);
+	int (*compar) (const void *, const void *, void *);
+	void *context;
+	const struct allocator *alloc;	// NULL for the C library
+
+	void *mem;		// the allocated block; buckets start on a line
+	void *buckets;		// tags (0 if empty), then elements
+	size_t stride;		// bytes per bucket
+	size_t offset;		// of the first element in a bucket
+	size_t nbucket;
+	size_t count;
+	size_t count_max;
+};
+
+struct cuckooset_pos {
+	size_t existing;	// slot holding the key, if found
+	size_t hash;
+};
+
+struct cuckooset_iter {
+	const struct cuckooset *s;
+	size_t i;
+	void *val;
+};
+
+#define CUCKOOSET_VAL(it) ((it).val)
+#define CUCKOOSET_FOREACH(it, set) \
+	for ((it) = cuckooset_iter_make(set); cuckooset_iter_advance(&(it));)
+
+// create, destroy
+int cuckooset_init(struct cuckooset *s, size_t width,
+		   size_t (*hash) (const void *, void *),
+		   int (*compar) (const void *, const void *, void *),
+		   void *context);
+int cuckooset_init_alloc(struct cuckooset *s, size_t width,
+			 size_t (*hash) (const void *, void *),
+			 int (*compar) (const void *, const void *, void *),
+			 void *context, const struct allocator *alloc);
+int cuckooset_init_copy(struct cuckooset *s, const struct cuckooset *src);
+int cuckooset_assign_copy(struct cuckooset *s, const struct cuckooset *src);
+void cuckooset_destroy(struct cuckooset *s);
+
+// properties
+static inline size_t cuckooset_count(const struct cuckooset *s);
+static inline size_t cuckooset_width(const struct cuckooset *s);
+static inline size_t cuckooset_capacity(const struct cuckooset *s);
+int cuckooset_ensure_capacity(struct cuckooset *s, size_t n);
+
+void *cuckooset_item(const struct cuckooset *s, const void *key);
+int cuckooset_set_item(struct cuckooset *s, const void *val);
+
+// methods
+int cuckooset_clear(struct cuckooset *s);
+int cuckooset_contains(const struct cuckooset *s, const void *key);
+int cuckooset_remove(struct cuckooset *s, const void *key);
+int cuckooset_trim_excess(struct cuckooset *s);
+size_t cuckooset_copy_to(const struct cuckooset *s, void *dst);
+
+// position-based operations
+void *cuckooset_find(const struct cuckooset *s, const void *key,
+		     struct cuckooset_pos *pos);
+int cuckooset_insert(struct cuckooset *s, struct cuckooset_pos *pos,
+		     const void *val);
+int cuckooset_remove_at(struct cuckooset *s, struct cuckooset_pos *pos);
+
+// iteration
+struct cuckooset_iter cuckooset_iter_make(const struct cuckooset *s);
+void cuckooset_iter_reset(struct cuckooset_iter *it);
+void *cuckooset_iter_advance(struct cuckooset_iter *it);
+
+// static method definitions
+size_t cuckooset_count(const struct cuckooset *s)
+{
+	return s->count;
+}
+
+size_t cuckooset_width(const struct cuckooset *s)
+{
+	return s->width;
+}
+
+size_t cuckooset_capacity(const struct cuckooset *s)
+{
+	return s->count_max;
+}
+
+#endif // CUCKOOSET_H
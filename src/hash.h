@@ -31,7 +31,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+static inline size_t bytes_hash(const void *ptr, size_t len);
 static inline size_t double_hash(double x);
 static inline size_t float_hash(float x);
 static inline size_t ptr_hash(void *x);
@@ -77,6 +79,31 @@ size_t ptr_hash(void *x)
 	return (size_t)x >> 2;	/* first two bits are typically 0 */
 }
 
+/* Not from boost: mixes in 8 bytes at a time, with a final avalanche
+ * (the multipliers are from MurmurHash3's fmix64).  The result depends on
+ * the byte order.
+ */
+size_t bytes_hash(const void *ptr, size_t len)
+{
+	const unsigned char *p = ptr;
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+	uint64_t w;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+
+	w = 0;
+	memcpy(&w, p, len);
+	h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
 /* from boost/functional/hash/hash.hpp */
 size_t hash_combine(size_t seed, size_t hash)
 {
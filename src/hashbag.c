@@ -0,0 +1,249 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "allocator.h"
+#include "hashbag.h"
+
+
+/* The count in the record that item points to */
+static inline size_t *hashbag_count_at(const struct hashbag *b,
+				       const void *item)
+{
+	return (size_t *)((char *)item + b->offset);
+}
+
+/* Give b its own scratch record, once b->set is set up */
+static int hashbag_init_rec(struct hashbag *b)
+{
+	// zeroed, so the padding between key and count is never garbage
+	if (!(b->rec = allocator_calloc(b->set.alloc, 1, b->set.width))) {
+		hashset_destroy(&b->set);
+		return ENOMEM;
+	}
+	return 0;
+}
+
+int hashbag_init(struct hashbag *b, size_t width,
+		 size_t (*hash) (const void *, void *),
+		 int (*compar) (const void *, const void *, void *),
+		 void *context)
+{
+	return hashbag_init_alloc(b, width, hash, compar, context, NULL);
+}
+
+int hashbag_init_alloc(struct hashbag *b, size_t width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, const struct allocator *alloc)
+{
+	assert(b);
+
+	struct hashset_options opts = { 0 };
+	size_t offset = (width + sizeof(size_t) - 1) / sizeof(size_t)
+		* sizeof(size_t);
+	int err;
+
+	opts.alloc = alloc;
+	if ((err = hashset_init_options(&b->set, offset + sizeof(size_t),
+					hash, compar, context, &opts))) {
+		return err;
+	}
+	b->width = width;
+	b->offset = offset;
+	b->total = 0;
+	return hashbag_init_rec(b);
+}
+
+int hashbag_init_copy(struct hashbag *b, const struct hashbag *src)
+{
+	assert(b);
+	assert(src);
+
+	int err;
+
+	if ((err = hashset_init_copy(&b->set, &src->set))) {
+		return err;
+	}
+	b->width = src->width;
+	b->offset = src->offset;
+	b->total = src->total;
+	return hashbag_init_rec(b);
+}
+
+int hashbag_assign_copy(struct hashbag *b, const struct hashbag *src)
+{
+	assert(b);
+	assert(src);
+
+	struct hashbag bnew;
+	int err;
+
+	if ((err = hashbag_init_copy(&bnew, src))) {
+		return err;
+	}
+
+	hashbag_destroy(b);
+	*b = bnew;
+	return 0;
+}
+
+void hashbag_destroy(struct hashbag *b)
+{
+	assert(b);
+
+	allocator_free(b->set.alloc, b->rec);
+	hashset_destroy(&b->set);
+}
+
+int hashbag_ensure_capacity(struct hashbag *b, size_t n)
+{
+	assert(b);
+
+	return hashset_ensure_capacity(&b->set, n);
+}
+
+/* The number of times key is in the bag; 0 if it isn't */
+size_t hashbag_count(const struct hashbag *b, const void *key)
+{
+	assert(b);
+	assert(key);
+
+	const void *item = hashset_item(&b->set, key);
+	return item ? *hashbag_count_at(b, item) : 0;
+}
+
+int hashbag_add(struct hashbag *b, const void *key, size_t delta)
+{
+	assert(b);
+	assert(key);
+
+	return hashbag_add_hashed(b, key, hashset_hash(&b->set, key), delta);
+}
+
+/* Add delta more of key, inserting it if it's new.  ERANGE if its count or
+ * the total would overflow, in which case nothing changes.
+ */
+int hashbag_add_hashed(struct hashbag *b, const void *key, size_t hash,
+		       size_t delta)
+{
+	assert(b);
+	assert(key);
+
+	struct hashset_pos pos;
+	void *item;
+	int err;
+
+	if (delta > SIZE_MAX - b->total) {
+		return ERANGE;	// a key's count is at most the total
+	}
+	if (!delta) {
+		return 0;
+	}
+
+	if ((item = hashset_find_hashed(&b->set, key, hash, &pos))) {
+		*hashbag_count_at(b, item) += delta;
+	} else {
+		memcpy(b->rec, key, b->width);
+		*hashbag_count_at(b, b->rec) = delta;
+		if ((err = hashset_insert(&b->set, &pos, b->rec))) {
+			return err;
+		}
+	}
+
+	b->total += delta;
+	return 0;
+}
+
+/* Take away up to delta of key, dropping it once none are left; returns
+ * how many were taken.
+ */
+size_t hashbag_remove(struct hashbag *b, const void *key, size_t delta)
+{
+	assert(b);
+	assert(key);
+
+	struct hashset_pos pos;
+	size_t *n;
+	void *item;
+
+	if (!(item = hashset_find(&b->set, key, &pos))) {
+		return 0;
+	}
+
+	n = hashbag_count_at(b, item);
+	if (delta < *n) {
+		*n -= delta;
+	} else {
+		delta = *n;
+		hashset_remove_at(&b->set, &pos);
+	}
+
+	b->total -= delta;
+	return delta;
+}
+
+int hashbag_clear(struct hashbag *b)
+{
+	assert(b);
+
+	b->total = 0;
+	return hashset_clear(&b->set);
+}
+
+int hashbag_trim_excess(struct hashbag *b)
+{
+	assert(b);
+
+	return hashset_trim_excess(&b->set);
+}
+
+struct hashbag_iter hashbag_iter_make(const struct hashbag *b)
+{
+	assert(b);
+
+	struct hashbag_iter it;
+
+	it.b = b;
+	it.it = hashset_iter_make(&b->set);
+	it.key = NULL;
+	it.count = 0;
+	return it;
+}
+
+void hashbag_iter_reset(struct hashbag_iter *it)
+{
+	assert(it);
+
+	hashset_iter_reset(&it->it);
+	it->key = NULL;
+	it->count = 0;
+}
+
+void *hashbag_iter_advance(struct hashbag_iter *it)
+{
+	assert(it);
+
+	if ((it->key = hashset_iter_advance(&it->it))) {
+		it->count = *hashbag_count_at(it->b, it->key);
+	} else {
+		it->count = 0;
+	}
+
+	return it->key;
+}
@@ -0,0 +1,98 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HASHBAG_H
+#define HASHBAG_H
+
+#include "hashset.h"
+
+/* A multiset: each distinct key with the number of times it was added.
+ * Each bucket of the underlying hashset holds a record of the key followed
+ * by its count, so hashbag_add hashes the key once and, with a single
+ * probe, finds either the count (in the same bucket as the key) or the
+ * bucket for a new key.  A key whose count drops to zero is removed.
+ *
+ * hash and compar act on keys; they get passed records, whose first width
+ * bytes are the key, so they must not read past the key.
+ */
+struct hashbag {
+	struct hashset set;	// of records: key, then count at offset
+	size_t width;		// of a key
+	size_t offset;		// of the count in a record
+	void *rec;		// a record to build new entries in
+	size_t total;		// the sum of the counts
+};
+
+struct hashbag_iter {
+	const struct hashbag *b;
+	struct hashset_iter it;
+	void *key;
+	size_t count;
+};
+
+#define HASHBAG_KEY(it) ((it).key)
+#define HASHBAG_COUNT(it) ((it).count)
+#define HASHBAG_FOREACH(it, bag) \
+	for ((it) = hashbag_iter_make(bag); hashbag_iter_advance(&(it));)
+
+// create, destroy
+int hashbag_init(struct hashbag *b, size_t width,
+		 size_t (*hash) (const void *, void *),
+		 int (*compar) (const void *, const void *, void *),
+		 void *context);
+int hashbag_init_alloc(struct hashbag *b, size_t width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, const struct allocator *alloc);
+int hashbag_init_copy(struct hashbag *b, const struct hashbag *src);
+int hashbag_assign_copy(struct hashbag *b, const struct hashbag *src);
+void hashbag_destroy(struct hashbag *b);
+
+// properties
+static inline size_t hashbag_distinct(const struct hashbag *b);
+static inline size_t hashbag_total(const struct hashbag *b);
+static inline size_t hashbag_capacity(const struct hashbag *b);
+int hashbag_ensure_capacity(struct hashbag *b, size_t n);
+
+// methods
+size_t hashbag_count(const struct hashbag *b, const void *key);
+int hashbag_add(struct hashbag *b, const void *key, size_t delta);
+int hashbag_add_hashed(struct hashbag *b, const void *key, size_t hash,
+		       size_t delta);
+size_t hashbag_remove(struct hashbag *b, const void *key, size_t delta);
+int hashbag_clear(struct hashbag *b);
+int hashbag_trim_excess(struct hashbag *b);
+
+// iteration
+struct hashbag_iter hashbag_iter_make(const struct hashbag *b);
+void hashbag_iter_reset(struct hashbag_iter *it);
+void *hashbag_iter_advance(struct hashbag_iter *it);
+
+// static method definitions
+size_t hashbag_distinct(const struct hashbag *b)
+{
+	return hashset_count(&b->set);
+}
+
+size_t hashbag_total(const struct hashbag *b)
+{
+	return b->total;
+}
+
+size_t hashbag_capacity(const struct hashbag *b)
+{
+	return hashset_capacity(&b->set);
+}
+
+#endif // HASHBAG_H
@@ -0,0 +1,161 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include "hashmap.h"
+
+int hashmap_init(struct hashmap *m, size_t key_width, size_t val_width,
+		 size_t (*hash) (const void *, void *),
+		 int (*compar) (const void *, const void *, void *),
+		 void *context)
+{
+	return hashmap_init_alloc(m, key_width, val_width, hash, compar,
+				  context, NULL);
+}
+
+int hashmap_init_alloc(struct hashmap *m, size_t key_width, size_t val_width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, const struct allocator *alloc)
+{
+	assert(m);
+	assert(val_width > 0);
+
+	struct hashset_options opts = { 0 };
+
+	opts.vwidth = val_width;
+	opts.alloc = alloc;
+	return hashset_init_options(&m->set, key_width, hash, compar, context,
+				    &opts);
+}
+
+int hashmap_init_copy(struct hashmap *m, const struct hashmap *src)
+{
+	assert(m);
+	assert(src);
+
+	return hashset_init_copy(&m->set, &src->set);
+}
+
+int hashmap_assign_copy(struct hashmap *m, const struct hashmap *src)
+{
+	assert(m);
+	assert(src);
+
+	return hashset_assign_copy(&m->set, &src->set);
+}
+
+void hashmap_destroy(struct hashmap *m)
+{
+	assert(m);
+
+	hashset_destroy(&m->set);
+}
+
+int hashmap_ensure_capacity(struct hashmap *m, size_t n)
+{
+	assert(m);
+
+	return hashset_ensure_capacity(&m->set, n);
+}
+
+void *hashmap_item(const struct hashmap *m, const void *key)
+{
+	assert(m);
+
+	return hashset_item_value(&m->set, key);
+}
+
+int hashmap_set_item(struct hashmap *m, const void *key, const void *val)
+{
+	assert(m);
+	assert(key);
+	assert(val);
+
+	struct hashset_pos pos;
+	int err;
+
+	if (!hashset_find(&m->set, key, &pos)) {
+		if ((err = hashset_insert(&m->set, &pos, key))) {
+			return err;
+		}
+	}
+
+	memcpy(hashset_value(&m->set, &pos), val, m->set.vwidth);
+	return 0;
+}
+
+int hashmap_clear(struct hashmap *m)
+{
+	assert(m);
+
+	return hashset_clear(&m->set);
+}
+
+int hashmap_contains(const struct hashmap *m, const void *key)
+{
+	assert(m);
+
+	return hashset_contains(&m->set, key);
+}
+
+int hashmap_remove(struct hashmap *m, const void *key)
+{
+	assert(m);
+
+	return hashset_remove(&m->set, key);
+}
+
+int hashmap_trim_excess(struct hashmap *m)
+{
+	assert(m);
+
+	return hashset_trim_excess(&m->set);
+}
+
+struct hashmap_iter hashmap_iter_make(const struct hashmap *m)
+{
+	assert(m);
+
+	struct hashmap_iter it;
+
+	it.it = hashset_iter_make(&m->set);
+	it.key = NULL;
+	it.val = NULL;
+	return it;
+}
+
+void hashmap_iter_reset(struct hashmap_iter *it)
+{
+	assert(it);
+
+	hashset_iter_reset(&it->it);
+	it->key = NULL;
+	it->val = NULL;
+}
+
+void *hashmap_iter_advance(struct hashmap_iter *it)
+{
+	assert(it);
+
+	if ((it->key = hashset_iter_advance(&it->it))) {
+		it->val = hashset_iter_value(&it->it);
+	} else {
+		it->val = NULL;
+	}
+
+	return it->key;
+}
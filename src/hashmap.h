@@ -0,0 +1,82 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include "hashset.h"
+
+/* A map from keys to values, built on hashset.  The keys live in the
+ * probed buckets and the values in a parallel array, so lookups only
+ * touch key bytes until they find a match.  hash and compar act on keys.
+ */
+struct hashmap {
+	struct hashset set;
+};
+
+struct hashmap_iter {
+	struct hashset_iter it;
+	void *key;
+	void *val;
+};
+
+#define HASHMAP_KEY(it) ((it).key)
+#define HASHMAP_VAL(it) ((it).val)
+#define HASHMAP_FOREACH(it, map) \
+	for ((it) = hashmap_iter_make(map); hashmap_iter_advance(&(it));)
+
+// create, destroy
+int hashmap_init(struct hashmap *m, size_t key_width, size_t val_width,
+		 size_t (*hash) (const void *, void *),
+		 int (*compar) (const void *, const void *, void *),
+		 void *context);
+int hashmap_init_alloc(struct hashmap *m, size_t key_width, size_t val_width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, const struct allocator *alloc);
+int hashmap_init_copy(struct hashmap *m, const struct hashmap *src);
+int hashmap_assign_copy(struct hashmap *m, const struct hashmap *src);
+void hashmap_destroy(struct hashmap *m);
+
+// properties
+static inline size_t hashmap_count(const struct hashmap *m);
+static inline size_t hashmap_capacity(const struct hashmap *m);
+int hashmap_ensure_capacity(struct hashmap *m, size_t n);
+
+void *hashmap_item(const struct hashmap *m, const void *key);
+int hashmap_set_item(struct hashmap *m, const void *key, const void *val);
+
+// methods
+int hashmap_clear(struct hashmap *m);
+int hashmap_contains(const struct hashmap *m, const void *key);
+int hashmap_remove(struct hashmap *m, const void *key);
+int hashmap_trim_excess(struct hashmap *m);
+
+// iteration
+struct hashmap_iter hashmap_iter_make(const struct hashmap *m);
+void hashmap_iter_reset(struct hashmap_iter *it);
+void *hashmap_iter_advance(struct hashmap_iter *it);
+
+// static method definitions
+size_t hashmap_count(const struct hashmap *m)
+{
+	return hashset_count(&m->set);
+}
+
+size_t hashmap_capacity(const struct hashmap *m)
+{
+	return hashset_capacity(&m->set);
+}
+
+#endif // HASHMAP_H
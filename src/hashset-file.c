@@ -0,0 +1,368 @@
+// Copyright (c) 2005, Google Inc.
+// Copyright (c) 2011, Patrick O. Perry
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following disclaimer
+//       in the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the names of Patrick O. Perry, Google Inc,. nor the names of
+//       their contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/* hashset_save and hashset_map: a table written to a file in its in-memory
+ * layout, and mapped back read-only.
+ */
+
+#include <assert.h>		// assert
+#include <errno.h>		// EINVAL, ENOMEM
+#include <fcntl.h>		// open
+#include <stddef.h>		// size_t, NULL
+#include <stdint.h>		// uint32_t, uint64_t, SIZE_MAX
+#include <string.h>		// memset, memcpy, memcmp
+#include <sys/mman.h>		// mmap, munmap
+#include <sys/stat.h>		// fstat
+#include <unistd.h>		// close, write
+
+#include "allocator.h"
+#include "hashset.h"
+#include "hashset-group.h"
+#include "hashset-internal.h"
+
+/* The saved format: this header, then the arrays, each at an offset that
+ * is a multiple of HT_FILE_ALIGN (0 if the array is absent).  Everything
+ * is in the saving machine's byte order.
+ */
+#define HT_FILE_MAGIC	"HASHSET"
+#define HT_FILE_VERSION	1
+#define HT_FILE_ENDIAN	0x01020304
+#define HT_FILE_ALIGN	64
+
+/* hashset_save writes the arrays through a buffer of this many bytes, or
+ * of one element if that is bigger */
+#define HT_FILE_BUF	16384
+
+struct hashset_file {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t size_width;	// sizeof(size_t)
+	uint32_t group_width;	// HT_GROUP_WIDTH
+	uint64_t width;
+	uint64_t vwidth;
+	uint64_t flags;
+	uint64_t load_pct;
+	uint64_t probe;
+	uint64_t nbucket;
+	uint64_t count;
+	uint64_t ndeleted;
+	uint64_t buckets;	// offsets into the file
+	uint64_t vals;
+	uint64_t status;
+	uint64_t hashes;
+	uint64_t size;		// of the whole file
+};
+
+/* Only these flags make sense for a mapped table */
+#define HT_FILE_FLAGS	HASHSET_CACHE_HASH
+
+static uint64_t hashset_file_place(uint64_t *size, uint64_t len)
+{
+	uint64_t off = (*size + HT_FILE_ALIGN - 1) / HT_FILE_ALIGN
+		       * HT_FILE_ALIGN;
+
+	*size = off + len;
+	return off;
+}
+
+static int hashset_write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/* Write len bytes of buf at offset off, padding with zeros from *pos */
+static int hashset_write_at(int fd, uint64_t *pos, uint64_t off,
+			    const void *buf, size_t len)
+{
+	static const char zeros[HT_FILE_ALIGN];
+	int err;
+
+	assert(off - *pos <= HT_FILE_ALIGN);
+
+	if ((err = hashset_write_all(fd, zeros, (size_t)(off - *pos)))
+	    || (err = hashset_write_all(fd, buf, len))) {
+		return err;
+	}
+	*pos = off + len;
+	return 0;
+}
+
+/* Write the array arr, which has size bytes for each bucket of s, at
+ * offset off, with the entries of the buckets that aren't full zeroed:
+ * neither hashset_remove nor hashset_clear wipes a bucket, and what was in
+ * it doesn't belong in the file.  buf has room for nbuf bytes, at least
+ * size of them.
+ */
+static int hashset_write_full(const struct hashset *s, int fd, uint64_t *pos,
+			      uint64_t off, const void *arr, size_t size,
+			      char *buf, size_t nbuf)
+{
+	const char *src = arr;
+	const size_t chunk = nbuf / size;
+	size_t i, j, n;
+	int err;
+
+	for (i = 0; i < s->nbucket; i += n) {
+		n = s->nbucket - i < chunk ? s->nbucket - i : chunk;
+		memcpy(buf, src + i * size, n * size);
+		for (j = 0; j < n; j++) {
+			if (!(s->status[i + j] & HT_BUCKET_FULL)) {
+				memset(buf + j * size, 0, size);
+			}
+		}
+		if ((err = hashset_write_at(fd, pos, i ? *pos : off, buf,
+					    n * size))) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+/* The file must be opened for writing, and positioned where the table
+ * should start (normally, at the start of an empty file).
+ */
+int hashset_save(const struct hashset *s, int fd)
+{
+	assert(s);
+
+	struct hashset_file h;
+	struct hashset tmp;
+	const size_t nbucket = s->nbucket;
+	size_t nbuf = HT_FILE_BUF;
+	uint64_t pos;
+	char *buf;
+	int err;
+
+	if (hashset_old(s) || hashset_is_small(s)) {
+		// write a copy with a single, ordinary table
+		if ((err = hashset_init_copy(&tmp, s))) {
+			return err;
+		}
+		err = hashset_save(&tmp, fd);
+		hashset_destroy(&tmp);
+		return err;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, HT_FILE_MAGIC, sizeof(HT_FILE_MAGIC));
+	h.version = HT_FILE_VERSION;
+	h.endian = HT_FILE_ENDIAN;
+	h.size_width = sizeof(size_t);
+	h.group_width = HT_GROUP_WIDTH;
+	h.width = s->width;
+	h.vwidth = s->vwidth;
+	h.flags = s->flags & HT_FILE_FLAGS;
+	h.load_pct = s->load_pct;
+	h.probe = s->probe;
+	h.nbucket = nbucket;
+	h.count = s->count;
+	h.ndeleted = s->ndeleted;
+
+	h.size = sizeof(h);
+	if (nbucket) {
+		h.buckets = hashset_file_place(&h.size, nbucket * s->width);
+		h.status = hashset_file_place(&h.size,
+					      ht_status_size(nbucket));
+		if (s->vwidth) {
+			h.vals = hashset_file_place(&h.size,
+						    nbucket * s->vwidth);
+		}
+		if (s->flags & HASHSET_CACHE_HASH) {
+			h.hashes = hashset_file_place(&h.size, nbucket
+						      * sizeof(size_t));
+		}
+	}
+
+	pos = 0;
+	if ((err = hashset_write_at(fd, &pos, 0, &h, sizeof(h)))) {
+		return err;
+	}
+	if (!nbucket) {
+		return 0;
+	}
+
+	if (nbuf < s->width) {
+		nbuf = s->width;
+	}
+	if (nbuf < s->vwidth) {
+		nbuf = s->vwidth;
+	}
+	if (!(buf = allocator_malloc(s->alloc, nbuf))) {
+		return ENOMEM;
+	}
+	if ((err = hashset_write_full(s, fd, &pos, h.buckets, s->buckets,
+				      s->width, buf, nbuf))
+	    || (err = hashset_write_at(fd, &pos, h.status, s->status,
+				       ht_status_size(nbucket)))
+	    || (h.vals && (err = hashset_write_full(s, fd, &pos, h.vals,
+						    s->vals, s->vwidth, buf,
+						    nbuf)))
+	    || (h.hashes && (err = hashset_write_full(s, fd, &pos, h.hashes,
+						      hashset_hashes(s),
+						      sizeof(size_t), buf,
+						      nbuf)))) {
+		allocator_free(s->alloc, buf);
+		return err;
+	}
+
+	allocator_free(s->alloc, buf);
+	return 0;
+}
+
+/* Does the array at off, len bytes long, fit in the file? */
+static int hashset_file_fits(const struct hashset_file *h, uint64_t off,
+			     uint64_t len)
+{
+	return (off >= sizeof(*h) && off % HT_FILE_ALIGN == 0
+		&& off <= h->size && len <= h->size - off);
+}
+
+static int hashset_file_check(const struct hashset_file *h, uint64_t size)
+{
+	uint64_t n = h->nbucket;
+
+	if (memcmp(h->magic, HT_FILE_MAGIC, sizeof(HT_FILE_MAGIC))
+	    || h->version != HT_FILE_VERSION || h->endian != HT_FILE_ENDIAN
+	    || h->size_width != sizeof(size_t)
+	    || h->group_width != HT_GROUP_WIDTH || h->size != size
+	    || (h->flags & ~(uint64_t)HT_FILE_FLAGS)
+	    || h->load_pct == 0 || h->load_pct > HASHSET_MAX_LOAD_PCT
+	    || h->probe > HASHSET_PROBE_DOUBLE) {
+		return EINVAL;
+	}
+
+	if (!n) {
+		return h->count ? EINVAL : 0;
+	}
+
+	// sizes first, so the products below can't overflow
+	if (n < HT_MIN_BUCKETS || n > HT_MAX_BUCKETS || (n & (n - 1))
+	    || h->count > n || h->ndeleted > n
+	    || h->count + h->ndeleted > PERCENT((size_t)h->load_pct,
+						(size_t)n)
+	    || h->width > size / n || h->vwidth > size / n
+	    || !hashset_file_fits(h, h->buckets, n * h->width)
+	    || !hashset_file_fits(h, h->status, ht_status_size(n))
+	    || (h->vwidth && !hashset_file_fits(h, h->vals, n * h->vwidth))
+	    || ((h->flags & HASHSET_CACHE_HASH)
+		&& !hashset_file_fits(h, h->hashes, n * sizeof(size_t)))) {
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+int hashset_map(struct hashset *s, const char *path,
+		size_t (*hash) (const void *, void *),
+		int (*compar) (const void *, const void *, void *),
+		void *context)
+{
+	assert(s);
+	assert(path);
+
+	const struct hashset_file *h;
+	struct stat st;
+	char *base;
+	size_t size;
+	int fd, err;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return errno;
+	}
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+	if (st.st_size < (off_t)sizeof(*h)
+	    || (uint64_t)st.st_size > SIZE_MAX) {
+		close(fd);
+		return EINVAL;
+	}
+
+	size = (size_t)st.st_size;
+	base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	err = errno;
+	close(fd);	// the mapping keeps the file
+	if (base == MAP_FAILED) {
+		return err;
+	}
+
+	h = (const struct hashset_file *)base;
+	if ((err = hashset_file_check(h, size))) {
+		munmap(base, size);
+		return err;
+	}
+
+	hashset_init_params(s, (size_t)h->width, (size_t)h->vwidth, hash,
+			    compar, context, (unsigned)h->flags, NULL);
+	if (!hashset_need_ext(s)) {
+		munmap(base, size);
+		return ENOMEM;
+	}
+	s->load_pct = (unsigned char)h->load_pct;
+	s->probe = (unsigned char)h->probe;
+	if (h->nbucket) {
+		s->nbucket = (size_t)h->nbucket;
+		s->buckets = base + h->buckets;
+		s->status = (unsigned char *)base + h->status;
+		s->vals = h->vals ? base + h->vals : NULL;
+		s->ext->hashes = (h->hashes ? (size_t *)(base + h->hashes)
+				  : NULL);
+		s->count = (size_t)h->count;
+		s->ndeleted = (size_t)h->ndeleted;
+		hashset_reset_thresholds(s, s->nbucket);
+	}
+	s->ext->map = base;
+	s->ext->map_size = size;
+	return 0;
+}
+
+void hashset_unmap(struct hashset *s)
+{
+	assert(hashset_is_mapped(s));
+
+	munmap(s->ext->map, s->ext->map_size);
+}
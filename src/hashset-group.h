@@ -0,0 +1,319 @@
+// Copyright (c) 2005, Google Inc.
+// Copyright (c) 2011, Patrick O. Perry
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following disclaimer
+//       in the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the names of Patrick O. Perry, Google Inc,. nor the names of
+//       their contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef HASHSET_GROUP_H
+#define HASHSET_GROUP_H
+
+/* The bucket layout and group probing primitives shared by hashset.c and
+ * the specialized sets generated by hashset-impl.h.
+ */
+
+#include <assert.h>		// assert
+#include <limits.h>		// CHAR_BIT
+#include <stddef.h>		// size_t
+#include <stdint.h>		// uint64_t, SIZE_MAX
+#if defined(__SSE2__)
+# include <emmintrin.h>		// _mm_loadu_si128, _mm_movemask_epi8
+#endif
+
+/* Each bucket has a control byte in the status array.  Empty and deleted
+ * buckets have the high bit clear; full buckets have it set, and keep 7
+ * bits of the hash in the low bits so that most mismatches can be ruled
+ * out without calling compar.
+ */
+#define  HT_BUCKET_EMPTY   0
+#define  HT_BUCKET_DELETED 1
+#define  HT_BUCKET_FULL    0x80
+
+/* Buckets are probed a group at a time: we load the control bytes for
+ * HT_GROUP_WIDTH consecutive buckets and compare them all at once.
+ * Groups are aligned, so bucket i belongs to group i / HT_GROUP_WIDTH.
+ */
+#define HT_GROUP_WIDTH 16
+
+/* The probing method (the jump is between groups, not buckets) */
+/* #define JUMP_(key, num_probes) (1)          // Linear probing */
+#define JUMP_(key, num_probes)    (num_probes)	// Quadratic probing
+
+/* How full we let the table get before we resize, by default.
+ * Knuth says .8 is good -- higher causes us to probe too much,
+ * though it saves memory.
+ */
+#define HT_OCCUPANCY_PCT 80	// (out of 100);
+
+/* Minimum size we're willing to let hashtables be.
+ * Must be a power of two, and at least 4.
+ * Note, however, that for a given hashtable, the initial size is a
+ * function of the first constructor arg, and may be >HT_MIN_BUCKETS.
+ */
+#define HT_MIN_BUCKETS	4
+
+/* Deleted buckets count against the occupancy, since probes have to step
+ * over them.  When the table fills up, we drop them with a rehash at the
+ * same size instead of growing, provided the live elements take up at most
+ * this fraction of the allowed occupancy.  Otherwise we would have to
+ * purge again too soon.
+ */
+#define HT_PURGE_PCT	80	// (out of 100)
+
+/* The number of buckets must be a power of 2.  This is the largest 
+ * power of 2 that a size_t can hold.
+ */
+#define HT_MAX_BUCKETS	((size_t)1 << (CHAR_BIT * sizeof(size_t) - 1))
+
+/* The following is more accurate than ((pct)/100.0 * (x)) when x is
+ * really big (> 2^52).
+ */
+#define PERCENT(pct,x) \
+	((pct) * ((x) / 100) \
+	 + (size_t)((pct) * (((x) % 100) / 100.0)))
+
+#define HT_MAX_COUNT	PERCENT(HT_OCCUPANCY_PCT, HT_MAX_BUCKETS)
+
+/* The tag for a full bucket: the high bit, plus 7 bits from a
+ * multiplicative mix of the hash.  We mix because the low bits of the hash
+ * pick the bucket, and for simple hashes (like the identity on integers)
+ * the high bits are often all zero.
+ */
+#if SIZE_MAX > 0xffffffffUL
+# define HT_TAG_MULT	((size_t)0x9e3779b97f4a7c15ULL)
+#else
+# define HT_TAG_MULT	((size_t)0x9e3779b9UL)
+#endif
+#define HT_TAG_SHIFT	(CHAR_BIT * sizeof(size_t) - 7)
+
+static inline unsigned char ht_tag(size_t hash)
+{
+	return HT_BUCKET_FULL | (unsigned char)((hash * HT_TAG_MULT)
+						>> HT_TAG_SHIFT);
+}
+
+#if defined(__GNUC__)
+# define HT_PREFETCH(addr) __builtin_prefetch((addr), 0)
+# define HT_PREFETCH_WRITE(addr) __builtin_prefetch((addr), 1)
+#else
+# define HT_PREFETCH(addr) ((void)(addr))
+# define HT_PREFETCH_WRITE(addr) ((void)(addr))
+#endif
+
+static inline unsigned ht_ctz(unsigned x)
+{
+	assert(x);
+#if defined(__GNUC__)
+	return (unsigned)__builtin_ctz(x);
+#else
+	unsigned n = 0;
+	while (!(x & 1)) {
+		x >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/* Group matching.  Each of these returns a bit mask with bit i set if
+ * control byte ctrl[i] matches, for i in 0, ..., HT_GROUP_WIDTH - 1.
+ */
+#if defined(__SSE2__)
+
+static inline __m128i ht_group_load(const unsigned char *ctrl)
+{
+	return _mm_loadu_si128((const __m128i *)ctrl);
+}
+
+static inline unsigned ht_group_match(const unsigned char *ctrl,
+				      unsigned char tag)
+{
+	__m128i g = ht_group_load(ctrl);
+	__m128i t = _mm_set1_epi8((char)tag);
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(g, t));
+}
+
+static inline unsigned ht_group_match_empty(const unsigned char *ctrl)
+{
+	__m128i g = ht_group_load(ctrl);
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(g,
+							  _mm_setzero_si128()));
+}
+
+static inline unsigned ht_group_match_free(const unsigned char *ctrl)
+{
+	return ~(unsigned)_mm_movemask_epi8(ht_group_load(ctrl)) & 0xffffU;
+}
+
+static inline unsigned ht_group_match_full(const unsigned char *ctrl)
+{
+	return (unsigned)_mm_movemask_epi8(ht_group_load(ctrl));
+}
+
+#else /* portable SWAR fallback, two 64-bit words per group */
+
+#define HT_LSB	0x0101010101010101ULL
+#define HT_MSB	0x8080808080808080ULL
+#define HT_LOW7	0x7f7f7f7f7f7f7f7fULL
+
+static inline uint64_t ht_load64(const unsigned char *p)
+{
+	uint64_t x = 0;
+	int i;
+
+	/* compilers turn this into a single load on little-endian targets */
+	for (i = 7; i >= 0; i--) {
+		x = (x << 8) | p[i];
+	}
+	return x;
+}
+
+/* set the high bit of every zero byte (exactly, no false positives) */
+static inline uint64_t ht_word_zero(uint64_t x)
+{
+	return ~(((x & HT_LOW7) + HT_LOW7) | x | HT_LOW7);
+}
+
+/* gather the high bit of each byte into the low 8 bits */
+static inline unsigned ht_word_mask(uint64_t msb)
+{
+	return (unsigned)(((msb >> 7) * 0x0102040810204080ULL) >> 56);
+}
+
+static inline unsigned ht_group_match(const unsigned char *ctrl,
+				      unsigned char tag)
+{
+	uint64_t t = HT_LSB * tag;
+	return (ht_word_mask(ht_word_zero(ht_load64(ctrl) ^ t))
+		| ht_word_mask(ht_word_zero(ht_load64(ctrl + 8) ^ t)) << 8);
+}
+
+static inline unsigned ht_group_match_empty(const unsigned char *ctrl)
+{
+	return (ht_word_mask(ht_word_zero(ht_load64(ctrl)))
+		| ht_word_mask(ht_word_zero(ht_load64(ctrl + 8))) << 8);
+}
+
+static inline unsigned ht_group_match_free(const unsigned char *ctrl)
+{
+	return (ht_word_mask(~ht_load64(ctrl) & HT_MSB)
+		| ht_word_mask(~ht_load64(ctrl + 8) & HT_MSB) << 8);
+}
+
+static inline unsigned ht_group_match_full(const unsigned char *ctrl)
+{
+	return (ht_word_mask(ht_load64(ctrl) & HT_MSB)
+		| ht_word_mask(ht_load64(ctrl + 8) & HT_MSB) << 8);
+}
+
+#endif /* __SSE2__ */
+
+/* The first free bucket at or after offset start in the group, wrapping
+ * around to the beginning of the group; avail must be nonzero.
+ */
+static inline unsigned ht_first_free(unsigned avail, unsigned start)
+{
+	unsigned after = avail >> start;
+
+	if (after & 1)
+		return start;	// the common case; keep it easy to predict
+	if (after)
+		return start + ht_ctz(after);
+	return ht_ctz(avail);
+}
+
+/* Tables smaller than a group only use the first nbucket control bytes
+ * (the status array is always padded out to a full group).
+ */
+static inline unsigned ht_group_mask(size_t nbucket)
+{
+	if (nbucket >= HT_GROUP_WIDTH)
+		return (1U << HT_GROUP_WIDTH) - 1;
+	return (1U << nbucket) - 1;
+}
+
+static inline size_t ht_group_count(size_t nbucket)
+{
+	return (nbucket + HT_GROUP_WIDTH - 1) / HT_GROUP_WIDTH;
+}
+
+static inline size_t ht_status_size(size_t nbucket)
+{
+	return nbucket < HT_GROUP_WIDTH ? HT_GROUP_WIDTH : nbucket;
+}
+
+/* The first full bucket at or after i, or nbucket if there is none.  This
+ * skips a group of empty or deleted buckets at a time.
+ */
+static inline size_t ht_next_full(const unsigned char *status, size_t nbucket,
+				  size_t i)
+{
+	const unsigned mask = ht_group_mask(nbucket);
+	size_t group = i / HT_GROUP_WIDTH;
+	unsigned full;
+
+	if (i >= nbucket)
+		return nbucket;
+
+	full = (ht_group_match_full(status + group * HT_GROUP_WIDTH) & mask
+		& (~0U << (i % HT_GROUP_WIDTH)));
+	while (!full) {
+		group++;
+		if (group * HT_GROUP_WIDTH >= nbucket)
+			return nbucket;
+		full = ht_group_match_full(status + group * HT_GROUP_WIDTH);
+	}
+
+	return group * HT_GROUP_WIDTH + ht_ctz(full);
+}
+
+/* This is the smallest size a hashtable can be without being too crowded
+ * If you like, you can give a min #buckets as well as a min #elts */
+static inline size_t ht_min_buckets_pct(size_t count, size_t nbucket0,
+					unsigned pct)
+{
+	assert(count <= PERCENT(pct, HT_MAX_BUCKETS));
+	assert(nbucket0 <= HT_MAX_BUCKETS);
+
+	size_t n = HT_MIN_BUCKETS;	// min buckets allowed
+
+	while (n < nbucket0 || count > PERCENT(pct, n)) {
+		assert(2 * n > n);
+		n *= 2;
+	}
+
+	assert(n >= nbucket0);
+	assert(count <= PERCENT(pct, n));
+
+	return n;
+}
+
+static inline size_t ht_min_buckets(size_t count, size_t nbucket0)
+{
+	return ht_min_buckets_pct(count, nbucket0, HT_OCCUPANCY_PCT);
+}
+
+#endif // HASHSET_GROUP_H
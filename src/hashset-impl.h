@@ -0,0 +1,425 @@
+// Copyright (c) 2005, Google Inc.
+// Copyright (c) 2011, Patrick O. Perry
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following disclaimer
+//       in the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the names of Patrick O. Perry, Google Inc,. nor the names of
+//       their contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/* A hashset specialized for one element type, with the hash and equality
+ * tests inlined.  Define the following, then include this file:
+ *
+ *   HASHSET_NAME		prefix for the generated struct and functions
+ *   HASHSET_TYPE		the element type
+ *   HASHSET_HASH(x)		the hash (a size_t) of an element x
+ *   HASHSET_EQUAL(x, y)	nonzero if elements x and y are equal
+ *
+ * The arguments to HASHSET_HASH and HASHSET_EQUAL are lvalues of type
+ * HASHSET_TYPE.  For example,
+ *
+ *   #define HASHSET_NAME int_hashset
+ *   #define HASHSET_TYPE int
+ *   #define HASHSET_HASH(x) ((size_t)(x))
+ *   #define HASHSET_EQUAL(x, y) ((x) == (y))
+ *   #include "hashset-impl.h"
+ *   #undef HASHSET_EQUAL
+ *   #undef HASHSET_HASH
+ *   #undef HASHSET_TYPE
+ *   #undef HASHSET_NAME
+ *
+ * defines struct int_hashset, with int_hashset_init, int_hashset_set_item,
+ * and so on.  These behave like their hashset counterparts, but take
+ * HASHSET_TYPE pointers.  All of the functions are static, so include the
+ * file in each translation unit that uses the set.
+ */
+
+#include <assert.h>		// assert
+#include <errno.h>		// ENOMEM
+#include <stddef.h>		// size_t, NULL
+#include <stdlib.h>		// malloc, calloc, free
+#include <string.h>		// memset
+#include "hashset-group.h"
+
+#define HS_CONCAT(x, y) x ## _ ## y
+#define HS_MAKE_STR(x, y) HS_CONCAT(x, y)
+#define HS_NAME(x) HS_MAKE_STR(HASHSET_NAME, x)
+#define HS_SET struct HASHSET_NAME
+#define HS_ITER struct HS_NAME(iter)
+
+HS_SET {
+	size_t nbucket;
+	HASHSET_TYPE *buckets;
+	unsigned char *status;
+
+	size_t count;
+	size_t count_max;
+	size_t ndeleted;	// tombstones
+};
+
+HS_ITER {
+	const HS_SET *s;
+	size_t i;
+	HASHSET_TYPE *val;
+};
+
+/* Look for key, whose hash is given; see hashset_probe in hashset.c */
+static inline size_t HS_NAME(probe) (const HS_SET *s, const HASHSET_TYPE *key,
+				     size_t hash, size_t *insert)
+{
+	const unsigned char *status = s->status;
+	const size_t bucket_count = s->nbucket;
+	const unsigned char tag = ht_tag(hash);
+	const unsigned group_mask = ht_group_mask(bucket_count);
+	const size_t group_count = ht_group_count(bucket_count);
+	const size_t group_count_minus_one = group_count - 1;
+	size_t num_probes = 0;	// how many groups we've probed
+	size_t bucknum = hash & (bucket_count - 1);	// the home bucket
+	size_t group = bucknum / HT_GROUP_WIDTH;
+	const unsigned home = (unsigned)(bucknum % HT_GROUP_WIDTH);
+	const unsigned char *ctrl;
+	unsigned match, avail;
+
+	if (insert) {
+		*insert = HT_MAX_BUCKETS;
+		HT_PREFETCH_WRITE(s->buckets + bucknum);
+	}
+
+	if (status[bucknum] == tag
+	    && HASHSET_EQUAL(*key, s->buckets[bucknum])) {
+		return bucknum;
+	}
+
+	for (num_probes = 0; num_probes < group_count; num_probes++) {
+		ctrl = status + group * HT_GROUP_WIDTH;
+
+		match = ht_group_match(ctrl, tag) & group_mask;
+		if (num_probes == 0) {
+			match &= ~(1U << home);	// already checked
+		}
+		while (match) {
+			bucknum = group * HT_GROUP_WIDTH + ht_ctz(match);
+			match &= match - 1;
+			if (HASHSET_EQUAL(*key, s->buckets[bucknum])) {
+				return bucknum;
+			}
+		}
+
+		if (insert && *insert == HT_MAX_BUCKETS) {
+			if ((avail = ht_group_match_free(ctrl) & group_mask)) {
+				*insert = group * HT_GROUP_WIDTH
+					+ ht_first_free(avail, num_probes
+							? 0 : home);
+			}
+		}
+
+		if (ht_group_match_empty(ctrl) & group_mask) {
+			break;	// an empty bucket ends the probe sequence
+		}
+
+		group = (group + JUMP_(hash, num_probes + 1))
+			& group_count_minus_one;
+	}
+
+	return HT_MAX_BUCKETS;
+}
+
+/* The first free bucket in the probe sequence for hash */
+static inline size_t HS_NAME(probe_free) (const HS_SET *s, size_t hash)
+{
+	const unsigned char *status = s->status;
+	const size_t bucket_count = s->nbucket;
+	const unsigned group_mask = ht_group_mask(bucket_count);
+	const size_t group_count_minus_one = ht_group_count(bucket_count) - 1;
+	size_t num_probes = 0;	// how many groups we've probed
+	size_t bucknum = hash & (bucket_count - 1);	// the home bucket
+	size_t group = bucknum / HT_GROUP_WIDTH;
+	unsigned home = (unsigned)(bucknum % HT_GROUP_WIDTH);
+	unsigned avail;
+
+	if (!(status[bucknum] & HT_BUCKET_FULL)) {
+		return bucknum;
+	}
+
+	for (;;) {
+		avail = (ht_group_match_free(status + group * HT_GROUP_WIDTH)
+			 & group_mask);
+		if (avail) {
+			return group * HT_GROUP_WIDTH
+				+ ht_first_free(avail, num_probes ? 0 : home);
+		}
+		num_probes++;
+		assert(num_probes <= group_count_minus_one);
+		group = (group + JUMP_(hash, num_probes))
+			& group_count_minus_one;
+	}
+}
+
+/* Put val, which is not in the table, in bucket ix */
+static inline void HS_NAME(insert_at) (HS_SET *s, size_t ix,
+				       const HASHSET_TYPE *val, size_t hash)
+{
+	if (s->status[ix] == HT_BUCKET_DELETED) {
+		s->ndeleted--;
+	}
+	s->count++;
+	s->status[ix] = ht_tag(hash);
+	s->buckets[ix] = *val;
+}
+
+/* Rebuild the table with nbucket buckets, dropping the tombstones */
+static inline int HS_NAME(rehash) (HS_SET *s, size_t nbucket)
+{
+	HS_SET snew;
+	size_t i, ix, hash;
+
+	assert(nbucket >= HT_MIN_BUCKETS);
+	assert(s->count <= PERCENT(HT_OCCUPANCY_PCT, nbucket));
+
+	snew.buckets = malloc(nbucket * sizeof(snew.buckets[0]));
+	snew.status = calloc(ht_status_size(nbucket), sizeof(snew.status[0]));
+	if (snew.buckets == NULL || snew.status == NULL) {
+		free(snew.buckets);
+		free(snew.status);
+		return ENOMEM;
+	}
+	snew.nbucket = nbucket;
+	snew.count = 0;
+	snew.count_max = PERCENT(HT_OCCUPANCY_PCT, nbucket);
+	snew.ndeleted = 0;
+
+	for (i = ht_next_full(s->status, s->nbucket, 0); i < s->nbucket;
+	     i = ht_next_full(s->status, s->nbucket, i + 1)) {
+		hash = HASHSET_HASH(s->buckets[i]);
+		ix = HS_NAME(probe_free) (&snew, hash);
+		HS_NAME(insert_at) (&snew, ix, &s->buckets[i], hash);
+	}
+
+	free(s->status);
+	free(s->buckets);
+	*s = snew;
+	return 0;
+}
+
+static inline int HS_NAME(grow_delta) (HS_SET *s, size_t delta)
+{
+	assert(delta <= HT_MAX_COUNT - s->nbucket);
+
+	size_t nbucket0 = s->nbucket;
+	size_t count = s->count + delta;
+	size_t nbucket = ht_min_buckets(count, nbucket0);
+
+	if (nbucket == nbucket0 && s->ndeleted
+	    && count > PERCENT(HT_PURGE_PCT, s->count_max)) {
+		// dropping the tombstones would not buy enough room
+		nbucket = ht_min_buckets(count, 2 * nbucket0);
+	}
+
+	return HS_NAME(rehash) (s, nbucket);
+}
+
+static inline int HS_NAME(init) (HS_SET *s)
+{
+	assert(s);
+
+	s->nbucket = 0;
+	s->buckets = NULL;
+	s->status = NULL;
+	s->count = 0;
+	s->count_max = 0;
+	s->ndeleted = 0;
+	return 0;
+}
+
+static inline void HS_NAME(destroy) (HS_SET *s)
+{
+	assert(s);
+
+	free(s->status);
+	free(s->buckets);
+}
+
+static inline size_t HS_NAME(count) (const HS_SET *s)
+{
+	return s->count;
+}
+
+static inline size_t HS_NAME(capacity) (const HS_SET *s)
+{
+	return s->count_max;
+}
+
+static inline int HS_NAME(ensure_capacity) (HS_SET *s, size_t n)
+{
+	assert(s);
+	assert(n >= s->count);
+	assert(n <= HT_MAX_COUNT);
+
+	if (n > s->count_max - s->ndeleted) {
+		return HS_NAME(grow_delta) (s, n - s->count);
+	}
+
+	return 0;
+}
+
+static inline HASHSET_TYPE *HS_NAME(item) (const HS_SET *s,
+					   const HASHSET_TYPE *key)
+{
+	assert(s);
+	assert(key);
+
+	size_t bucknum;
+
+	if (!s->count) {
+		return NULL;
+	}
+
+	bucknum = HS_NAME(probe) (s, key, HASHSET_HASH(*key), NULL);
+	if (bucknum == HT_MAX_BUCKETS) {
+		return NULL;
+	}
+
+	return &s->buckets[bucknum];
+}
+
+static inline int HS_NAME(contains) (const HS_SET *s, const HASHSET_TYPE *key)
+{
+	return HS_NAME(item) (s, key) != NULL;
+}
+
+static inline int HS_NAME(set_item) (HS_SET *s, const HASHSET_TYPE *val)
+{
+	assert(s);
+	assert(val);
+
+	size_t hash = HASHSET_HASH(*val);
+	size_t bucknum, insert = HT_MAX_BUCKETS;
+	int err;
+
+	if (s->count) {
+		bucknum = HS_NAME(probe) (s, val, hash, &insert);
+		if (bucknum != HT_MAX_BUCKETS) {
+			s->buckets[bucknum] = *val;
+			return 0;
+		}
+	}
+
+	if (s->count + s->ndeleted == s->count_max) {
+		if ((err = HS_NAME(grow_delta) (s, 1))) {
+			return err;
+		}
+		insert = HS_NAME(probe_free) (s, hash);
+	} else if (insert == HT_MAX_BUCKETS) {	// the table is empty
+		insert = HS_NAME(probe_free) (s, hash);
+	}
+
+	HS_NAME(insert_at) (s, insert, val, hash);
+	return 0;
+}
+
+static inline int HS_NAME(remove) (HS_SET *s, const HASHSET_TYPE *key)
+{
+	assert(s);
+	assert(key);
+
+	const unsigned char *ctrl;
+	size_t bucknum;
+
+	if (!s->count) {
+		return 0;
+	}
+
+	bucknum = HS_NAME(probe) (s, key, HASHSET_HASH(*key), NULL);
+	if (bucknum == HT_MAX_BUCKETS) {
+		return 0;
+	}
+
+	// see hashset_erase in hashset.c
+	ctrl = s->status + bucknum - bucknum % HT_GROUP_WIDTH;
+	if (ht_group_match_empty(ctrl) & ht_group_mask(s->nbucket)) {
+		s->status[bucknum] = HT_BUCKET_EMPTY;
+	} else {
+		s->status[bucknum] = HT_BUCKET_DELETED;
+		s->ndeleted++;
+	}
+	s->count--;
+	return 1;
+}
+
+static inline int HS_NAME(clear) (HS_SET *s)
+{
+	assert(s);
+
+	if (s->status) {
+		memset(s->status, 0, s->nbucket * sizeof(s->status[0]));
+	}
+	s->count = 0;
+	s->ndeleted = 0;
+	return 0;
+}
+
+static inline HS_ITER HS_NAME(iter_make) (const HS_SET *s)
+{
+	assert(s);
+
+	HS_ITER it;
+
+	it.s = s;
+	it.i = 0;
+	it.val = NULL;
+	return it;
+}
+
+static inline void HS_NAME(iter_reset) (HS_ITER *it)
+{
+	assert(it);
+
+	it->i = 0;
+	it->val = NULL;
+}
+
+static inline HASHSET_TYPE *HS_NAME(iter_advance) (HS_ITER *it)
+{
+	assert(it);
+
+	const HS_SET *s = it->s;
+	size_t i = ht_next_full(s->status, s->nbucket, it->i);
+
+	if (i < s->nbucket) {
+		it->val = &s->buckets[i];
+		it->i = i + 1;
+	} else {
+		it->val = NULL;
+		it->i = i;
+	}
+
+	return it->val;
+}
+
+#undef HS_ITER
+#undef HS_SET
+#undef HS_NAME
+#undef HS_MAKE_STR
+#undef HS_CONCAT
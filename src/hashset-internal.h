@@ -0,0 +1,155 @@
+// Copyright (c) 2005, Google Inc.
+// Copyright (c) 2011, Patrick O. Perry
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following disclaimer
+//       in the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the names of Patrick O. Perry, Google Inc,. nor the names of
+//       their contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef HASHSET_INTERNAL_H
+#define HASHSET_INTERNAL_H
+
+/* What hashset.c shares with the rest of the hashset implementation
+ * (hashset-file.c and hashset-parallel.c).  Not part of the interface.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"		// HASHSET_PARALLEL
+#endif
+
+#include <limits.h>		// CHAR_BIT
+#include <stddef.h>		// size_t, NULL
+#include "hashset.h"
+#include "hashset-group.h"
+
+/* A small set has no table: its buckets are the caller's buffer, with the
+ * elements packed at the front in no particular order.
+ */
+static inline int hashset_is_small(const struct hashset *s)
+{
+	return !s->status && s->buckets;
+}
+
+/* The elements the caller's buffer holds, whether or not s is in it now;
+ * 0 if s was not given one.
+ */
+static inline size_t hashset_nsmall(const struct hashset *s)
+{
+	if (hashset_is_small(s)) {
+		return s->count_max;
+	}
+	return s->ext ? s->ext->nsmall : 0;
+}
+
+/* The table being moved during an incremental resize, or NULL */
+static inline struct hashset *hashset_old(const struct hashset *s)
+{
+	return s->ext ? s->ext->old : NULL;
+}
+
+/* Whether s is a read-only table from hashset_map */
+static inline int hashset_is_mapped(const struct hashset *s)
+{
+	return s->ext && s->ext->map;
+}
+
+static inline size_t *hashset_hashes(const struct hashset *s)
+{
+	return s->ext ? s->ext->hashes : NULL;
+}
+
+/* The counters, if flags has HASHSET_STATS; otherwise NULL */
+static inline struct hashset_stats *hashset_counters(const struct hashset *s)
+{
+	return s->ext ? s->ext->stats : NULL;
+}
+
+static inline unsigned hashset_nthread(const struct hashset *s)
+{
+	return s->ext ? s->ext->nthread : 0;
+}
+
+/* The number of groups between the num_probes-th group in the probe
+ * sequence for hash and the next one.  Any of these sequences visits every
+ * group, since the group count is a power of two.
+ */
+static inline size_t hashset_jump(const struct hashset *s, size_t hash,
+				  size_t num_probes)
+{
+	switch (s->probe) {
+	case HASHSET_PROBE_LINEAR:
+		return 1;
+	case HASHSET_PROBE_DOUBLE:
+		return (hash >> (CHAR_BIT * sizeof(size_t) / 2)) | 1;
+	default:
+		return num_probes;
+	}
+}
+
+/* The value stored with the element in bucket i, for a map */
+static inline void *hashset_value_at(const struct hashset *s, size_t i)
+{
+	return (char *)s->vals + i * s->vwidth;
+}
+
+/* The hash of the element in bucket i, which must be full. */
+static inline size_t hashset_bucket_hash(const struct hashset *s, size_t i)
+{
+	const size_t *hashes = hashset_hashes(s);
+
+	if (hashes) {
+		return hashes[i];
+	}
+	return hashset_hash(s, (const char *)s->buckets + i * s->width);
+}
+
+/* With HASHSET_SPARSE_CLEAR, the table logs the groups that go from
+ * all-empty to holding an element, so that hashset_clear can reset just
+ * those.  Once more than this many are logged, clearing the whole status
+ * array is about as cheap, and we stop logging.
+ */
+static inline size_t hashset_dirty_max(size_t nbucket)
+{
+	return ht_group_count(nbucket) / 4 + 1;
+}
+
+// hashset.c
+void hashset_init_params(struct hashset *s, size_t width, size_t vwidth,
+			 size_t (*hash) (const void *, void *),
+			 int (*compar) (const void *, const void *, void *),
+			 void *context, unsigned flags,
+			 const struct allocator *alloc);
+void hashset_reset_thresholds(struct hashset *s, size_t nbucket);
+struct hashset_ext *hashset_need_ext(struct hashset *s);
+
+// hashset-file.c
+void hashset_unmap(struct hashset *s);
+
+// hashset-parallel.c, in builds with POSIX threads and __atomic builtins
+#ifdef HASHSET_PARALLEL
+void hashset_rehash_parallel(struct hashset *dst, const struct hashset *src);
+#endif
+
+#endif // HASHSET_INTERNAL_H
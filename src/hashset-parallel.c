@@ -0,0 +1,196 @@
+// Copyright (c) 2005, Google Inc.
+// Copyright (c) 2011, Patrick O. Perry
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following disclaimer
+//       in the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the names of Patrick O. Perry, Google Inc,. nor the names of
+//       their contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/* Rebuilding a big table on several threads, for nthread above 1.  Built
+ * only when configure finds POSIX threads and the __atomic builtins;
+ * otherwise hashset.c rebuilds on the caller's thread.
+ */
+
+#include <assert.h>		// assert
+#include <pthread.h>		// pthread_create, pthread_join
+#include <stddef.h>		// size_t, NULL
+#include <string.h>		// memcpy
+
+#include "allocator.h"
+#include "hashset.h"
+#include "hashset-group.h"
+#include "hashset-internal.h"
+
+/* The old buckets are handed out to the threads in chunks of this many */
+#define HT_PARALLEL_CHUNK	((size_t)1 << 14)
+
+/* Claim a free bucket for hash in the probe sequence, while other threads
+ * are doing the same.  Buckets only go from empty to full during a
+ * parallel rebuild, so a group seen full stays full, and every element
+ * lands where hashset_probe_free would have put it in some serial order.
+ */
+static size_t hashset_claim_free(struct hashset *s, size_t hash)
+{
+	unsigned char *status = s->status;
+	const unsigned char tag = ht_tag(hash);
+	const size_t bucket_count = s->nbucket;
+	const size_t group_count_minus_one = ht_group_count(bucket_count) - 1;
+	size_t num_probes = 0;
+	size_t bucknum = hash & (bucket_count - 1);
+	size_t group = bucknum / HT_GROUP_WIDTH;
+	unsigned start = (unsigned)(bucknum % HT_GROUP_WIDTH);
+	unsigned j;
+	size_t ix;
+	unsigned char empty;
+
+	assert(bucket_count >= HT_GROUP_WIDTH);
+
+	for (;;) {
+		for (j = 0; j < HT_GROUP_WIDTH; j++) {
+			ix = group * HT_GROUP_WIDTH
+				+ (start + j) % HT_GROUP_WIDTH;
+			empty = HT_BUCKET_EMPTY;
+			if (__atomic_load_n(&status[ix], __ATOMIC_RELAXED)
+			    == HT_BUCKET_EMPTY
+			    && __atomic_compare_exchange_n(&status[ix], &empty,
+							   tag, 0,
+							   __ATOMIC_RELAXED,
+							   __ATOMIC_RELAXED)) {
+				return ix;
+			}
+		}
+		num_probes++;
+		assert(num_probes <= group_count_minus_one);
+		group = (group + hashset_jump(s, hash, num_probes))
+			& group_count_minus_one;
+		start = 0;
+	}
+}
+
+struct hashset_rehash_work {
+	struct hashset *dst;
+	const struct hashset *src;
+	size_t next;		// first bucket of the next chunk to hand out
+};
+
+struct hashset_rehash_thread {
+	struct hashset_rehash_work *work;
+	size_t count;		// elements this thread moved
+	pthread_t thread;
+};
+
+static void *hashset_rehash_worker(void *arg)
+{
+	struct hashset_rehash_thread *t = arg;
+	struct hashset *dst = t->work->dst;
+	const struct hashset *src = t->work->src;
+	size_t *hashes = hashset_hashes(dst);
+	const size_t width = src->width;
+	size_t begin, end, i, ix, hash;
+
+	for (;;) {
+		begin = __atomic_fetch_add(&t->work->next, HT_PARALLEL_CHUNK,
+					   __ATOMIC_RELAXED);
+		if (begin >= src->nbucket) {
+			break;
+		}
+		end = src->nbucket - begin < HT_PARALLEL_CHUNK
+			? src->nbucket : begin + HT_PARALLEL_CHUNK;
+
+		for (i = ht_next_full(src->status, src->nbucket, begin);
+		     i < end; i = ht_next_full(src->status, src->nbucket,
+					       i + 1)) {
+			hash = hashset_bucket_hash(src, i);
+			ix = hashset_claim_free(dst, hash);
+			if (hashes) {
+				hashes[ix] = hash;
+			}
+			memcpy((char *)dst->buckets + ix * width,
+			       (const char *)src->buckets + i * width, width);
+			if (dst->vwidth) {
+				memcpy(hashset_value_at(dst, ix),
+				       hashset_value_at(src, i), dst->vwidth);
+			}
+			t->count++;
+		}
+	}
+
+	return NULL;
+}
+
+/* Add the elements of src's current table to dst, which must be empty and
+ * have room for them, on up to dst->nthread threads.  Falls back to fewer
+ * threads (down to just this one) if it can't start them.
+ */
+void hashset_rehash_parallel(struct hashset *dst, const struct hashset *src)
+{
+	struct hashset_rehash_thread *threads;
+	struct hashset_rehash_work work;
+	struct hashset_rehash_thread self;
+	size_t nchunk = (src->nbucket + HT_PARALLEL_CHUNK - 1)
+		/ HT_PARALLEL_CHUNK;
+	size_t n = hashset_nthread(dst) - 1, i, started = 0;
+
+	assert(dst->count == 0);
+	assert(src->status);
+
+	if (n > nchunk - 1) {
+		n = nchunk - 1;
+	}
+
+	work.dst = dst;
+	work.src = src;
+	work.next = 0;
+
+	threads = n ? allocator_malloc(dst->alloc, n * sizeof(threads[0]))
+		: NULL;
+	if (threads) {
+		for (; started < n; started++) {
+			threads[started].work = &work;
+			threads[started].count = 0;
+			if (pthread_create(&threads[started].thread, NULL,
+					   hashset_rehash_worker,
+					   &threads[started])) {
+				break;
+			}
+		}
+	}
+
+	self.work = &work;
+	self.count = 0;
+	hashset_rehash_worker(&self);
+	dst->count = self.count;
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i].thread, NULL);
+		dst->count += threads[i].count;
+	}
+	allocator_free(dst->alloc, threads);
+
+	if (dst->ext->dirty) {	// too many groups to log; clear them all
+		dst->ext->ndirty = hashset_dirty_max(dst->nbucket) + 1;
+	}
+}
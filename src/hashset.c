@@ -30,480 +30,1877 @@
 //
 
 #include <assert.h>		// assert
-#include <errno.h>		// ENOMEM
-#include <limits.h>		// CHAR_BIT
+#include <errno.h>		// EINVAL, ENOMEM
 #include <stddef.h>		// size_t, NULL
-#include <stdlib.h>		// free
 #include <string.h>		// memset, memcpy
+#include <time.h>		// clock_gettime
 
+#include "allocator.h"
 #include "hashset.h"
+#include "hashset-group.h"
+#include "hashset-internal.h"
 
-#define  HT_BUCKET_FULL    1
-#define  HT_BUCKET_DELETED 2
+/* By default, if you don't specify a hashtable size at
+ * construction-time, we use this size.  Must be a power of two, and
+ * at least HT_MIN_BUCKETS.
+ */
+#define HT_DEFAULT_STARTING_BUCKETS	32
 
-/* The probing method */
-/* #define JUMP_(key, num_probes) (1)          // Linear probing */
-#define JUMP_(key, num_probes)    (num_probes)	// Quadratic probing
+/* During an incremental resize, each insert or remove moves this many
+ * buckets from the old table to the new one.  The new table has at least
+ * twice as many buckets as the old one, so any value of 2 or more finishes
+ * the move before the new table fills up.
+ */
+#define HT_MIGRATE_BUCKETS	(2 * HT_GROUP_WIDTH)
 
-/* How full we let the table get before we resize, by default.
- * Knuth says .8 is good -- higher causes us to probe too much,
- * though it saves memory.
+/* Batched lookups hash this many keys and prefetch their home buckets
+ * before probing for any of them, so that the cache misses overlap.
  */
-#define HT_OCCUPANCY_PCT 80	// (out of 100);
+#define HT_BATCH	16
+
+/* Rebuilds with nthread above 1 go parallel from this many elements */
+#define HT_PARALLEL_MIN		((size_t)1 << 16)
+
+/* Reset the enlarge threshold */
+void hashset_reset_thresholds(struct hashset *s, size_t nbucket)
+{
+	s->count_max = PERCENT(s->load_pct, nbucket);
+}
 
-/* Minimum size we're willing to let hashtables be.
- * Must be a power of two, and at least 4.
- * Note, however, that for a given hashtable, the initial size is a
- * function of the first constructor arg, and may be >HT_MIN_BUCKETS.
+/* The fewest buckets, at least nbucket0, that hold count elements at the
+ * table's load factor.
  */
-#define HT_MIN_BUCKETS	4
+static size_t hashset_min_buckets(const struct hashset *s, size_t count,
+				  size_t nbucket0)
+{
+	return ht_min_buckets_pct(count, nbucket0, s->load_pct);
+}
 
-/* By default, if you don't specify a hashtable size at
- * construction-time, we use this size.  Must be a power of two, and
- * at least HT_MIN_BUCKETS.
+static size_t hashset_bucket_count(const struct hashset *s)
+{
+	return s->nbucket;
+}
+
+/* The side block of s, allocated (zeroed) if s doesn't have one yet; NULL
+ * if that fails.
  */
-#define HT_DEFAULT_STARTING_BUCKETS	32
+struct hashset_ext *hashset_need_ext(struct hashset *s)
+{
+	if (!s->ext) {
+		s->ext = allocator_calloc(s->alloc, 1, sizeof(*s->ext));
+	}
+	return s->ext;
+}
+
+/* One past the last bucket of the table t that can be full */
+static inline size_t hashset_table_end(const struct hashset *t)
+{
+	return hashset_is_small(t) ? t->count : t->nbucket;
+}
+
+/* The hash to look key up with; small sets are searched without one */
+static inline size_t hashset_key_hash(const struct hashset *s,
+				      const void *key)
+{
+	return hashset_is_small(s) ? 0 : hashset_hash(s, key);
+}
+
+/* With HASHSET_STATS, count a lookup that probed nprobe groups past the
+ * first one and called compar ncompar times.
+ */
+static inline void hashset_record_probe(const struct hashset *s,
+					size_t nprobe, size_t ncompar,
+					int found)
+{
+	struct hashset_stats *stats = hashset_counters(s);
+
+	if (stats) {
+		if (nprobe >= HASHSET_STATS_NPROBE) {
+			nprobe = HASHSET_STATS_NPROBE - 1;
+		}
+		if (found) {
+			stats->hit[nprobe]++;
+		} else {
+			stats->miss[nprobe]++;
+		}
+		stats->ncompar += ncompar;
+	}
+}
+
+/* Look for key, whose hash is given.  Returns the bucket holding it, or
+ * HT_MAX_BUCKETS if it is not in the table.  If insert is non-NULL, it gets
+ * the first free (empty or deleted) bucket in the probe sequence, or
+ * HT_MAX_BUCKETS if we did not see one.
+ */
+static inline size_t hashset_probe(const struct hashset *s, const void *key,
+				   size_t hash, size_t *insert)
+{
+	const void *buckets = s->buckets;
+	const unsigned char *status = s->status;
+	const size_t *hashes = hashset_hashes(s);
+	const size_t bucket_count = s->nbucket;
+	const size_t width = s->width;
+	const unsigned char tag = ht_tag(hash);
+	const unsigned group_mask = ht_group_mask(bucket_count);
+	const size_t group_count = ht_group_count(bucket_count);
+	const size_t group_count_minus_one = group_count - 1;
+	size_t num_probes = 0;	// how many groups we've probed
+	size_t ncompar = 0;
+	size_t bucknum = hash & (bucket_count - 1);	// the home bucket
+	size_t group = bucknum / HT_GROUP_WIDTH;
+	const unsigned home = (unsigned)(bucknum % HT_GROUP_WIDTH);
+	const unsigned char *ctrl;
+	const void *ptr;
+	unsigned match, avail;
+
+	if (insert) {
+		*insert = HT_MAX_BUCKETS;
+		// we will likely write to the home bucket
+		HT_PREFETCH_WRITE((const char *)buckets + bucknum * width);
+	}
+
+	/* Inserts favor the home bucket, so most keys live there.  Check it
+	 * before doing the group match: its address does not depend on the
+	 * control bytes, so the bucket load can overlap the status load.
+	 */
+	if (status[bucknum] == tag && (!hashes || hashes[bucknum] == hash)) {
+		ptr = (const char *)buckets + bucknum * width;
+		ncompar++;
+		if (!hashset_compare(s, key, ptr)) {
+			hashset_record_probe(s, 0, ncompar, 1);
+			return bucknum;
+		}
+	}
+
+	for (num_probes = 0; num_probes < group_count; num_probes++) {
+		ctrl = status + group * HT_GROUP_WIDTH;
+
+		match = ht_group_match(ctrl, tag) & group_mask;
+		if (num_probes == 0) {
+			match &= ~(1U << home);	// already checked
+		}
+		while (match) {
+			bucknum = group * HT_GROUP_WIDTH + ht_ctz(match);
+			match &= match - 1;
+			if (hashes && hashes[bucknum] != hash) {
+				continue;
+			}
+			ptr = (const char *)buckets + bucknum * width;
+			ncompar++;
+			if (!hashset_compare(s, key, ptr)) {
+				hashset_record_probe(s, num_probes, ncompar, 1);
+				return bucknum;
+			}
+		}
+
+		if (insert && *insert == HT_MAX_BUCKETS) {
+			if ((avail = ht_group_match_free(ctrl) & group_mask)) {
+				*insert = group * HT_GROUP_WIDTH
+					+ ht_first_free(avail, num_probes
+							? 0 : home);
+			}
+		}
+
+		if (ht_group_match_empty(ctrl) & group_mask) {
+			break;	// an empty bucket ends the probe sequence
+		}
+
+		group = (group + hashset_jump(s, hash, num_probes + 1))
+			& group_count_minus_one;
+	}
+
+	hashset_record_probe(s, num_probes, ncompar, 0);
+	return HT_MAX_BUCKETS;
+}
+
+/* The first free bucket in the probe sequence for hash.  This is where
+ * hashset_probe would put a key that is not in the table; use it when we
+ * already know the key is absent, as when we rebuild a table.  The table
+ * must have at least one free bucket.
+ */
+static inline size_t hashset_probe_free(const struct hashset *s, size_t hash)
+{
+	const unsigned char *status = s->status;
+	const size_t bucket_count = s->nbucket;
+	const unsigned group_mask = ht_group_mask(bucket_count);
+	const size_t group_count_minus_one = ht_group_count(bucket_count) - 1;
+	size_t num_probes = 0;	// how many groups we've probed
+	size_t bucknum = hash & (bucket_count - 1);	// the home bucket
+	size_t group = bucknum / HT_GROUP_WIDTH;
+	unsigned home = (unsigned)(bucknum % HT_GROUP_WIDTH);
+	unsigned avail;
+
+	assert(bucket_count);
+
+	if (!(status[bucknum] & HT_BUCKET_FULL)) {
+		return bucknum;
+	}
+
+	for (;;) {
+		avail = (ht_group_match_free(status + group * HT_GROUP_WIDTH)
+			 & group_mask);
+		if (avail) {
+			return group * HT_GROUP_WIDTH
+				+ ht_first_free(avail, num_probes ? 0 : home);
+		}
+		num_probes++;
+		assert(num_probes <= group_count_minus_one);
+		group = (group + hashset_jump(s, hash, num_probes))
+			& group_count_minus_one;
+	}
+}
+
+static inline void hashset_mark_dirty(struct hashset *s, size_t ix)
+{
+	struct hashset_ext *ext = s->ext;
+	const size_t group = ix / HT_GROUP_WIDTH;
+	const unsigned mask = ht_group_mask(s->nbucket);
+	const size_t dirty_max = hashset_dirty_max(s->nbucket);
+
+	if (ext->ndirty > dirty_max) {
+		return;		// overflowed
+	}
+	if ((ht_group_match_empty(s->status + group * HT_GROUP_WIDTH) & mask)
+	    != mask) {
+		return;		// already logged
+	}
+	if (ext->ndirty < dirty_max) {
+		ext->dirty[ext->ndirty] = group;
+	}
+	ext->ndirty++;
+}
+
+/* The first full bucket of s at or after i, or s->nbucket */
+static inline size_t hashset_next_full(const struct hashset *s, size_t i)
+{
+	if (!s->status) {	// no table, or a small set with no gaps
+		return i;
+	}
+	return ht_next_full(s->status, s->nbucket, i);
+}
+
+/* Put val, which must not already be in the table, in the free bucket ix,
+ * without checking whether the table needs to grow.  For a map, value
+ * (if non-NULL) gets copied to the bucket's value.
+ */
+static inline void hashset_insert_at(struct hashset *s, size_t ix,
+				     const void *val, const void *value,
+				     size_t hash)
+{
+	assert(s->count < s->count_max);
+	assert(!(s->status[ix] & HT_BUCKET_FULL));
+
+	size_t *hashes = hashset_hashes(s);
+
+	if (s->status[ix] == HT_BUCKET_DELETED) {
+		s->ndeleted--;
+	} else if (s->ext && s->ext->dirty) {
+		hashset_mark_dirty(s, ix);
+	}
+	s->count++;
+	s->status[ix] = ht_tag(hash);
+	if (hashes) {
+		hashes[ix] = hash;
+	}
+	memcpy((char *)s->buckets + ix * s->width, val, s->width);
+	if (s->vwidth && value) {
+		memcpy(hashset_value_at(s, ix), value, s->vwidth);
+	}
+}
 
-/* The number of buckets must be a power of 2.  This is the largest 
- * power of 2 that a size_t can hold.
+/* Add val, which must not already be in the table, without checking
+ * whether the table needs to grow.
  */
-#define HT_MAX_BUCKETS	((size_t)1 << (CHAR_BIT * sizeof(size_t) - 1))
+static void hashset_insert_new(struct hashset *s, const void *val,
+			       const void *value, size_t hash)
+{
+	hashset_insert_at(s, hashset_probe_free(s, hash), val, value, hash);
+}
 
-/* The following is more accurate than ((pct)/100.0 * (x)) when x is
- * really big (> 2^52).
+/* Add the elements in buckets [begin, end) of src to dst, which must not
+ * contain any of them, and must have room for them.
  */
-#define PERCENT(pct,x) \
-	((pct) * ((x) / 100) \
-	 + (size_t)((pct) * (((x) % 100) / 100.0)))
+static void hashset_rehash_range(struct hashset *dst, const struct hashset *src,
+				 size_t begin, size_t end)
+{
+	const size_t width = src->width;
+	size_t i;
+
+	for (i = hashset_next_full(src, begin); i < end;
+	     i = hashset_next_full(src, i + 1)) {
+		hashset_insert_new(dst, (const char *)src->buckets + i * width,
+				   hashset_value_at(src, i),
+				   hashset_bucket_hash(src, i));
+	}
+}
 
-#define HT_MAX_COUNT	PERCENT(HT_OCCUPANCY_PCT, HT_MAX_BUCKETS)
+/* Add all of the elements of src (including any that have not yet been
+ * moved out of its old table) to dst, which must be empty and have room
+ * for them.
+ */
+static void hashset_rehash_into(struct hashset *dst, const struct hashset *src)
+{
+	assert(dst->count == 0);
+	assert(dst->count_max >= hashset_count(src));
+
+	const struct hashset *old = hashset_old(src);
+
+#ifdef HASHSET_PARALLEL
+	if (hashset_nthread(dst) > 1 && src->count >= HT_PARALLEL_MIN
+	    && !hashset_is_small(src)) {
+		hashset_rehash_parallel(dst, src);
+	} else
+#endif
+	{
+		hashset_rehash_range(dst, src, 0, hashset_table_end(src));
+	}
+	if (old) {
+		hashset_rehash_range(dst, old, src->ext->migrate, old->nbucket);
+	}
+}
 
-/* This is the smallest size a hashtable can be without being too crowded
- * If you like, you can give a min #buckets as well as a min #elts */
-static size_t min_buckets(size_t count, size_t nbucket0)
+/* Move up to n buckets from the old table to the current one, and free
+ * the old table once it is empty.
+ */
+static void hashset_migrate(struct hashset *s, size_t n)
 {
-	assert(count <= HT_MAX_COUNT);
-	assert(nbucket0 <= HT_MAX_BUCKETS);
+	struct hashset_ext *ext = s->ext;
+	struct hashset *old = ext->old;
+	size_t i, end;
+
+	assert(old);
+
+	end = (old->nbucket - ext->migrate < n ? old->nbucket
+	       : ext->migrate + n);
+
+	for (i = hashset_next_full(old, ext->migrate); i < end;
+	     i = hashset_next_full(old, i + 1)) {
+		hashset_insert_new(s, (const char *)old->buckets
+				   + i * old->width,
+				   hashset_value_at(old, i),
+				   hashset_bucket_hash(old, i));
+		old->status[i] = HT_BUCKET_DELETED;
+		old->count--;
+	}
+	ext->migrate = end;
+
+	if (end == old->nbucket) {
+		assert(old->count == 0);
+		hashset_destroy(old);
+		allocator_free(s->alloc, old);
+		ext->old = NULL;
+		ext->migrate = 0;
+	}
+}
 
-	size_t n = HT_MIN_BUCKETS;	// min buckets allowed
+/* Find key in the table or, during an incremental resize, in the old
+ * table.  Buckets in the old table are numbered after those in the
+ * current one.  Returns HT_MAX_BUCKETS if key is not present; if insert is
+ * non-NULL, it gets a free bucket for key in the current table.  A small
+ * set gets searched linearly, ignoring hash.
+ */
+static size_t hashset_small_lookup(const struct hashset *s, const void *key,
+				   size_t *insert)
+{
+	const char *val = s->buckets;
+	size_t i;
 
-	while (n < nbucket0 || count > PERCENT(HT_OCCUPANCY_PCT, n)) {
-		assert(2 * n > n);
-		n *= 2;
+	if (insert) {
+		*insert = s->count < s->count_max ? s->count : HT_MAX_BUCKETS;
 	}
 
-	assert(n >= nbucket0);
-	assert(count <= PERCENT(HT_OCCUPANCY_PCT, n));
+	for (i = 0; i < s->count; i++, val += s->width) {
+		if (!hashset_compare(s, key, val)) {
+			return i;
+		}
+	}
 
-	return n;
+	return HT_MAX_BUCKETS;
 }
 
-/* Reset the enlarge threshold */
-static void hashset_reset_thresholds(struct hashset *s, size_t nbucket)
+static inline size_t hashset_lookup(const struct hashset *s, const void *key,
+				    size_t hash, size_t *insert)
 {
-	s->count_max = PERCENT(HT_OCCUPANCY_PCT, nbucket);
+	const struct hashset *old;
+	size_t bucknum;
+
+	if (hashset_is_small(s)) {
+		return hashset_small_lookup(s, key, insert);
+	}
+
+	bucknum = hashset_probe(s, key, hash, insert);
+
+	if (bucknum == HT_MAX_BUCKETS && (old = hashset_old(s))) {
+		size_t i = hashset_probe(old, key, hash, NULL);
+		if (i != HT_MAX_BUCKETS) {
+			bucknum = s->nbucket + i;
+		}
+	}
+
+	return bucknum;
 }
 
-static size_t hashset_bucket_count(const struct hashset *s)
+static inline void *hashset_bucket(const struct hashset *s, size_t bucknum)
 {
-	return s->nbucket;
+	if (bucknum < s->nbucket || hashset_is_small(s)) {
+		return (char *)s->buckets + bucknum * s->width;
+	} else {
+		return (char *)s->ext->old->buckets
+			+ (bucknum - s->nbucket) * s->width;
+	}
+}
+
+static inline void *hashset_bucket_value(const struct hashset *s,
+					 size_t bucknum)
+{
+	if (bucknum < s->nbucket) {
+		return hashset_value_at(s, bucknum);
+	} else {
+		return hashset_value_at(s->ext->old, bucknum - s->nbucket);
+	}
+}
+
+/* Remove the element in the given bucket (numbered as by hashset_lookup).
+ *
+ * If the bucket's group has an empty bucket, then no probe sequence has
+ * ever gone past this group (empty buckets only get reused, never
+ * created, between rebuilds), so we can mark the bucket empty instead of
+ * leaving a tombstone.
+ */
+static void hashset_erase(struct hashset *s, size_t bucknum)
+{
+	if (bucknum < s->nbucket) {
+		const unsigned char *ctrl = (s->status + bucknum
+					     - bucknum % HT_GROUP_WIDTH);
+
+		if (ht_group_match_empty(ctrl) & ht_group_mask(s->nbucket)) {
+			s->status[bucknum] = HT_BUCKET_EMPTY;
+		} else {
+			s->status[bucknum] = HT_BUCKET_DELETED;
+			s->ndeleted++;
+		}
+		s->count--;
+	} else if (hashset_is_small(s)) {	// move the last element down
+		s->count--;
+		if (bucknum != s->count) {
+			memcpy(hashset_bucket(s, bucknum),
+			       hashset_bucket(s, s->count), s->width);
+		}
+	} else {
+		s->ext->old->status[bucknum - s->nbucket] = HT_BUCKET_DELETED;
+		s->ext->old->count--;
+	}
+}
+
+/* Move the state that belongs to the set rather than to its table (the
+ * counters and the small buffer) from s to snew, which was built from s by
+ * hashset_init_next.
+ */
+static void hashset_hand_over(struct hashset *s, struct hashset *snew)
+{
+	if (hashset_is_small(s)) {	// remember the buffer we're leaving
+		snew->ext->small = s->buckets;
+		snew->ext->nsmall = s->count_max;
+	} else if (s->ext && s->ext->small) {
+		snew->ext->small = s->ext->small;
+		snew->ext->nsmall = s->ext->nsmall;
+	}
+	if (hashset_counters(s)) {
+		snew->ext->stats = s->ext->stats;
+		s->ext->stats = NULL;
+	}
+}
+
+/* Replace the table of s with snew, which was built from it by
+ * hashset_init_next.  The counters and the small buffer stay with s.
+ */
+static void hashset_replace(struct hashset *s, struct hashset *snew)
+{
+	hashset_hand_over(s, snew);
+	hashset_destroy(s);
+	*s = *snew;
+}
+
+void hashset_init_params(struct hashset *s, size_t width, size_t vwidth,
+			 size_t (*hash) (const void *, void *),
+			 int (*compar) (const void *, const void *, void *),
+			 void *context, unsigned flags,
+			 const struct allocator *alloc)
+{
+	assert(s);
+	assert(hash);
+	assert(compar);
+
+	s->alloc = alloc;
+	s->buckets = NULL;
+	s->vals = NULL;
+	s->nbucket = 0;
+	s->width = width;
+	s->vwidth = vwidth;
+	s->status = NULL;
+	s->count = 0;
+	s->hash = hash;
+	s->compar = compar;
+	s->context = context;
+	s->flags = flags;
+	s->load_pct = HT_OCCUPANCY_PCT;
+	s->probe = HASHSET_PROBE_QUADRATIC;
+	s->ndeleted = 0;
+	s->ext = NULL;
+	hashset_reset_thresholds(s, 0);
+}
+
+/* Flags that need the side block */
+#define HT_EXT_FLAGS \
+	(HASHSET_CACHE_HASH | HASHSET_STATS | HASHSET_SPARSE_CLEAR)
+
+/* Give s the side block, if its flags or nthread need one, and its own
+ * counters, if flags has HASHSET_STATS.  On failure, the caller must
+ * destroy s.
+ */
+static int hashset_init_ext(struct hashset *s, unsigned nthread)
+{
+	struct hashset_ext *ext;
+
+	if (nthread <= 1 && !(s->flags & HT_EXT_FLAGS)) {
+		return 0;
+	}
+	if (!(ext = hashset_need_ext(s))) {
+		return ENOMEM;
+	}
+	ext->nthread = nthread;
+	if (s->flags & HASHSET_STATS) {
+		ext->stats = allocator_calloc(s->alloc, 1, sizeof(*ext->stats));
+		if (!ext->stats) {
+			return ENOMEM;
+		}
+	}
+	return 0;
 }
 
-static int hashset_init_sized(struct hashset *s,
-			      size_t width,
-			      size_t (*hash) (const void *, void *),
-			      int (*compar) (const void *, const void *,
-				             void *),
-			      void *context,
+/* Initialize an empty table with nbucket buckets, using the same
+ * parameters (width, vwidth, hash, compar, context, flags, nthread, and
+ * allocator) as proto.  The table does not get its own counters.
+ */
+static int hashset_init_sized(struct hashset *s, const struct hashset *proto,
 			      size_t nbucket)
 {
 	void *buckets;
+	void *vals = NULL;
 	unsigned char *status;
-	int err;
+	size_t *hashes = NULL;
+	size_t *dirty = NULL;
 
 	assert(s);
-	assert(hash);
-	assert(compar);
+	assert(proto);
 	assert(nbucket >= HT_MIN_BUCKETS);
 
-	if ((err = hashset_init(s, width, hash, compar, context)))
-		return err;
+	const struct allocator *a = proto->alloc;
+
+	hashset_init_params(s, proto->width, proto->vwidth, proto->hash,
+			    proto->compar, proto->context, proto->flags, a);
+	s->load_pct = proto->load_pct;
+	s->probe = proto->probe;
+	if (hashset_nthread(proto) > 1 || (proto->flags & HT_EXT_FLAGS)) {
+		if (!hashset_need_ext(s)) {
+			return ENOMEM;
+		}
+		s->ext->nthread = hashset_nthread(proto);
+	}
 
-	buckets = calloc(nbucket, width);
-	status = calloc(nbucket, sizeof(s->status[0]));
-	if (buckets == NULL || status == NULL) {
-		free(buckets);
-		free(status);
+	buckets = allocator_calloc(a, nbucket, proto->width);
+	status = allocator_calloc(a, ht_status_size(nbucket),
+				  sizeof(s->status[0]));
+	if (proto->flags & HASHSET_CACHE_HASH) {
+		hashes = allocator_malloc(a, nbucket * sizeof(hashes[0]));
+	}
+	if (proto->vwidth) {
+		vals = allocator_calloc(a, nbucket, proto->vwidth);
+	}
+	if (proto->flags & HASHSET_SPARSE_CLEAR) {
+		dirty = allocator_malloc(a, hashset_dirty_max(nbucket)
+					 * sizeof(dirty[0]));
+	}
+	if (buckets == NULL || status == NULL
+	    || ((proto->flags & HASHSET_CACHE_HASH) && hashes == NULL)
+	    || (proto->vwidth && vals == NULL)
+	    || ((proto->flags & HASHSET_SPARSE_CLEAR) && dirty == NULL)) {
+		allocator_free(a, buckets);
+		allocator_free(a, vals);
+		allocator_free(a, status);
+		allocator_free(a, hashes);
+		allocator_free(a, dirty);
 		hashset_destroy(s);
 		return ENOMEM;
 	}
 
 	s->buckets = buckets;
+	s->vals = vals;
 	s->status = status;
+	if (s->ext) {
+		s->ext->hashes = hashes;
+		s->ext->dirty = dirty;
+	}
 	s->nbucket = nbucket;
 	hashset_reset_thresholds(s, nbucket);
 
 	return 0;
 }
 
+/* Initialize snew as a table with nbucket buckets to take the place of the
+ * one s has; if s has a small buffer, snew gets a side block to remember
+ * it in.
+ */
+static int hashset_init_next(struct hashset *snew, const struct hashset *s,
+			     size_t nbucket)
+{
+	int err;
+
+	if ((err = hashset_init_sized(snew, s, nbucket))) {
+		return err;
+	}
+	if (hashset_nsmall(s) && !hashset_need_ext(snew)) {
+		hashset_destroy(snew);
+		return ENOMEM;
+	}
+	return 0;
+}
+
 static int hashset_init_copy_sized(struct hashset *s,
 				    const struct hashset *src, size_t nbucket)
 {
-	struct hashset_iter it;
-	const void *val;
 	int err;
 
 	assert(s);
-	assert(src);
-	assert(s != src);
-	assert(nbucket >= HT_MIN_BUCKETS);
+	assert(src);
+	assert(s != src);
+	assert(nbucket >= HT_MIN_BUCKETS);
+
+	if ((err = hashset_init_sized(s, src, nbucket))) {
+		return err;
+	}
+
+	hashset_rehash_into(s, src);
+	return 0;
+}
+
+static int hashset_needs_grow_delta(const struct hashset *s, size_t delta)
+{
+	size_t used = hashset_count(s) + s->ndeleted;
+
+	assert(delta <= HT_MAX_COUNT);
+	assert(s->nbucket <= HT_MAX_COUNT - delta);
+	assert(s->count_max >= used);
+
+	if (s->nbucket >= HT_MIN_BUCKETS && delta <= s->count_max - used) {
+		return 0;
+	} else {
+		return 1;
+	}
+}
+
+static double hashset_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static int hashset_grow_delta_nostats(struct hashset *s, size_t delta);
+
+static int hashset_grow_delta(struct hashset *s, size_t delta)
+{
+	struct hashset_stats *stats = hashset_counters(s);
+	double start;
+	int err;
+
+	if (!stats) {
+		return hashset_grow_delta_nostats(s, delta);
+	}
+
+	start = hashset_clock();
+	err = hashset_grow_delta_nostats(s, delta);
+	stats->grow_time += hashset_clock() - start;
+	return err;
+}
+
+static int hashset_grow_delta_nostats(struct hashset *s, size_t delta)
+{
+	assert(delta <= HT_MAX_COUNT - s->nbucket);
+
+	size_t count0 = hashset_count(s);
+	size_t nbucket0 = s->nbucket;
+	size_t count = count0 + delta;
+	size_t nbucket = hashset_min_buckets(s, count, nbucket0);
+	struct hashset_stats *stats = hashset_counters(s);
+	struct hashset *old;
+	int err;
+
+	if (nbucket == nbucket0 && count > s->count_max - s->ndeleted) {
+		// the live elements fit, but not with the tombstones
+		if (count <= PERCENT(HT_PURGE_PCT, s->count_max)) {
+			return hashset_purge(s);
+		}
+		nbucket = hashset_min_buckets(s, count, 2 * nbucket0);
+	}
+
+	if (nbucket > nbucket0) {
+		struct hashset snew;
+
+		if ((err = hashset_init_next(&snew, s, nbucket))) {
+			return err;
+		}
+
+		if ((old = hashset_old(s))) {	// finish the resize in progress
+			hashset_migrate(s, old->nbucket);
+		}
+
+		if (stats) {
+			stats->nresize++;
+		}
+
+		if ((s->flags & HASHSET_INCREMENTAL) && s->count
+		    && !hashset_is_small(s)) {
+			// keep the current table, and move its elements later
+			if (!hashset_need_ext(&snew)
+			    || !(old = allocator_malloc(s->alloc,
+							sizeof(*old)))) {
+				hashset_destroy(&snew);
+				return ENOMEM;
+			}
+			hashset_hand_over(s, &snew);
+			*old = *s;
+			*s = snew;
+			s->ext->old = old;
+			s->ext->migrate = 0;
+		} else {
+			hashset_rehash_into(&snew, s);
+			hashset_replace(s, &snew);
+		}
+	}
+
+	return 0;
+}
+
+/* Free the arrays of the table of s (and of its old table, if any), but
+ * not the rest of its side block.
+ */
+static void hashset_free_table(struct hashset *s)
+{
+	struct hashset_ext *ext = s->ext;
+
+	if (ext) {
+		if (ext->old) {
+			hashset_destroy(ext->old);
+			allocator_free(s->alloc, ext->old);
+			ext->old = NULL;
+			ext->migrate = 0;
+		}
+		allocator_free(s->alloc, ext->dirty);
+		allocator_free(s->alloc, ext->hashes);
+		ext->dirty = NULL;
+		ext->ndirty = 0;
+		ext->hashes = NULL;
+	}
+	allocator_free(s->alloc, s->status);
+	allocator_free(s->alloc, s->vals);
+	if (!hashset_is_small(s)) {
+		allocator_free(s->alloc, s->buckets);
+	}
+}
+
+/* Move the elements of s, which must fit, to its small buffer, and free
+ * its table.
+ */
+static void hashset_make_small(struct hashset *s)
+{
+	struct hashset_ext *ext = s->ext;
+	size_t count = hashset_count(s);
+
+	assert(hashset_nsmall(s));
+	assert(count <= hashset_nsmall(s));
+
+	if (hashset_is_small(s)) {
+		return;
+	}
+
+	hashset_copy_to(s, ext->small);
+	hashset_free_table(s);
+	s->nbucket = 0;
+	s->buckets = ext->small;
+	s->vals = NULL;
+	s->status = NULL;
+	s->count = count;
+	s->count_max = ext->nsmall;
+	s->ndeleted = 0;
+	ext->small = NULL;
+	ext->nsmall = 0;
+}
+
+int hashset_ensure_capacity(struct hashset *s, size_t n)
+{
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(n >= hashset_count(s));
+	assert(hashset_capacity(s) >= hashset_count(s));
+	assert(n <= HT_MAX_BUCKETS);
+
+	if (n > hashset_capacity(s)) {
+		size_t delta = n - hashset_count(s);
+		return hashset_grow_delta(s, delta);
+	}
+
+	return 0;
+}
+
+int hashset_init(struct hashset *s, size_t width,
+		 size_t (*hash) (const void *, void *),
+		 int (*compar) (const void *, const void *, void *),
+		 void *context)
+{
+	return hashset_init_flags(s, width, hash, compar, context, 0);
+}
+
+int hashset_init_flags(struct hashset *s, size_t width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, unsigned flags)
+{
+	return hashset_init_map(s, width, 0, hash, compar, context, flags);
+}
+
+int hashset_init_alloc(struct hashset *s, size_t width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, const struct allocator *alloc)
+{
+	hashset_init_params(s, width, 0, hash, compar, context, 0, alloc);
+	return 0;
+}
+
+int hashset_init_options(struct hashset *s, size_t width,
+			 size_t (*hash) (const void *, void *),
+			 int (*compar) (const void *, const void *, void *),
+			 void *context, const struct hashset_options *opts)
+{
+	assert(opts);
+
+	int err;
+
+	if (opts->load_pct > HASHSET_MAX_LOAD_PCT
+	    || opts->probe > HASHSET_PROBE_DOUBLE
+	    || (opts->nsmall && !opts->small)
+	    || (opts->nsmall && opts->vwidth)) {	// small sets aren't maps
+		return EINVAL;
+	}
+
+	hashset_init_params(s, width, opts->vwidth, hash, compar, context,
+			    opts->flags, opts->alloc);
+	if (opts->load_pct) {
+		s->load_pct = (unsigned char)opts->load_pct;
+	}
+	s->probe = (unsigned char)opts->probe;
+
+	if (opts->nsmall) {
+		s->buckets = opts->small;
+		s->count_max = opts->nsmall;
+	}
+
+	if ((err = hashset_init_ext(s, opts->nthread))
+	    || (opts->capacity
+		&& (err = hashset_ensure_capacity(s, opts->capacity)))) {
+		hashset_destroy(s);
+		return err;
+	}
+	return 0;
+}
+
+int hashset_init_map(struct hashset *s, size_t width, size_t vwidth,
+		     size_t (*hash) (const void *, void *),
+		     int (*compar) (const void *, const void *, void *),
+		     void *context, unsigned flags)
+{
+	int err;
+
+	hashset_init_params(s, width, vwidth, hash, compar, context, flags,
+			    NULL);
+	if ((err = hashset_init_ext(s, 0))) {
+		hashset_destroy(s);
+	}
+	return err;
+}
+
+int hashset_assign_array(struct hashset *s, const void *base, size_t nel)
+{
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(base || !nel);
+	assert(nel <= HT_MAX_COUNT);
+
+	const char *val = base;
+	const size_t width = s->width;
+	struct hashset snew;
+	size_t hash[HT_BATCH];
+	size_t i, j, n, bucknum, insert, mask;
+	int err;
+
+	if (hashset_nsmall(s) && nel <= hashset_nsmall(s)) {
+		hashset_clear(s);
+		hashset_make_small(s);
+		for (i = 0; i < nel; i++) {
+			// can't fail, since the elements fit
+			hashset_set_item(s, val + i * width);
+		}
+		return 0;
+	}
+
+	// size the table once, for the case where there are no duplicates
+	if ((err = hashset_init_next(&snew, s,
+				     hashset_min_buckets(s, nel, 0)))) {
+		return err;
+	}
+	mask = snew.nbucket - 1;
+
+	for (i = 0; i < nel; i += n) {
+		n = nel - i < HT_BATCH ? nel - i : HT_BATCH;
+
+		for (j = 0; j < n; j++) {
+			hash[j] = hashset_hash(&snew, val + (i + j) * width);
+			bucknum = hash[j] & mask;
+			HT_PREFETCH(snew.status + bucknum);
+			HT_PREFETCH_WRITE((char *)snew.buckets
+					  + bucknum * width);
+		}
+
+		for (j = 0; j < n; j++) {
+			bucknum = hashset_probe(&snew, val + (i + j) * width,
+						hash[j], &insert);
+			if (bucknum != HT_MAX_BUCKETS) {	// duplicate
+				memcpy((char *)snew.buckets + bucknum * width,
+				       val + (i + j) * width, width);
+			} else {
+				hashset_insert_at(&snew, insert,
+						  val + (i + j) * width, NULL,
+						  hash[j]);
+			}
+		}
+	}
+
+	hashset_replace(s, &snew);
+	return 0;
+}
+
+int hashset_init_copy(struct hashset *s, const struct hashset *src)
+{
+	size_t nbucket;
+	int err;
+
+	assert(s);
+	assert(src);
+	assert(s != src);
+
+	nbucket = hashset_bucket_count(src);
+	if (hashset_is_small(src) && src->count) {
+		// the copy can't share the buffer, so it needs a table
+		nbucket = hashset_min_buckets(src, src->count, 0);
+	}
+	if (nbucket < HT_MIN_BUCKETS) {
+		hashset_init_params(s, src->width, src->vwidth, src->hash,
+				    src->compar, src->context, src->flags,
+				    src->alloc);
+		s->load_pct = src->load_pct;
+		s->probe = src->probe;
+	} else if ((err = hashset_init_copy_sized(s, src, nbucket))) {
+		return err;
+	}
+
+	if ((err = hashset_init_ext(s, hashset_nthread(src)))) {
+		hashset_destroy(s);
+		return err;
+	}
+	return 0;
+}
+
+int hashset_assign_copy(struct hashset *s, const struct hashset *src)
+{
+	struct hashset snew;
+	int err;
+
+	assert(s);
+	assert(src);
+
+	if ((err = hashset_init_copy(&snew, src))) {
+		return err;
+	}
+
+	hashset_destroy(s);
+	*s = snew;
+
+	return 0;
+}
+
+void hashset_destroy(struct hashset *s)
+{
+	assert(s);
+
+	struct hashset_ext *ext = s->ext;
+
+	if (hashset_is_mapped(s)) {	// the arrays all live in the mapping
+		hashset_unmap(s);
+	} else {
+		hashset_free_table(s);
+	}
+	if (ext) {
+		allocator_free(s->alloc, ext->stats);
+		allocator_free(s->alloc, ext);
+	}
+}
+
+void *hashset_item(const struct hashset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	if (!hashset_count(s)) {
+		return NULL;
+	}
+
+	return hashset_item_hashed(s, key, hashset_key_hash(s, key));
+}
+
+void *hashset_item_hashed(const struct hashset *s, const void *key,
+			  size_t hash)
+{
+	assert(s);
+	assert(key);
+
+	size_t bucknum;
+
+	if (!hashset_count(s)) {
+		return NULL;
+	}
+
+	bucknum = hashset_lookup(s, key, hash, NULL);
+	if (bucknum == HT_MAX_BUCKETS) {
+		return NULL;
+	}
+
+	return hashset_bucket(s, bucknum);
+}
+
+void *hashset_item_value(const struct hashset *s, const void *key)
+{
+	assert(s);
+	assert(s->vwidth);
+	assert(key);
+
+	size_t bucknum;
+
+	if (!hashset_count(s)) {
+		return NULL;
+	}
+
+	bucknum = hashset_lookup(s, key, hashset_hash(s, key), NULL);
+	if (bucknum == HT_MAX_BUCKETS) {
+		return NULL;
+	}
+
+	return hashset_bucket_value(s, bucknum);
+}
+
+int hashset_set_item(struct hashset *s, const void *key)
+{
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(key);
+
+	struct hashset_pos pos;
+	void *dst;
+
+	if ((dst = hashset_find(s, key, &pos))) {
+		memcpy(dst, key, s->width);
+		if (hashset_old(s)) {
+			hashset_migrate(s, HT_MIGRATE_BUCKETS);
+		}
+		return 0;
+	} else {
+		return hashset_insert(s, &pos, key);
+	}
+}
+
+/* Only the status bytes need resetting; the bytes of an empty bucket are
+ * never read.
+ */
+int hashset_clear(struct hashset *s)
+{
+	assert(s);
+	assert(!hashset_is_mapped(s));
+
+	struct hashset_ext *ext = s->ext;
+	size_t n = hashset_bucket_count(s);
+	size_t i, len;
+
+	if (ext && ext->old) {
+		hashset_destroy(ext->old);
+		allocator_free(s->alloc, ext->old);
+		ext->old = NULL;
+		ext->migrate = 0;
+	}
+
+	if (ext && ext->dirty && ext->ndirty <= hashset_dirty_max(n)) {
+		len = n < HT_GROUP_WIDTH ? n : HT_GROUP_WIDTH;
+		for (i = 0; i < ext->ndirty; i++) {
+			memset(s->status + ext->dirty[i] * HT_GROUP_WIDTH, 0,
+			       len * sizeof(s->status[0]));
+		}
+	} else {
+		memset(s->status, 0, n * sizeof(s->status[0]));
+	}
+	if (ext) {
+		ext->ndirty = 0;
+	}
+	s->count = 0;
+	s->ndeleted = 0;
+	return 0;
+}
+
+/* The counters do not include lookups in the old table during an
+ * incremental resize.
+ */
+void hashset_stats(const struct hashset *s, struct hashset_stats *stats)
+{
+	assert(s);
+	assert(stats);
+
+	if (hashset_counters(s)) {
+		*stats = *hashset_counters(s);
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+
+	stats->count = hashset_count(s);
+	stats->nbucket = s->nbucket;
+	stats->ndeleted = s->ndeleted;
+	stats->load = s->nbucket ? (double)stats->count / s->nbucket : 0;
+	stats->deleted_ratio = (s->nbucket ? (double)s->ndeleted / s->nbucket
+				: 0);
+}
+
+int hashset_contains(const struct hashset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	if (hashset_item(s, key)) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+int hashset_contains_hashed(const struct hashset *s, const void *key,
+			    size_t hash)
+{
+	assert(s);
+	assert(key);
+
+	if (hashset_item_hashed(s, key, hash)) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+/* Set operations visit every element of a set, in its current table and
+ * then in its old one.  This gives the table after t.
+ */
+static inline const struct hashset *hashset_next_table(const struct hashset *s,
+						       const struct hashset *t)
+{
+	return t == s ? hashset_old(s) : NULL;
+}
+
+/* The number that hashset_lookup uses for bucket i of t, one of s's tables */
+static inline size_t hashset_bucket_number(const struct hashset *s,
+					   const struct hashset *t, size_t i)
+{
+	return t == s ? i : s->nbucket + i;
+}
+
+/* The hash under s of the element in bucket i of t, reusing t's cached
+ * hash if the two sets hash the same way.
+ */
+static inline size_t hashset_hash_from(const struct hashset *s,
+				       const struct hashset *t, size_t i)
+{
+	const size_t *hashes = hashset_hashes(t);
+
+	if (hashes && t->hash == s->hash && t->context == s->context) {
+		return hashes[i];
+	}
+	return hashset_hash(s, (const char *)t->buckets + i * t->width);
+}
+
+/* Look up the element in bucket i of t in s.  Returns the bucket number,
+ * or HT_MAX_BUCKETS if it is not present; if hash is non-NULL, it gets the
+ * element's hash under s (or 0, if s is small).
+ */
+static size_t hashset_lookup_from(const struct hashset *s,
+				  const struct hashset *t, size_t i,
+				  size_t *hash)
+{
+	size_t h;
+
+	if (!hashset_count(s)) {
+		return HT_MAX_BUCKETS;
+	}
+
+	h = hashset_is_small(s) ? 0 : hashset_hash_from(s, t, i);
+	if (hash) {
+		*hash = h;
+	}
+	return hashset_lookup(s, (const char *)t->buckets + i * t->width, h,
+			      NULL);
+}
+
+/* Remove the elements of the small set s that are in other (if found is
+ * nonzero) or not in other (if found is zero).  Erasing moves the last
+ * element into the gap, so we go backwards.
+ */
+static void hashset_small_erase_if(struct hashset *s,
+				   const struct hashset *other, int found)
+{
+	size_t i;
+
+	for (i = s->count; i-- > 0;) {
+		if ((hashset_lookup_from(other, s, i, NULL)
+		     != HT_MAX_BUCKETS) == !!found) {
+			hashset_erase(s, i);
+		}
+	}
+}
+
+/* Whether every element of s is in other */
+static int hashset_all_in(const struct hashset *s, const struct hashset *other)
+{
+	const struct hashset *t;
+	size_t i;
+
+	for (t = s; t; t = hashset_next_table(s, t)) {
+		for (i = hashset_next_full(t, 0); i < hashset_table_end(t);
+		     i = hashset_next_full(t, i + 1)) {
+			if (hashset_lookup_from(other, t, i, NULL) == HT_MAX_BUCKETS) {
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+size_t hashset_copy_to(const struct hashset *s, void *dst)
+{
+	assert(s);
+	assert(dst || !hashset_count(s));
+
+	const struct hashset *t;
+	const size_t width = s->width;
+	char *out = dst;
+	size_t i;
+
+	for (t = s; t; t = hashset_next_table(s, t)) {
+		for (i = hashset_next_full(t, 0); i < hashset_table_end(t);
+		     i = hashset_next_full(t, i + 1)) {
+			memcpy(out, (const char *)t->buckets + i * width,
+			       width);
+			out += width;
+		}
+	}
+
+	assert((size_t)(out - (char *)dst) == hashset_count(s) * width);
+	return hashset_count(s);
+}
+/* INVALID create_set_comparer */
+/* MISSING equals */
+
+int hashset_except_with(struct hashset *s, const struct hashset *other)
+{
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(other);
+	assert(s->width == other->width);
+
+	const struct hashset *t;
+	size_t i, bucknum;
+
+	if (s == other) {
+		return hashset_clear(s);
+	}
+
+	if (hashset_is_small(s)) {
+		hashset_small_erase_if(s, other, 1);
+	} else if (hashset_count(other) <= hashset_count(s)) {
+		// remove the elements of other from s
+		for (t = other; t; t = hashset_next_table(other, t)) {
+			for (i = hashset_next_full(t, 0);
+			     i < hashset_table_end(t);
+			     i = hashset_next_full(t, i + 1)) {
+				bucknum = hashset_lookup_from(s, t, i, NULL);
+				if (bucknum != HT_MAX_BUCKETS) {
+					hashset_erase(s, bucknum);
+				}
+			}
+		}
+	} else {
+		// remove the elements of s that are in other
+		for (t = s; t; t = hashset_next_table(s, t)) {
+			for (i = hashset_next_full(t, 0);
+			     i < hashset_table_end(t);
+			     i = hashset_next_full(t, i + 1)) {
+				if (hashset_lookup_from(other, t, i, NULL)
+				    != HT_MAX_BUCKETS) {
+					bucknum = hashset_bucket_number(s, t, i);
+					hashset_erase(s, bucknum);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* INVALID finalize */
+/* UNNECESSARY get_enumerator (iter_make) */
+/* MISSING get_hash_code */
+/* UNNECESSARY get_object_data */
+/* INVALID get_type */
+
+int hashset_intersect_with(struct hashset *s, const struct hashset *other)
+{
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(other);
+	assert(s->width == other->width);
+
+	const struct hashset *t;
+	struct hashset snew;
+	const void *val, *value;
+	size_t i, bucknum, hash, nbucket;
+	int err;
+
+	if (s == other) {
+		return 0;
+	}
+
+	if (hashset_is_small(s)) {
+		hashset_small_erase_if(s, other, 0);
+	} else if (2 * hashset_count(other) < hashset_count(s)) {
+		// most of s goes away: copy the survivors to a smaller table
+		nbucket = hashset_min_buckets(s, hashset_count(other), 0);
+		if ((err = hashset_init_sized(&snew, s, nbucket))) {
+			return err;
+		}
+		for (t = other; t; t = hashset_next_table(other, t)) {
+			for (i = hashset_next_full(t, 0);
+			     i < hashset_table_end(t);
+			     i = hashset_next_full(t, i + 1)) {
+				bucknum = hashset_lookup_from(s, t, i, &hash);
+				if (bucknum != HT_MAX_BUCKETS) {
+					val = hashset_bucket(s, bucknum);
+					value = hashset_bucket_value(s, bucknum);
+					hashset_insert_new(&snew, val, value,
+							   hash);
+				}
+			}
+		}
+		hashset_replace(s, &snew);
+	} else {
+		// remove the elements of s that are not in other
+		for (t = s; t; t = hashset_next_table(s, t)) {
+			for (i = hashset_next_full(t, 0);
+			     i < hashset_table_end(t);
+			     i = hashset_next_full(t, i + 1)) {
+				if (hashset_lookup_from(other, t, i, NULL)
+				    == HT_MAX_BUCKETS) {
+					bucknum = hashset_bucket_number(s, t, i);
+					hashset_erase(s, bucknum);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+int hashset_is_proper_subset_of(const struct hashset *s,
+				const struct hashset *other)
+{
+	assert(s);
+	assert(other);
+
+	return (hashset_count(s) < hashset_count(other)
+		&& hashset_all_in(s, other));
+}
+
+int hashset_is_proper_superset_of(const struct hashset *s,
+				  const struct hashset *other)
+{
+	return hashset_is_proper_subset_of(other, s);
+}
+
+int hashset_is_subset_of(const struct hashset *s, const struct hashset *other)
+{
+	assert(s);
+	assert(other);
+
+	return (hashset_count(s) <= hashset_count(other)
+		&& hashset_all_in(s, other));
+}
+
+int hashset_is_superset_of(const struct hashset *s,
+			   const struct hashset *other)
+{
+	return hashset_is_subset_of(other, s);
+}
+
+/* UNNESSARY memberwise_clone (assign_copy) */
+/* INVALID on_deserialization */
+
+int hashset_overlaps(const struct hashset *s, const struct hashset *other)
+{
+	assert(s);
+	assert(other);
 
-	if ((err = hashset_init_sized(s, src->width, src->hash, src->compar,
-				      src->context, nbucket))) {
-		return err;
+	const struct hashset *t;
+	size_t i;
+
+	if (hashset_count(other) < hashset_count(s)) {
+		const struct hashset *tmp = s;
+		s = other;
+		other = tmp;
 	}
 
-	HASHSET_FOREACH(it, src) {
-		val = HASHSET_VAL(it);
-		if ((err = hashset_set_item(s, val))) {
-			hashset_destroy(s);
-			return err;
+	// look up the elements of the smaller set in the larger one
+	for (t = s; t; t = hashset_next_table(s, t)) {
+		for (i = hashset_next_full(t, 0); i < hashset_table_end(t);
+		     i = hashset_next_full(t, i + 1)) {
+			if (hashset_lookup_from(other, t, i, NULL) != HT_MAX_BUCKETS) {
+				return 1;
+			}
 		}
 	}
 
 	return 0;
 }
 
-static int hashset_needs_grow_delta(const struct hashset *s, size_t delta)
+int hashset_remove(struct hashset *s, const void *key)
 {
-	assert(delta <= HT_MAX_COUNT);
-	assert(s->nbucket <= HT_MAX_COUNT - delta);
-	assert(s->count_max >= s->count);
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(key);
 
-	if (s->nbucket >= HT_MIN_BUCKETS && delta <= s->count_max - s->count) {
+	if (!hashset_count(s)) {
 		return 0;
-	} else {
-		return 1;
 	}
+
+	return hashset_remove_hashed(s, key, hashset_key_hash(s, key));
 }
 
-static int hashset_grow_delta(struct hashset *s, size_t delta)
+int hashset_remove_hashed(struct hashset *s, const void *key, size_t hash)
 {
-	assert(delta <= HT_MAX_COUNT - s->nbucket);
-
-	size_t count0 = s->count;
-	size_t nbucket0 = s->nbucket;
-	size_t count = count0 + delta;
-	size_t nbucket = min_buckets(count, nbucket0);
-	int err;
-
-	if (nbucket > nbucket0) {
-		struct hashset snew;
-		struct hashset_iter it;
-		void *val;
+	assert(s);
+	assert(!hashset_is_mapped(s));
+	assert(key);
 
-		if ((err = hashset_init_sized(&snew, s->width, s->hash,
-					      s->compar, s->context,
-					      nbucket))) {
-			return err;
-		}
+	size_t bucknum;
 
-		HASHSET_FOREACH(it, s) {
-			val = HASHSET_VAL(it);
-			if ((err = hashset_set_item(&snew, val))) {
-				hashset_destroy(&snew);
-				return err;
-			}
-		}
+	if (!hashset_count(s)) {
+		return 0;
+	}
 
-		hashset_destroy(s);
-		*s = snew;
+	bucknum = hashset_lookup(s, key, hash, NULL);
+	if (bucknum == HT_MAX_BUCKETS) {
+		return 0;
 	}
 
-	return 0;
+	hashset_erase(s, bucknum);
+	if (hashset_old(s)) {
+		hashset_migrate(s, HT_MIGRATE_BUCKETS);
+	}
+	return 1;
 }
 
-int hashset_ensure_capacity(struct hashset *s, size_t n)
+/* MISSING remove_where */
+
+int hashset_set_equals(const struct hashset *s, const struct hashset *other)
 {
 	assert(s);
-	assert(n >= hashset_count(s));
-	assert(hashset_capacity(s) >= hashset_count(s));
-	assert(n <= HT_MAX_BUCKETS);
-
-	if (n > hashset_capacity(s)) {
-		size_t delta = n - hashset_count(s);
-		return hashset_grow_delta(s, delta);
-	}
+	assert(other);
 
-	return 0;
+	return (hashset_count(s) == hashset_count(other)
+		&& hashset_all_in(s, other));
 }
 
-int hashset_init(struct hashset *s, size_t width,
-		 size_t (*hash) (const void *, void *),
-		 int (*compar) (const void *, const void *, void *),
-		 void *context)
+int hashset_symmetric_except_with(struct hashset *s,
+				  const struct hashset *other)
 {
 	assert(s);
-	assert(hash);
-	assert(compar);
+	assert(!hashset_is_mapped(s));
+	assert(other);
+	assert(s->width == other->width);
+	assert(s->vwidth == other->vwidth);
 
-	s->buckets = NULL;
-	s->nbucket = 0;
-	s->width = width;
-	s->status = NULL;
-	s->count = 0;
-	s->hash = hash;
-	s->compar = compar;
-	s->context = context;
-	hashset_reset_thresholds(s, 0);
+	const struct hashset *t;
+	struct hashset_pos pos;
+	const void *val;
+	size_t i;
+	int err;
 
-	return 0;
-}
+	if (s == other) {
+		return hashset_clear(s);
+	}
 
-int hashset_init_copy(struct hashset *s, const struct hashset *src)
-{
-	size_t nbucket;
+	if ((err = hashset_ensure_capacity(s, hashset_count(s)
+					   + hashset_count(other)))) {
+		return err;
+	}
 
-	assert(s);
-	assert(src);
-	assert(s != src);
+	for (t = other; t; t = hashset_next_table(other, t)) {
+		for (i = hashset_next_full(t, 0); i < hashset_table_end(t);
+		     i = hashset_next_full(t, i + 1)) {
+
+			val = (const char *)t->buckets + i * t->width;
+			pos.hash = hashset_hash_from(s, t, i);
+			pos.existing = hashset_lookup(s, val, pos.hash,
+						      &pos.insert);
+			if (pos.existing != HT_MAX_BUCKETS) {
+				hashset_erase(s, pos.existing);
+				continue;
+			}
+			if ((err = hashset_insert(s, &pos, val))) {
+				return err;
+			}
+			if (s->vwidth) {
+				memcpy(hashset_bucket_value(s, pos.existing),
+				       hashset_value_at(t, i), s->vwidth);
+			}
+		}
+	}
 
-	nbucket = hashset_bucket_count(src);
-	return hashset_init_copy_sized(s, src, nbucket);
+	return 0;
 }
 
-int hashset_assign_copy(struct hashset *s, const struct hashset *src)
+/* MISSING to_string */
+
+int hashset_trim_excess(struct hashset *s)
 {
+	assert(s);
+	assert(!hashset_is_mapped(s));
+
+	size_t count = hashset_count(s);
+	size_t nbucket = hashset_min_buckets(s, count, 0);
 	struct hashset snew;
 	int err;
 
-	assert(s);
-	assert(src);
+	if (hashset_nsmall(s) && count <= hashset_nsmall(s)) {
+		hashset_make_small(s);
+		return 0;
+	}
 
-	if ((err = hashset_init_copy(&snew, src))) {
+	if ((err = hashset_init_next(&snew, s, nbucket))) {
 		return err;
 	}
 
-	hashset_destroy(s);
-	*s = snew;
+	if (hashset_counters(s) && snew.nbucket != s->nbucket) {
+		hashset_counters(s)->nresize++;
+	}
 
+	hashset_rehash_into(&snew, s);
+	hashset_replace(s, &snew);
 	return 0;
 }
 
-void hashset_destroy(struct hashset *s)
+static void swap_bytes(void *x, void *y, size_t width)
 {
-	assert(s);
+	unsigned char *a = x, *b = y, tmp;
+	size_t i;
 
-	free(s->status);
-	free(s->buckets);
+	for (i = 0; i < width; i++) {
+		tmp = a[i];
+		a[i] = b[i];
+		b[i] = tmp;
+	}
 }
 
-void *hashset_item(const struct hashset *s, const void *key)
+/* Rehash in place, without allocating, to get rid of the tombstones.
+ * We first mark every deleted bucket empty and every full bucket deleted;
+ * after that, a deleted bucket holds an element that still needs a place.
+ * We move each of those to the first free bucket in its probe sequence,
+ * swapping with the bucket there if it is still waiting for a place.
+ */
+int hashset_purge(struct hashset *s)
 {
 	assert(s);
-	assert(key);
+	assert(!hashset_is_mapped(s));
 
-	const void *buckets = s->buckets;
-	const unsigned char *status = s->status;
-	const size_t bucket_count = s->nbucket;
+	unsigned char *status;
+	const size_t n = s->nbucket;
 	const size_t width = s->width;
-	size_t num_probes = 0;	// how many times we've probed
-	const size_t bucket_count_minus_one = bucket_count - 1;
-	size_t hash = hashset_hash(s, key);
-	size_t bucknum = hash & bucket_count_minus_one;
-	void *ptr;
-	unsigned char stat;
+	const struct hashset *old;
+	size_t *hashes;
+	char *buckets;
+	size_t i, dst, hash;
+
+	if ((old = hashset_old(s))) {	// finish the resize in progress
+		hashset_migrate(s, old->nbucket);
+	}
+
+	if (!s->ndeleted) {
+		return 0;
+	}
+
+	status = s->status;
+	buckets = s->buckets;
+	hashes = hashset_hashes(s);
+
+	// elements can move to groups that are not in the log
+	if (s->ext && s->ext->dirty) {
+		s->ext->ndirty = hashset_dirty_max(n) + 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (status[i] & HT_BUCKET_FULL) {
+			status[i] = HT_BUCKET_DELETED;
+		} else {
+			status[i] = HT_BUCKET_EMPTY;
+		}
+	}
 
-	for (num_probes = 0; num_probes < bucket_count; num_probes++) {
-		ptr = (char *)buckets + bucknum * width;
-		stat = status[bucknum];
-		if (!stat) {	// bucket is empty
-			return NULL;
-		} else if (stat == HT_BUCKET_DELETED) {	// bucket empty, deleted; keep searching
+	for (i = 0; i < n; i++) {
+		if (status[i] != HT_BUCKET_DELETED) {
+			continue;
+		}
 
-		} else if (!hashset_compare(s, key, ptr)) {
-			return ptr;
+		hash = hashset_bucket_hash(s, i);
+		dst = hashset_probe_free(s, hash);
+
+		if (dst / HT_GROUP_WIDTH == i / HT_GROUP_WIDTH) {
+			// already in the first group with room
+			status[i] = ht_tag(hash);
+		} else if (status[dst] == HT_BUCKET_EMPTY) {
+			status[dst] = ht_tag(hash);
+			status[i] = HT_BUCKET_EMPTY;
+			memcpy(buckets + dst * width, buckets + i * width,
+			       width);
+			if (hashes) {
+				hashes[dst] = hash;
+			}
+			if (s->vwidth) {
+				memcpy(hashset_value_at(s, dst),
+				       hashset_value_at(s, i), s->vwidth);
+			}
+		} else {
+			// dst is waiting for a place too: swap, then redo i
+			status[dst] = ht_tag(hash);
+			swap_bytes(buckets + dst * width, buckets + i * width,
+				   width);
+			if (hashes) {
+				hashes[i] = hashes[dst];
+				hashes[dst] = hash;
+			}
+			if (s->vwidth) {
+				swap_bytes(hashset_value_at(s, dst),
+					   hashset_value_at(s, i), s->vwidth);
+			}
+			i--;
 		}
-		bucknum =
-		    (bucknum +
-		     JUMP_(key, num_probes + 1)) & bucket_count_minus_one;
 	}
 
-	return NULL;
+	s->ndeleted = 0;
+	return 0;
 }
 
-int hashset_set_item(struct hashset *s, const void *key)
+int hashset_union_with(struct hashset *s, const struct hashset *other)
 {
 	assert(s);
-	assert(key);
+	assert(!hashset_is_mapped(s));
+	assert(other);
+	assert(s->width == other->width);
+	assert(s->vwidth == other->vwidth);
 
+	const struct hashset *t;
 	struct hashset_pos pos;
-	void *dst;
+	const void *val;
+	size_t i, n;
+	int err = 0;
 
-	if ((dst = hashset_find(s, key, &pos))) {
-		memcpy(dst, key, s->width);
+	if (s == other || !hashset_count(other)) {
 		return 0;
-	} else {
-		return hashset_insert(s, &pos, key);
 	}
-}
 
-int hashset_clear(struct hashset *s)
-{
-	assert(s);
+	// reserve room for all of other, tombstones included, so that we
+	// grow (or purge) at most once, up front
+	n = hashset_count(other);
+	if (hashset_is_small(s)) {
+		err = hashset_ensure_capacity(s, hashset_count(s) + n);
+	} else if (hashset_needs_grow_delta(s, n)) {
+		err = hashset_grow_delta(s, n);
+	}
+	if (err) {
+		return err;
+	}
 
-	size_t n = hashset_bucket_count(s);
+	for (t = other; t; t = hashset_next_table(other, t)) {
+		for (i = hashset_next_full(t, 0); i < hashset_table_end(t);
+		     i = hashset_next_full(t, i + 1)) {
+
+			val = (const char *)t->buckets + i * t->width;
+			pos.hash = hashset_hash_from(s, t, i);
+			pos.existing = hashset_lookup(s, val, pos.hash,
+						      &pos.insert);
+			if (pos.existing != HT_MAX_BUCKETS) {
+				continue;
+			}
+			if ((err = hashset_insert(s, &pos, val))) {
+				return err;
+			}
+			if (s->vwidth) {
+				memcpy(hashset_bucket_value(s, pos.existing),
+				       hashset_value_at(t, i), s->vwidth);
+			}
+		}
+	}
 
-	memset(s->buckets, 0, n * s->width);
-	memset(s->status, 0, n * sizeof(s->status[0]));
-	s->count = 0;
 	return 0;
 }
 
-int hashset_contains(const struct hashset *s, const void *key)
+void *hashset_find(const struct hashset *s, const void *key,
+		   struct hashset_pos *pos)
 {
 	assert(s);
 	assert(key);
+	assert(pos);
 
-	if (hashset_item(s, key)) {
-		return 1;
-	} else {
-		return 0;
-	}
+	return hashset_find_hashed(s, key, hashset_key_hash(s, key), pos);
 }
 
-/* MISSING copy_to */
-/* INVALID create_set_comparer */
-/* MISSING equals */
-/* MISSING except_with */
-/* INVALID finalize */
-/* UNNECESSARY get_enumerator (iter_make) */
-/* MISSING get_hash_code */
-/* UNNECESSARY get_object_data */
-/* INVALID get_type */
-/* MISSING intersect_with */
-/* MISSING is_proper_subset_of */
-/* MISSING is_proper_superset_of */
-/* MISSING is_subset_of */
-/* MISSING is_superset_of */
-/* UNNESSARY memberwise_clone (assign_copy) */
-/* INVALID on_deserialization */
-/* MISSING overlaps */
-
-int hashset_remove(struct hashset *s, const void *key)
+/* pos keeps the hash, so a following hashset_insert doesn't recompute it */
+void *hashset_find_hashed(const struct hashset *s, const void *key,
+			  size_t hash, struct hashset_pos *pos)
 {
 	assert(s);
 	assert(key);
+	assert(pos);
 
-	const void *buckets = s->buckets;
-	unsigned char *status = s->status;
-	const size_t bucket_count = s->nbucket;
-	const size_t width = s->width;
-	size_t num_probes = 0;	// how many times we've probed
-	const size_t bucket_count_minus_one = bucket_count - 1;
-	size_t hash = hashset_hash(s, key);
-	size_t bucknum = hash & bucket_count_minus_one;
-	void *ptr;
-	unsigned char stat;
-
-	for (num_probes = 0; num_probes < bucket_count; num_probes++) {
-		ptr = (char *)buckets + bucknum * width;
-		stat = status[bucknum];
-		if (!stat) {	// bucket is empty
-			return 0;
-		} else if (stat == HT_BUCKET_DELETED) {	// empty, deleted; keep searching
-		} else if (!hashset_compare(s, key, ptr)) {
-			status[bucknum] = HT_BUCKET_DELETED;
-			s->count--;
-			return 1;
-		}
-		bucknum =
-		    (bucknum +
-		     JUMP_(key, num_probes + 1)) & bucket_count_minus_one;
+	pos->hash = hash;
+
+	if (!s->nbucket && !hashset_is_small(s)) {
+		pos->insert = HT_MAX_BUCKETS;
+		pos->existing = HT_MAX_BUCKETS;
+		return NULL;
 	}
 
-	return 0;
-}
+	pos->existing = hashset_lookup(s, key, pos->hash, &pos->insert);
+	if (pos->existing == HT_MAX_BUCKETS) {
+		return NULL;	// key is not present
+	}
 
-/* MISSING remove_where */
-/* MISSING set_equals */
-/* MISSING symmetric_except_with */
-/* MISSING to_string */
+	return hashset_bucket(s, pos->existing);
+}
 
-int hashset_trim_excess(struct hashset *s)
+size_t hashset_find_many(const struct hashset *s, const void *keys,
+			 size_t nkey, size_t key_width, void **items,
+			 struct hashset_pos *pos)
 {
 	assert(s);
+	assert(keys || !nkey);
+	assert(items);
+
+	const char *key = keys;
+	const size_t bucket_count_minus_one = s->nbucket - 1;
+	size_t hash[HT_BATCH];
+	size_t i, j, n, bucknum, insert, nfound = 0;
+	struct hashset_pos p;
+
+	if (hashset_is_small(s)) {
+		for (i = 0; i < nkey; i++) {
+			items[i] = hashset_find(s, key + i * key_width, &p);
+			nfound += items[i] != NULL;
+			if (pos) {
+				pos[i] = p;
+			}
+		}
+		return nfound;
+	}
 
-	size_t count = hashset_count(s);
-	size_t nbucket = min_buckets(count, 0);
-	struct hashset snew;
-	struct hashset_iter it;
-	void *val;
-	int err;
-
-	if ((err = hashset_init_sized(&snew, s->width, s->hash, s->compar,
-				      s->context, nbucket))) {
-		return err;
+	if (!s->nbucket) {
+		for (i = 0; i < nkey; i++) {
+			items[i] = NULL;
+			if (pos) {
+				pos[i].hash = hashset_hash(s, key
+							   + i * key_width);
+				pos[i].insert = HT_MAX_BUCKETS;
+				pos[i].existing = HT_MAX_BUCKETS;
+			}
+		}
+		return 0;
 	}
 
-	HASHSET_FOREACH(it, s) {
-		val = HASHSET_VAL(it);
-		if ((err = hashset_set_item(&snew, val))) {
-			hashset_destroy(&snew);
-			return err;
+	for (i = 0; i < nkey; i += n) {
+		n = nkey - i < HT_BATCH ? nkey - i : HT_BATCH;
+
+		// hash the batch, and start loading the home buckets
+		for (j = 0; j < n; j++) {
+			hash[j] = hashset_hash(s, key + (i + j) * key_width);
+			bucknum = hash[j] & bucket_count_minus_one;
+			HT_PREFETCH(s->status + bucknum);
+			HT_PREFETCH((const char *)s->buckets
+				    + bucknum * s->width);
+		}
+
+		// by now, most of the loads have finished
+		for (j = 0; j < n; j++) {
+			bucknum = hashset_lookup(s, key + (i + j) * key_width,
+						 hash[j], pos ? &insert : NULL);
+			if (bucknum != HT_MAX_BUCKETS) {
+				items[i + j] = hashset_bucket(s, bucknum);
+				nfound++;
+			} else {
+				items[i + j] = NULL;
+			}
+			if (pos) {
+				pos[i + j].hash = hash[j];
+				pos[i + j].insert = insert;
+				pos[i + j].existing = bucknum;
+			}
 		}
 	}
 
-	hashset_destroy(s);
-	*s = snew;
-	return 0;
+	return nfound;
 }
 
-/* MISSING union_with */
-
-void *hashset_find(const struct hashset *s, const void *key,
-		   struct hashset_pos *pos)
+size_t hashset_contains_many(const struct hashset *s, const void *keys,
+			     size_t nkey, size_t key_width, int *found)
 {
 	assert(s);
-	assert(key);
-	assert(pos);
-
-	const void *buckets = s->buckets;
-	const unsigned char *status = s->status;
-	const size_t bucket_count = s->nbucket;
-	const size_t width = s->width;
-	size_t num_probes = 0;	// how many times we've probed
-	const size_t bucket_count_minus_one = bucket_count - 1;
-	size_t hash = hashset_hash(s, key);
-	size_t bucknum = hash & bucket_count_minus_one;
-	void *ptr;
-	unsigned char stat;
-
-	pos->insert = HT_MAX_BUCKETS;
-	pos->existing = HT_MAX_BUCKETS;
-
-	for (num_probes = 0; num_probes < bucket_count; num_probes++) {
-		ptr = (char *)buckets + bucknum * width;
-		stat = status[bucknum];
-		if (!stat) {	// bucket is empty
-			if (pos->insert == HT_MAX_BUCKETS) {	// found no prior place to insert
-				pos->insert = bucknum;
-			}
-			return NULL;
-		} else if (stat == HT_BUCKET_DELETED) {	// empty, deleted; keep searching, mark to insert
-			if (pos->insert == HT_MAX_BUCKETS) {
-				pos->insert = bucknum;
-			}
-		} else if (!hashset_compare(s, key, ptr)) {
-			pos->existing = bucknum;
-			return ptr;
+	assert(keys || !nkey);
+	assert(found);
+
+	const char *key = keys;
+	void *items[HT_BATCH];
+	size_t i, j, n, nfound = 0;
+
+	for (i = 0; i < nkey; i += n) {
+		n = nkey - i < HT_BATCH ? nkey - i : HT_BATCH;
+		nfound += hashset_find_many(s, key + i * key_width, n,
+					    key_width, items, NULL);
+		for (j = 0; j < n; j++) {
+			found[i + j] = items[j] != NULL;
 		}
-		bucknum =
-		    (bucknum +
-		     JUMP_(key, num_probes + 1)) & bucket_count_minus_one;
 	}
 
-	return NULL;		// table is full and key is not present
+	return nfound;
 }
 
 int hashset_insert(struct hashset *s, struct hashset_pos *pos,
@@ -512,30 +1909,42 @@ int hashset_insert(struct hashset *s, struct hashset_pos *pos,
 	int err;
 
 	assert(s);
+	assert(!hashset_is_mapped(s));
 	assert(pos);
 	assert(pos->existing == HT_MAX_BUCKETS);
 	assert(val);
 
-	if (hashset_needs_grow_delta(s, 1)) {
+	if (hashset_is_small(s)) {
+		if (s->count < s->count_max) {
+			pos->existing = s->count++;
+			memcpy(hashset_bucket(s, pos->existing), val,
+			       s->width);
+			return 0;
+		}
+		// move to a table; pos has no hash if the lookup skipped it
+		if ((err = hashset_grow_delta(s, 1))) {
+			return err;
+		}
+		pos->hash = hashset_hash(s, val);
+		pos->existing = hashset_probe(s, val, pos->hash, &pos->insert);
+	} else if (hashset_needs_grow_delta(s, 1)) {
 		if ((err = hashset_grow_delta(s, 1))) {
 			return err;
 		}
-		hashset_find(s, val, pos);	// need to recompute pos
+		// need to recompute pos
+		pos->existing = hashset_probe(s, val, pos->hash, &pos->insert);
 	}
 
 	assert(!hashset_needs_grow_delta(s, 1));
 	assert(s->count < s->count_max);
 	assert(pos->insert != HT_MAX_BUCKETS);
 
-	size_t ix = pos->insert;
-	size_t width = s->width;
-
-	pos->existing = ix;
-	s->count++;
-	s->status[ix] |= HT_BUCKET_FULL;
+	pos->existing = pos->insert;
+	hashset_insert_at(s, pos->insert, val, NULL, pos->hash);
 
-	void *ptr = s->buckets + ix * width;
-	memcpy(ptr, val, width);
+	if (hashset_old(s)) {
+		hashset_migrate(s, HT_MIGRATE_BUCKETS);
+	}
 
 	return 0;
 }
@@ -543,19 +1952,36 @@ int hashset_insert(struct hashset *s, struct hashset_pos *pos,
 int hashset_remove_at(struct hashset *s, struct hashset_pos *pos)
 {
 	assert(s);
+	assert(!hashset_is_mapped(s));
 	assert(pos);
 	assert(pos->existing != HT_MAX_BUCKETS);
 
 	size_t ix = pos->existing;
 
-	pos->insert = ix;
+	hashset_erase(s, ix);
+
+	if (ix < s->nbucket) {
+		pos->insert = ix;
+	} else if (hashset_is_small(s)) {
+		pos->insert = s->count;
+	} else {
+		pos->insert = hashset_probe_free(s, pos->hash);
+	}
 	pos->existing = HT_MAX_BUCKETS;
 
-	s->count--;
-	s->status[ix] = HT_BUCKET_DELETED;
 	return 0;
 }
 
+void *hashset_value(const struct hashset *s, const struct hashset_pos *pos)
+{
+	assert(s);
+	assert(s->vwidth);
+	assert(pos);
+	assert(pos->existing != HT_MAX_BUCKETS);
+
+	return hashset_bucket_value(s, pos->existing);
+}
+
 struct hashset_iter hashset_iter_make(const struct hashset *s)
 {
 	assert(s);
@@ -579,17 +2005,36 @@ void *hashset_iter_advance(struct hashset_iter *it)
 	assert(it);
 
 	const struct hashset *s = it->s;
-	const unsigned char *status = it->s->status;
-	size_t i, n = hashset_bucket_count(s);
+	size_t i, n = hashset_table_end(s);
 
-	for (i = it->i; i < n; i++) {
-		if (status[i] & HT_BUCKET_FULL) {
-			it->val = s->buckets + i * s->width;
+	i = it->i;
+	if (i < n && (i = hashset_next_full(s, i)) < n) {
+		it->val = (char *)s->buckets + i * s->width;
+		goto out;
+	}
+
+	if (hashset_old(s)) {	// old table buckets come after the current ones
+		const struct hashset *old = hashset_old(s);
+
+		i = hashset_next_full(old, i - n);
+		if (i < old->nbucket) {
+			it->val = (char *)old->buckets + i * old->width;
+			i += n;
 			goto out;
 		}
+		i += n;
 	}
 	it->val = NULL;
 out:
 	it->i = i + 1;
 	return it->val;
 }
+
+void *hashset_iter_value(const struct hashset_iter *it)
+{
+	assert(it);
+	assert(it->val);
+	assert(it->s->vwidth);
+
+	return hashset_bucket_value(it->s, it->i - 1);
+}
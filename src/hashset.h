@@ -31,24 +31,127 @@
 #ifndef HASHSET_H
 #define HASHSET_H
 
+struct allocator;
 
+
+/* flags */
+#define HASHSET_CACHE_HASH	0x1	// store each element's hash
+#define HASHSET_INCREMENTAL	0x2	// spread resizes over many inserts
+#define HASHSET_STATS		0x4	// collect the counters in hashset_stats
+#define HASHSET_SPARSE_CLEAR	0x8	// clear only the groups that were used
+
+/* probe sequences (the steps are between groups of buckets) */
+#define HASHSET_PROBE_QUADRATIC	0	// 1, 2, 3, ... groups
+#define HASHSET_PROBE_LINEAR	1	// 1, 1, 1, ... groups
+#define HASHSET_PROBE_DOUBLE	2	// a fixed, odd step taken from the hash
+
+/* the most a table can be filled, out of 100 */
+#define HASHSET_MAX_LOAD_PCT	95
+
+struct hashset_options {
+	unsigned flags;
+	size_t vwidth;		// for a map, bytes per value; 0 for a set
+	unsigned load_pct;	// max occupancy, out of 100; 0 for the default
+	unsigned probe;		// a HASHSET_PROBE_ value
+	size_t capacity;	// elements to make room for up front
+	const struct allocator *alloc;	// NULL for the C library
+	unsigned nthread;	// threads for rebuilding big tables; see below
+
+	// a buffer for up to nsmall elements, or NULL; see below
+	void *small;
+	size_t nsmall;
+};
+
+/* With nthread above 1, rebuilding a big table (to grow it, copy it, or
+ * trim it) splits the old buckets into chunks and moves them into the new
+ * table on up to nthread threads at once.  hash must then be safe to call
+ * from several threads, and the allocator is still only called from the
+ * caller's thread.  Tables under a few tens of thousands of elements are
+ * always rebuilt on one thread, where starting the others costs more than
+ * it saves.  So is every table in a build that configure found without
+ * POSIX threads or the __atomic builtins; there, nthread is ignored.
+ */
+
+/* A set given a small buffer keeps its elements there, searching them
+ * linearly without hashing, until it outgrows the buffer; then it moves
+ * them to a hashed table.  trim_excess moves them back once they fit.
+ * The buffer must stay valid until the set is destroyed.  Small sets
+ * support everything but maps, and copies of them never get a buffer.
+ */
+
+/* Probe lengths are in groups past the first one; the last histogram
+ * entry counts everything at or above it.
+ */
+#define HASHSET_STATS_NPROBE	16
+
+struct hashset_stats {
+	size_t count;		// elements
+	size_t nbucket;		// buckets in the current table
+	size_t ndeleted;	// tombstones in the current table
+	double load;		// count / nbucket
+	double deleted_ratio;	// ndeleted / nbucket
+
+	// the remaining fields are zero unless flags has HASHSET_STATS
+	size_t hit[HASHSET_STATS_NPROBE];	// probe lengths, key found
+	size_t miss[HASHSET_STATS_NPROBE];	// probe lengths, key absent
+	size_t ncompar;		// calls to compar while probing
+	size_t nresize;		// table rebuilds to a new bucket count
+	double grow_time;	// seconds spent making room for inserts
+};
+
+/* The parts of a set that most sets never use, kept out of struct hashset
+ * so that the fields every lookup reads share a cache line or two.  A set
+ * allocates this on first need: for its flags, for nthread, for an
+ * incremental resize, once it outgrows its small buffer, or when mapped.
+ */
+struct hashset_ext {
+	unsigned nthread;	// threads for rebuilding big tables
+	size_t *hashes;		// NULL unless flags has HASHSET_CACHE_HASH
+	size_t *dirty;		// with HASHSET_SPARSE_CLEAR, groups in use
+	size_t ndirty;		// more than hashset_dirty_max: all of them
+
+	void *small;		// caller's buffer, once the set outgrows it
+	size_t nsmall;		// elements it holds
+
+	struct hashset *old;	// table being moved during incremental resize
+	size_t migrate;		// next bucket of old to move
+
+	struct hashset_stats *stats;	// NULL unless flags has HASHSET_STATS
+
+	void *map;		// the file mapping from hashset_map, or NULL
+	size_t map_size;
+};
+
+/* A small set has no status array; its buckets are the caller's buffer,
+ * and count_max is the number of elements the buffer holds.
+ */
 struct hashset {
 	size_t width;
+	size_t vwidth;		// 0 unless the set is a map
 	size_t (*hash) (const void *, void *);
 	int (*compar) (const void *, const void *, void *);
 	void *context;
+	unsigned flags;
+	unsigned char load_pct;	// max occupancy, out of 100
+	unsigned char probe;	// a HASHSET_PROBE_ value
+	const struct allocator *alloc;	// NULL for the C library
 
 	size_t nbucket;
 	void *buckets;
+	void *vals;		// for a map, the values, parallel to buckets
 	unsigned char *status;
 
 	size_t count;
 	size_t count_max;
+	size_t ndeleted;	// tombstones
+
+	struct hashset_ext *ext;	// NULL until needed
 };
 
 struct hashset_pos {
 	size_t insert;
 	size_t existing;
+	size_t hash;
 };
 
 struct hashset_iter {
@@ -66,8 +169,25 @@ int hashset_init(struct hashset *s, size_t width,
 		 size_t (*hash) (const void *, void *),
 		 int (*compar) (const void *, const void *, void *),
 		 void *context);
+int hashset_init_flags(struct hashset *s, size_t width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, unsigned flags);
+int hashset_init_alloc(struct hashset *s, size_t width,
+		       size_t (*hash) (const void *, void *),
+		       int (*compar) (const void *, const void *, void *),
+		       void *context, const struct allocator *alloc);
+int hashset_init_options(struct hashset *s, size_t width,
+			 size_t (*hash) (const void *, void *),
+			 int (*compar) (const void *, const void *, void *),
+			 void *context, const struct hashset_options *opts);
+int hashset_init_map(struct hashset *s, size_t width, size_t vwidth,
+		     size_t (*hash) (const void *, void *),
+		     int (*compar) (const void *, const void *, void *),
+		     void *context, unsigned flags);
 int hashset_init_copy(struct hashset *s, const struct hashset *src);
 int hashset_assign_copy(struct hashset *s, const struct hashset *src);
+int hashset_assign_array(struct hashset *s, const void *base, size_t nel);
 void hashset_destroy(struct hashset *s);
 
 // properties
@@ -82,29 +202,92 @@ int hashset_ensure_capacity(struct hashset *s, size_t n);
 
 void *hashset_item(const struct hashset *s, const void *key);
 int hashset_set_item(struct hashset *s, const void *val);
+void *hashset_item_value(const struct hashset *s, const void *key);
+
+/* These take key's hash, which must equal hashset_hash(s, key), so that a
+ * caller looking the same key up in several sets hashes it only once.
+ */
+void *hashset_item_hashed(const struct hashset *s, const void *key,
+			  size_t hash);
+int hashset_contains_hashed(const struct hashset *s, const void *key,
+			    size_t hash);
+int hashset_remove_hashed(struct hashset *s, const void *key, size_t hash);
 
 // methods
 int hashset_clear(struct hashset *s);
 int hashset_contains(const struct hashset *s, const void *key);
 int hashset_remove(struct hashset *s, const void *key);
 int hashset_trim_excess(struct hashset *s);
+int hashset_purge(struct hashset *s);
+size_t hashset_copy_to(const struct hashset *s, void *dst);
+void hashset_stats(const struct hashset *s, struct hashset_stats *stats);
+
+// set operations; other must have the same width, hash, and compar as s
+int hashset_except_with(struct hashset *s, const struct hashset *other);
+int hashset_intersect_with(struct hashset *s, const struct hashset *other);
+int hashset_symmetric_except_with(struct hashset *s,
+				  const struct hashset *other);
+int hashset_union_with(struct hashset *s, const struct hashset *other);
+int hashset_is_proper_subset_of(const struct hashset *s,
+				const struct hashset *other);
+int hashset_is_proper_superset_of(const struct hashset *s,
+				  const struct hashset *other);
+int hashset_is_subset_of(const struct hashset *s, const struct hashset *other);
+int hashset_is_superset_of(const struct hashset *s,
+			   const struct hashset *other);
+int hashset_overlaps(const struct hashset *s, const struct hashset *other);
+int hashset_set_equals(const struct hashset *s, const struct hashset *other);
 
 // position-based operations
 void *hashset_find(const struct hashset *s, const void *key,
 		   struct hashset_pos *pos);
+void *hashset_find_hashed(const struct hashset *s, const void *key,
+			  size_t hash, struct hashset_pos *pos);
 int hashset_insert(struct hashset *s, struct hashset_pos *pos,
 		   const void *val);
 int hashset_remove_at(struct hashset *s, struct hashset_pos *pos);
+void *hashset_value(const struct hashset *s, const struct hashset_pos *pos);
+
+// batch operations; keys is an array of nkey keys, each key_width bytes
+size_t hashset_find_many(const struct hashset *s, const void *keys,
+			 size_t nkey, size_t key_width, void **items,
+			 struct hashset_pos *pos);
+size_t hashset_contains_many(const struct hashset *s, const void *keys,
+			     size_t nkey, size_t key_width, int *found);
+
+/* hashset_save writes the table to fd as it is laid out in memory, and
+ * hashset_map maps such a file read-only, giving a set that answers
+ * lookups and iteration straight from the mapped pages, without reading
+ * or rehashing anything up front.  Processes mapping the same file share
+ * its pages.  The caller supplies hash and compar again; they must hash
+ * equal keys as the saving process's did.  The file records the sizes
+ * and probe parameters and is rejected (EINVAL) by a build that lays
+ * tables out differently.
+ *
+ * A mapped set must not be modified; hashset_init_copy gives a copy that
+ * can be.  hashset_destroy unmaps it.
+ */
+int hashset_save(const struct hashset *s, int fd);
+int hashset_map(struct hashset *s, const char *path,
+		size_t (*hash) (const void *, void *),
+		int (*compar) (const void *, const void *, void *),
+		void *context);
 
 // iteration
 struct hashset_iter hashset_iter_make(const struct hashset *s);
 void hashset_iter_reset(struct hashset_iter *it);
 void *hashset_iter_advance(struct hashset_iter *it);
+void *hashset_iter_value(const struct hashset_iter *it);
 
 // static method definitions
 size_t hashset_count(const struct hashset *s)
 {
-	return s->count;
+	size_t count = s->count;
+
+	if (s->ext && s->ext->old)
+		count += s->ext->old->count;
+
+	return count;
 }
 
 static inline size_t hashset_capacity(const struct hashset *s)
@@ -0,0 +1,228 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "xalloc.h"
+#include "intern.h"
+
+/* Bytes in an arena chunk.  Strings longer than a quarter of this get a
+ * chunk of their own.
+ */
+#define INTERN_CHUNK_SIZE	65536
+
+/* Starting size of the strings array */
+#define INTERN_MIN_STRS		16
+
+#define INTERN_NONE		SIZE_MAX
+
+struct intern_chunk {
+	struct intern_chunk *next;
+	size_t size;
+	char data[];
+};
+
+/* The elements of the hash set */
+struct intern_elt {
+	size_t hash;
+	size_t id;
+};
+
+/* A string being looked up; its id is INTERN_NONE */
+struct intern_key {
+	struct intern_elt elt;
+	const char *ptr;
+	size_t len;
+};
+
+
+static size_t intern_elt_hash(const void *x, void *context)
+{
+	(void)context;
+	return ((const struct intern_elt *)x)->hash;
+}
+
+static const struct intern_str *intern_elt_str(const struct intern *t,
+					       const struct intern_elt *e,
+					       struct intern_str *buf)
+{
+	const struct intern_key *key;
+
+	if (e->id != INTERN_NONE) {
+		return &t->strs[e->id];
+	}
+
+	key = (const struct intern_key *)e;
+	buf->ptr = key->ptr;
+	buf->len = key->len;
+	buf->hash = e->hash;
+	return buf;
+}
+
+/* The hashes are full-width, so most mismatches stop before memcmp */
+static int intern_elt_compar(const void *x, const void *y, void *context)
+{
+	const struct intern *t = context;
+	const struct intern_elt *a = x, *b = y;
+	const struct intern_str *sa, *sb;
+	struct intern_str abuf, bbuf;
+
+	if (a->hash != b->hash) {
+		return 1;
+	}
+
+	sa = intern_elt_str(t, a, &abuf);
+	sb = intern_elt_str(t, b, &bbuf);
+	if (sa->len != sb->len) {
+		return 1;
+	}
+	return memcmp(sa->ptr, sb->ptr, sa->len);
+}
+
+static struct intern_chunk *intern_chunk_new(size_t size)
+{
+	struct intern_chunk *c = xmalloc(sizeof(*c) + size);
+
+	c->next = NULL;
+	c->size = size;
+	return c;
+}
+
+/* Get n bytes from the arena */
+static char *intern_alloc(struct intern *t, size_t n)
+{
+	struct intern_chunk *c = t->chunk;
+	char *ptr;
+
+	if (c && c->size - t->chunk_used >= n) {
+		ptr = c->data + t->chunk_used;
+		t->chunk_used += n;
+		return ptr;
+	}
+
+	if (c && n > INTERN_CHUNK_SIZE / 4) {
+		// keep filling the current chunk; put this one behind it
+		c = intern_chunk_new(n);
+		c->next = t->chunk->next;
+		t->chunk->next = c;
+		return c->data;
+	}
+
+	c = intern_chunk_new(n > INTERN_CHUNK_SIZE ? n : INTERN_CHUNK_SIZE);
+	c->next = t->chunk;
+	t->chunk = c;
+	t->chunk_used = n;
+	return c->data;
+}
+
+void intern_init(struct intern *t)
+{
+	assert(t);
+
+	hashset_init(&t->set, sizeof(struct intern_elt), intern_elt_hash,
+		     intern_elt_compar, t);
+	t->strs = NULL;
+	t->nstr = 0;
+	t->nstr_max = 0;
+	t->chunk = NULL;
+	t->chunk_used = 0;
+}
+
+void intern_destroy(struct intern *t)
+{
+	assert(t);
+
+	struct intern_chunk *c, *next;
+
+	for (c = t->chunk; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(t->strs);
+	hashset_destroy(&t->set);
+}
+
+size_t intern_id(struct intern *t, const char *str, size_t len)
+{
+	assert(t);
+	assert(str);
+
+	const struct intern_elt *e;
+	struct intern_key key;
+	struct intern_elt elt;
+	struct hashset_pos pos;
+	struct intern_str *s;
+	char *copy;
+
+	key.elt.hash = bytes_hash(str, len);
+	key.elt.id = INTERN_NONE;
+	key.ptr = str;
+	key.len = len;
+
+	if ((e = hashset_find_hashed(&t->set, &key, key.elt.hash, &pos))) {
+		return e->id;
+	}
+
+	copy = intern_alloc(t, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	if (t->nstr == t->nstr_max) {
+		t->nstr_max = (t->nstr_max ? 2 * t->nstr_max
+			       : INTERN_MIN_STRS);
+		t->strs = xrealloc(t->strs, t->nstr_max * sizeof(t->strs[0]));
+	}
+
+	// add the string first: if the set grows, it reprobes with elt
+	elt.hash = key.elt.hash;
+	elt.id = t->nstr++;
+	s = &t->strs[elt.id];
+	s->ptr = copy;
+	s->len = len;
+	s->hash = elt.hash;
+
+	if (hashset_insert(&t->set, &pos, &elt)) {
+		xalloc_die();
+	}
+
+	return elt.id;
+}
+
+int intern_find(const struct intern *t, const char *str, size_t len,
+		size_t *id)
+{
+	assert(t);
+	assert(str);
+
+	const struct intern_elt *e;
+	struct intern_key key;
+
+	key.elt.hash = bytes_hash(str, len);
+	key.elt.id = INTERN_NONE;
+	key.ptr = str;
+	key.len = len;
+
+	e = hashset_item_hashed(&t->set, &key, key.elt.hash);
+	if (!e) {
+		return 0;
+	}
+
+	if (id) {
+		*id = e->id;
+	}
+	return 1;
+}
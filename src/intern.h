@@ -0,0 +1,84 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include "hashset.h"
+
+/* A string interning table.  Each distinct string (any bytes, of a given
+ * length) gets a small integer id, assigned in order from 0, and a copy
+ * in an arena of large chunks.  Ids and copies stay valid until the table
+ * is destroyed.  Copies are NUL-terminated.
+ *
+ * The hash set holds just each string's hash and id; the strings array
+ * keeps its copy, length, and hash.  The set's compar refers back to the
+ * table, so a table must not be moved after intern_init.  Like xalloc,
+ * the functions here abort when out of memory.
+ */
+struct intern_str {
+	const char *ptr;
+	size_t len;
+	size_t hash;		// bytes_hash(ptr, len)
+};
+
+struct intern_chunk;
+
+struct intern {
+	struct hashset set;
+	struct intern_str *strs;	// by id
+	size_t nstr;
+	size_t nstr_max;
+	struct intern_chunk *chunk;	// the one being filled; older follow
+	size_t chunk_used;
+};
+
+// create, destroy
+void intern_init(struct intern *t);
+void intern_destroy(struct intern *t);
+
+// properties
+static inline size_t intern_count(const struct intern *t);
+static inline const char *intern_ptr(const struct intern *t, size_t id);
+static inline size_t intern_len(const struct intern *t, size_t id);
+static inline size_t intern_hash(const struct intern *t, size_t id);
+
+// methods
+size_t intern_id(struct intern *t, const char *str, size_t len);
+int intern_find(const struct intern *t, const char *str, size_t len,
+		size_t *id);
+
+// static method definitions
+size_t intern_count(const struct intern *t)
+{
+	return t->nstr;
+}
+
+const char *intern_ptr(const struct intern *t, size_t id)
+{
+	return t->strs[id].ptr;
+}
+
+size_t intern_len(const struct intern *t, size_t id)
+{
+	return t->strs[id].len;
+}
+
+size_t intern_hash(const struct intern *t, size_t id)
+{
+	return t->strs[id].hash;
+}
+
+#endif // INTERN_H
@@ -16,8 +16,9 @@
 #include <errno.h>		// ENOMEM
 #include <stddef.h>		// size_t, NULL
 #include <stdint.h>		// int64_t
-#include <stdlib.h>		// free, malloc, qsort, realloc
+#include <stdlib.h>		// qsort
 #include <string.h>		// memcpy, memmove
+#include "allocator.h"
 #include "coreutil.h"		// needs_grow
 
 #include "intset.h"
@@ -35,10 +36,16 @@ static int compare(const void *px, const void *py)
 }
 
 int intset_init(struct intset *s)
+{
+	return intset_init_alloc(s, NULL);
+}
+
+int intset_init_alloc(struct intset *s, const struct allocator *alloc)
 {
 	s->vals = NULL;
 	s->n = 0;
 	s->nmax = 0;
+	s->alloc = alloc;
 	return 0;
 }
 
@@ -48,7 +55,8 @@ int intset_init_copy(struct intset *s, const struct intset *src)
 	size_t n;
 
 	intset_get_vals(src, &vals, &n);
-	s->vals = malloc(n * sizeof(int64_t));
+	s->alloc = src->alloc;
+	s->vals = allocator_malloc(s->alloc, n * sizeof(int64_t));
 	if (!s->vals) {
 		s->n = 0;
 		s->nmax = 0;
@@ -90,7 +98,7 @@ int intset_assign_array(struct intset *s, const int64_t *vals, size_t n,
 
 void intset_destroy(struct intset *s)
 {
-	free(s->vals);
+	allocator_free(s->alloc, s->vals);
 }
 
 int intset_add(struct intset *s, int64_t val)
@@ -133,7 +141,8 @@ int intset_ensure_capacity(struct intset *s, size_t n)
 	size_t nmax = s->nmax;
 
 	if (needs_grow(n, &nmax)) {
-		int64_t *vals = realloc(s->vals, nmax * sizeof(int64_t));
+		int64_t *vals = allocator_realloc(s->alloc, s->vals,
+						   nmax * sizeof(int64_t));
 		if (!vals)
 			return ENOMEM;
 		s->vals = vals;
@@ -148,13 +157,14 @@ int intset_trim_excess(struct intset *s)
 	size_t nmax = s->n;
 
 	if (nmax) {
-		int64_t *vals = realloc(s->vals, nmax * sizeof(int64_t));
+		int64_t *vals = allocator_realloc(s->alloc, s->vals,
+						   nmax * sizeof(int64_t));
 		if (vals) {
 			s->vals = vals;
 			s->nmax = nmax;
 		}
 	} else {
-		free(s->vals);
+		allocator_free(s->alloc, s->vals);
 		s->vals = NULL;
 		s->nmax = 0;
 	}
@@ -15,14 +15,18 @@
 #ifndef INTSET_H
 #define INTSET_H
 
+struct allocator;
+
 struct intset {
 	int64_t *vals;
 	size_t n;
 	size_t nmax;
+	const struct allocator *alloc;	// NULL for the C library
 };
 
 // create, destroy
 int intset_init(struct intset *s);
+int intset_init_alloc(struct intset *s, const struct allocator *alloc);
 int intset_init_copy(struct intset *s, const struct intset *src);
 int intset_assign_copy(struct intset *s, const struct intset *src);
 int intset_assign_array(struct intset *s, const int64_t *vals, size_t n,
@@ -0,0 +1,563 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "allocator.h"
+#include "ohashset.h"
+
+/* Minimum size we're willing to let tables be; must be a power of two */
+#define OH_MIN_BUCKETS	8
+
+#define OH_MAX_BUCKETS	((size_t)1 << (CHAR_BIT * sizeof(size_t) - 1))
+
+/* Number of entries a table with n buckets has room for: floor(2n/3),
+ * computed without overflow.  This is always less than n, so a probe
+ * always reaches an empty bucket.
+ */
+#define OH_USABLE(n)	((n) / 3 * 2 + (n) % 3 * 2 / 3)
+
+#define OH_EMPTY	0
+#define OH_DELETED	1
+#define OH_NOT_FOUND	SIZE_MAX
+
+/* Bits of the hash folded into the probe sequence at each step */
+#define OH_PERTURB_SHIFT 5
+
+
+static size_t oh_min_buckets(size_t count, size_t nbucket0)
+{
+	size_t n = OH_MIN_BUCKETS;
+
+	assert(count <= OH_USABLE(OH_MAX_BUCKETS));
+
+	while (n < nbucket0 || count > OH_USABLE(n)) {
+		assert(2 * n > n);
+		n *= 2;
+	}
+
+	return n;
+}
+
+/* Bytes per index in a table with nbucket buckets.  The largest index
+ * stored is 2 + (entry_max - 1), which is less than nbucket.
+ */
+static size_t oh_index_width(size_t nbucket)
+{
+	size_t n = nbucket - 1;
+
+	if (n <= UINT8_MAX) {
+		return 1;
+	} else if (n <= UINT16_MAX) {
+		return 2;
+	} else if (n <= UINT32_MAX) {
+		return 4;
+	}
+	return sizeof(size_t);
+}
+
+static inline size_t oh_dead_size(size_t entry_max)
+{
+	return (entry_max + CHAR_BIT - 1) / CHAR_BIT;
+}
+
+static inline void *ohashset_entry(const struct ohashset *s, size_t e)
+{
+	return (char *)s->entries + e * s->width;
+}
+
+static inline int ohashset_is_dead(const struct ohashset *s, size_t e)
+{
+	return (s->dead[e / CHAR_BIT] >> (e % CHAR_BIT)) & 1;
+}
+
+static inline size_t ohashset_index_get(const struct ohashset *s, size_t i)
+{
+	switch (s->iwidth) {
+	case 1:
+		return ((const uint8_t *)s->index)[i];
+	case 2:
+		return ((const uint16_t *)s->index)[i];
+	case 4:
+		return ((const uint32_t *)s->index)[i];
+	default:
+		return ((const size_t *)s->index)[i];
+	}
+}
+
+static inline void ohashset_index_set(struct ohashset *s, size_t i, size_t ix)
+{
+	switch (s->iwidth) {
+	case 1:
+		((uint8_t *)s->index)[i] = (uint8_t)ix;
+		break;
+	case 2:
+		((uint16_t *)s->index)[i] = (uint16_t)ix;
+		break;
+	case 4:
+		((uint32_t *)s->index)[i] = (uint32_t)ix;
+		break;
+	default:
+		((size_t *)s->index)[i] = ix;
+		break;
+	}
+}
+
+/* Look for key, whose hash is given.  Returns its entry, or OH_NOT_FOUND.
+ * *slot gets the bucket holding the key, or, if it isn't there, the first
+ * deleted or empty bucket on its probe sequence.
+ *
+ * The sequence is CPython's: i = 5i + 1 + perturb, with perturb starting
+ * as the hash and losing OH_PERTURB_SHIFT bits at each step.  Once perturb
+ * reaches zero this visits every bucket, so it ends at an empty one.
+ */
+static size_t ohashset_probe(const struct ohashset *s, const void *key,
+			     size_t hash, size_t *slot)
+{
+	const size_t mask = s->nbucket - 1;
+	size_t perturb = hash;
+	size_t i = hash & mask;
+	size_t ins = OH_NOT_FOUND;
+	size_t ix, e;
+
+	for (;;) {
+		ix = ohashset_index_get(s, i);
+		if (ix == OH_EMPTY) {
+			break;
+		} else if (ix == OH_DELETED) {
+			if (ins == OH_NOT_FOUND) {
+				ins = i;
+			}
+		} else {
+			e = ix - 2;
+			if (s->hashes[e] == hash
+			    && !s->compar(key, ohashset_entry(s, e),
+					  s->context)) {
+				*slot = i;
+				return e;
+			}
+		}
+		perturb >>= OH_PERTURB_SHIFT;
+		i = (5 * i + 1 + perturb) & mask;
+	}
+
+	*slot = (ins == OH_NOT_FOUND) ? i : ins;
+	return OH_NOT_FOUND;
+}
+
+/* Bucket for an entry known not to be in the table, which has no
+ * deleted buckets (as after a rebuild) */
+static size_t ohashset_probe_empty(const struct ohashset *s, size_t hash)
+{
+	const size_t mask = s->nbucket - 1;
+	size_t perturb = hash;
+	size_t i = hash & mask;
+
+	while (ohashset_index_get(s, i) != OH_EMPTY) {
+		perturb >>= OH_PERTURB_SHIFT;
+		i = (5 * i + 1 + perturb) & mask;
+	}
+
+	return i;
+}
+
+/* Slide the live entries down over the holes, keeping their order */
+static void ohashset_compact(struct ohashset *s)
+{
+	const size_t width = s->width;
+	size_t i, j;
+
+	if (s->nentry == s->count) {
+		return;
+	}
+
+	for (i = 0, j = 0; i < s->nentry; i++) {
+		if (ohashset_is_dead(s, i)) {
+			continue;
+		}
+		if (i != j) {
+			memcpy(ohashset_entry(s, j), ohashset_entry(s, i),
+			       width);
+			s->hashes[j] = s->hashes[i];
+		}
+		j++;
+	}
+
+	assert(j == s->count);
+	s->nentry = j;
+}
+
+/* Resize the entries, hashes, and dead arrays to hold n entries */
+static int ohashset_resize_entries(struct ohashset *s, size_t n)
+{
+	void *entries;
+	size_t *hashes;
+	unsigned char *dead;
+
+	if (!(entries = allocator_realloc(s->alloc, s->entries,
+					  n * s->width))) {
+		return ENOMEM;
+	}
+	s->entries = entries;
+
+	if (!(hashes = allocator_realloc(s->alloc, s->hashes,
+					 n * sizeof(*hashes)))) {
+		return ENOMEM;
+	}
+	s->hashes = hashes;
+
+	if (!(dead = allocator_realloc(s->alloc, s->dead, oh_dead_size(n)))) {
+		return ENOMEM;
+	}
+	s->dead = dead;
+	return 0;
+}
+
+/* Compact the entries and rebuild the index with nbucket buckets.  On
+ * failure, s is unchanged (though its arrays may have grown).
+ */
+static int ohashset_rebuild(struct ohashset *s, size_t nbucket)
+{
+	size_t entry_max = OH_USABLE(nbucket);
+	size_t iwidth = oh_index_width(nbucket);
+	void *index;
+	size_t e;
+	int err;
+
+	assert(nbucket >= OH_MIN_BUCKETS);
+	assert(s->count <= entry_max);
+
+	if (!(index = allocator_calloc(s->alloc, nbucket, iwidth))) {
+		return ENOMEM;
+	}
+
+	if (entry_max > s->entry_max
+	    && (err = ohashset_resize_entries(s, entry_max))) {
+		allocator_free(s->alloc, index);
+		return err;
+	}
+
+	ohashset_compact(s);
+	if (entry_max < s->entry_max) {
+		// a failed shrink leaves the bigger arrays, which is fine
+		ohashset_resize_entries(s, entry_max);
+	}
+	memset(s->dead, 0, oh_dead_size(entry_max));
+
+	allocator_free(s->alloc, s->index);
+	s->index = index;
+	s->nbucket = nbucket;
+	s->iwidth = iwidth;
+	s->entry_max = entry_max;
+
+	for (e = 0; e < s->nentry; e++) {
+		ohashset_index_set(s, ohashset_probe_empty(s, s->hashes[e]),
+				   e + 2);
+	}
+
+	return 0;
+}
+
+int ohashset_init(struct ohashset *s, size_t width,
+		  size_t (*hash) (const void *, void *),
+		  int (*compar) (const void *, const void *, void *),
+		  void *context)
+{
+	return ohashset_init_alloc(s, width, hash, compar, context, NULL);
+}
+
+int ohashset_init_alloc(struct ohashset *s, size_t width,
+			size_t (*hash) (const void *, void *),
+			int (*compar) (const void *, const void *, void *),
+			void *context, const struct allocator *alloc)
+{
+	assert(s);
+	assert(hash);
+	assert(compar);
+
+	s->width = width;
+	s->hash = hash;
+	s->compar = compar;
+	s->context = context;
+	s->alloc = alloc;
+	s->entries = NULL;
+	s->hashes = NULL;
+	s->dead = NULL;
+	s->nentry = 0;
+	s->entry_max = 0;
+	s->index = NULL;
+	s->nbucket = 0;
+	s->iwidth = 0;
+	s->count = 0;
+	return 0;
+}
+
+int ohashset_init_copy(struct ohashset *s, const struct ohashset *src)
+{
+	assert(s);
+	assert(src);
+	assert(s != src);
+
+	ohashset_init_alloc(s, src->width, src->hash, src->compar,
+			    src->context, src->alloc);
+	if (!src->nbucket) {
+		return 0;
+	}
+
+	s->entries = allocator_malloc(s->alloc, src->entry_max * src->width);
+	s->hashes = allocator_malloc(s->alloc,
+				     src->entry_max * sizeof(s->hashes[0]));
+	s->dead = allocator_malloc(s->alloc, oh_dead_size(src->entry_max));
+	s->index = allocator_malloc(s->alloc, src->nbucket * src->iwidth);
+	if (!s->entries || !s->hashes || !s->dead || !s->index) {
+		ohashset_destroy(s);
+		return ENOMEM;
+	}
+
+	memcpy(s->entries, src->entries, src->nentry * src->width);
+	memcpy(s->hashes, src->hashes, src->nentry * sizeof(s->hashes[0]));
+	memcpy(s->dead, src->dead, oh_dead_size(src->entry_max));
+	memcpy(s->index, src->index, src->nbucket * src->iwidth);
+	s->nentry = src->nentry;
+	s->entry_max = src->entry_max;
+	s->nbucket = src->nbucket;
+	s->iwidth = src->iwidth;
+	s->count = src->count;
+	return 0;
+}
+
+int ohashset_assign_copy(struct ohashset *s, const struct ohashset *src)
+{
+	struct ohashset snew;
+	int err;
+
+	assert(s);
+	assert(src);
+
+	if ((err = ohashset_init_copy(&snew, src))) {
+		return err;
+	}
+
+	ohashset_destroy(s);
+	*s = snew;
+	return 0;
+}
+
+void ohashset_destroy(struct ohashset *s)
+{
+	assert(s);
+
+	allocator_free(s->alloc, s->index);
+	allocator_free(s->alloc, s->dead);
+	allocator_free(s->alloc, s->hashes);
+	allocator_free(s->alloc, s->entries);
+}
+
+int ohashset_ensure_capacity(struct ohashset *s, size_t n)
+{
+	assert(s);
+	assert(n >= s->count);
+	assert(n <= OH_USABLE(OH_MAX_BUCKETS));
+
+	if (n > ohashset_capacity(s)) {
+		return ohashset_rebuild(s, oh_min_buckets(n, s->nbucket));
+	}
+
+	return 0;
+}
+
+void *ohashset_item(const struct ohashset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	size_t e, slot;
+
+	if (!s->count) {
+		return NULL;
+	}
+
+	e = ohashset_probe(s, key, s->hash(key, s->context), &slot);
+	if (e == OH_NOT_FOUND) {
+		return NULL;
+	}
+
+	return ohashset_entry(s, e);
+}
+
+int ohashset_set_item(struct ohashset *s, const void *val)
+{
+	assert(s);
+	assert(val);
+
+	size_t hash = s->hash(val, s->context);
+	size_t e, slot;
+	int err;
+
+	if (s->nbucket) {
+		e = ohashset_probe(s, val, hash, &slot);
+		if (e != OH_NOT_FOUND) {
+			memcpy(ohashset_entry(s, e), val, s->width);
+			return 0;
+		}
+	}
+
+	if (s->nentry == s->entry_max) {
+		// compact, and grow unless at least half the entries are holes
+		if ((err = ohashset_rebuild(s, oh_min_buckets(2 * s->count + 1,
+							      0)))) {
+			return err;
+		}
+		slot = ohashset_probe_empty(s, hash);
+	}
+
+	e = s->nentry++;
+	memcpy(ohashset_entry(s, e), val, s->width);
+	s->hashes[e] = hash;
+	ohashset_index_set(s, slot, e + 2);
+	s->count++;
+	return 0;
+}
+
+int ohashset_clear(struct ohashset *s)
+{
+	assert(s);
+
+	if (s->index) {
+		memset(s->index, 0, s->nbucket * s->iwidth);
+		memset(s->dead, 0, oh_dead_size(s->entry_max));
+	}
+	s->nentry = 0;
+	s->count = 0;
+	return 0;
+}
+
+int ohashset_contains(const struct ohashset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	return ohashset_item(s, key) != NULL;
+}
+
+int ohashset_remove(struct ohashset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	size_t e, slot;
+
+	if (!s->count) {
+		return 0;
+	}
+
+	e = ohashset_probe(s, key, s->hash(key, s->context), &slot);
+	if (e == OH_NOT_FOUND) {
+		return 0;
+	}
+
+	ohashset_index_set(s, slot, OH_DELETED);
+	s->dead[e / CHAR_BIT] |= (unsigned char)(1 << (e % CHAR_BIT));
+	s->count--;
+	return 1;
+}
+
+int ohashset_trim_excess(struct ohashset *s)
+{
+	assert(s);
+
+	return ohashset_rebuild(s, oh_min_buckets(s->count, 0));
+}
+
+size_t ohashset_copy_to(const struct ohashset *s, void *dst)
+{
+	assert(s);
+	assert(dst || !s->count);
+
+	const size_t width = s->width;
+	char *out = dst;
+	size_t e, start;
+
+	if (s->nentry == s->count) {
+		if (s->count) {
+			memcpy(dst, s->entries, s->count * width);
+		}
+		return s->count;
+	}
+
+	// copy each run of live entries in one go
+	for (e = 0; e < s->nentry; e = start) {
+		while (e < s->nentry && ohashset_is_dead(s, e)) {
+			e++;
+		}
+		for (start = e; start < s->nentry; start++) {
+			if (ohashset_is_dead(s, start)) {
+				break;
+			}
+		}
+		if (start > e) {
+			memcpy(out, ohashset_entry(s, e), (start - e) * width);
+			out += (start - e) * width;
+		}
+	}
+
+	return s->count;
+}
+
+struct ohashset_iter ohashset_iter_make(const struct ohashset *s)
+{
+	assert(s);
+
+	struct ohashset_iter it;
+
+	it.s = s;
+	ohashset_iter_reset(&it);
+	return it;
+}
+
+void ohashset_iter_reset(struct ohashset_iter *it)
+{
+	assert(it);
+
+	it->i = 0;
+	it->val = NULL;
+}
+
+void *ohashset_iter_advance(struct ohashset_iter *it)
+{
+	assert(it);
+
+	const struct ohashset *s = it->s;
+	size_t i = it->i;
+
+	if (s->nentry != s->count) {
+		while (i < s->nentry && ohashset_is_dead(s, i)) {
+			i++;
+		}
+	}
+
+	if (i < s->nentry) {
+		it->val = ohashset_entry(s, i);
+		it->i = i + 1;
+		return it->val;
+	}
+
+	it->val = NULL;
+	it->i = i;
+	return NULL;
+}
@@ -0,0 +1,113 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef OHASHSET_H
+#define OHASHSET_H
+
+#include <stddef.h>
+
+struct allocator;
+
+/* An insertion-ordered hash set, laid out like CPython's compact dict.
+ * The elements live densely in an entries array, in the order they were
+ * added, and the open-addressed table holds only their indices, in 1, 2,
+ * 4, or 8 bytes depending on its size.  An empty bucket costs that much
+ * instead of a whole element, and iteration is a linear scan of the
+ * entries.
+ *
+ * Replacing an element keeps its place.  Removal leaves a hole in the
+ * entries, which iteration skips; the holes go away the next time the
+ * table is rebuilt (on growth, ensure_capacity, or trim_excess).
+ */
+struct ohashset {
+	size_t width;
+	size_t (*hash) (const void *, void *);
+	int (*compar) (const void *, const void *, void *);
+	void *context;
+	const struct allocator *alloc;	// NULL for the C library
+
+	void *entries;		// the first nentry are in use, in order
+	size_t *hashes;		// hash of each entry
+	unsigned char *dead;	// bit e is set if entry e was removed
+	size_t nentry;
+	size_t entry_max;
+
+	void *index;		// 0 if empty, 1 if deleted, else 2 + entry
+	size_t nbucket;
+	size_t iwidth;		// bytes per index
+
+	size_t count;
+};
+
+struct ohashset_iter {
+	const struct ohashset *s;
+	size_t i;
+	void *val;
+};
+
+#define OHASHSET_VAL(it) ((it).val)
+#define OHASHSET_FOREACH(it, set) \
+	for ((it) = ohashset_iter_make(set); ohashset_iter_advance(&(it));)
+
+// create, destroy
+int ohashset_init(struct ohashset *s, size_t width,
+		  size_t (*hash) (const void *, void *),
+		  int (*compar) (const void *, const void *, void *),
+		  void *context);
+int ohashset_init_alloc(struct ohashset *s, size_t width,
+			size_t (*hash) (const void *, void *),
+			int (*compar) (const void *, const void *, void *),
+			void *context, const struct allocator *alloc);
+int ohashset_init_copy(struct ohashset *s, const struct ohashset *src);
+int ohashset_assign_copy(struct ohashset *s, const struct ohashset *src);
+void ohashset_destroy(struct ohashset *s);
+
+// properties
+static inline size_t ohashset_count(const struct ohashset *s);
+static inline size_t ohashset_width(const struct ohashset *s);
+static inline size_t ohashset_capacity(const struct ohashset *s);
+int ohashset_ensure_capacity(struct ohashset *s, size_t n);
+
+void *ohashset_item(const struct ohashset *s, const void *key);
+int ohashset_set_item(struct ohashset *s, const void *val);
+
+// methods
+int ohashset_clear(struct ohashset *s);
+int ohashset_contains(const struct ohashset *s, const void *key);
+int ohashset_remove(struct ohashset *s, const void *key);
+int ohashset_trim_excess(struct ohashset *s);
+size_t ohashset_copy_to(const struct ohashset *s, void *dst);
+
+// iteration
+struct ohashset_iter ohashset_iter_make(const struct ohashset *s);
+void ohashset_iter_reset(struct ohashset_iter *it);
+void *ohashset_iter_advance(struct ohashset_iter *it);
+
+// static method definitions
+size_t ohashset_count(const struct ohashset *s)
+{
+	return s->count;
+}
+
+size_t ohashset_width(const struct ohashset *s)
+{
+	return s->width;
+}
+
+size_t ohashset_capacity(const struct ohashset *s)
+{
+	return s->entry_max - (s->nentry - s->count);
+}
+
+#endif // OHASHSET_H
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include "allocator.h"
 #include "coreutil.h"
 #include "pqueue.h"
 
@@ -37,11 +38,19 @@ static int array_update_top(void *base, size_t nel, size_t width,
 int pqueue_init(struct pqueue *q, size_t width,
 		int (*compar) (const void *, const void *, void *),
 		void *context)
+{
+	return pqueue_init_alloc(q, width, compar, context, NULL);
+}
+
+int pqueue_init_alloc(struct pqueue *q, size_t width,
+		      int (*compar) (const void *, const void *, void *),
+		      void *context, const struct allocator *alloc)
 {
 	assert(compar);
 	q->width = width;
 	q->compar = compar;
 	q->context = context;
+	q->alloc = alloc;
 	q->base = NULL;
 	q->count = 0;
 	q->capacity = 0;
@@ -53,12 +62,13 @@ int pqueue_init_copy(struct pqueue *q, const struct pqueue *src)
 	q->width = src->width;
 	q->compar = src->compar;
 	q->context = src->context;
-	q->base = malloc(src->count * q->width);
+	q->alloc = src->alloc;
+	q->base = allocator_malloc(q->alloc, src->count * q->width);
 	if (!q->base)
 		return ENOMEM;
 
 	q->count = src->count;
-	q->capacity = src->capacity;
+	q->capacity = src->count;
 	memcpy(q->base, src->base, q->count * q->width);
 	return 0;
 }
@@ -69,8 +79,10 @@ int pqueue_assign_copy(struct pqueue *q, const struct pqueue *src)
 	assert(q->compar == src->compar);
 	assert(q->context == src->context);
 
-	if (!pqueue_ensure_capacity(q, src->count))
-		return ENOMEM;
+	int err;
+
+	if ((err = pqueue_ensure_capacity(q, src->count)))
+		return err;
 
 	q->count = src->count;
 	memcpy(q->base, src->base, q->count * q->width);
@@ -79,7 +91,7 @@ int pqueue_assign_copy(struct pqueue *q, const struct pqueue *src)
 
 void pqueue_destroy(struct pqueue *q)
 {
-	free(q->base);
+	allocator_free(q->alloc, q->base);
 }
 
 int pqueue_ensure_capacity(struct pqueue *q, size_t n)
@@ -87,7 +99,7 @@ int pqueue_ensure_capacity(struct pqueue *q, size_t n)
 	if (q->capacity >= n)
 		return 0;
 
-	void *base = realloc(q->base, n * q->width);
+	void *base = allocator_realloc(q->alloc, q->base, n * q->width);
 	if (base) {
 		q->capacity = n;
 		q->base = base;
@@ -102,7 +114,8 @@ static int pqueue_grow(struct pqueue *q, size_t delta)
 	size_t capacity = q->capacity;
 
 	if (needs_grow(q->count + delta, &capacity)) {
-		void *base = realloc(q->base, capacity * q->width);
+		void *base = allocator_realloc(q->alloc, q->base,
+					       capacity * q->width);
 		if (!base)
 			return ENOMEM;
 		q->base = base;
@@ -150,13 +163,14 @@ int pqueue_trim_excess(struct pqueue *q)
 	size_t capacity = q->count;
 
 	if (capacity) {
-		void *base = realloc(q->base, capacity * q->width);
+		void *base = allocator_realloc(q->alloc, q->base,
+					       capacity * q->width);
 		if (base) {
 			q->base = base;
 			q->capacity = capacity;
 		}
 	} else {
-		free(q->base);
+		allocator_free(q->alloc, q->base);
 		q->base = NULL;
 		q->capacity = 0;
 	}
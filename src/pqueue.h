@@ -15,11 +15,13 @@
 #ifndef PQUEUE_H
 #define PQUEUE_H
 
+struct allocator;
 
 struct pqueue {
 	size_t width;
 	int (*compar) (const void *, const void *, void *);
 	void *context;
+	const struct allocator *alloc;	/* NULL for the C library */
 
 	void *base;
 	size_t count;
@@ -30,6 +32,9 @@ struct pqueue {
 int pqueue_init(struct pqueue *q, size_t width,
 		int (*compar) (const void *, const void *, void *),
 		void *context);
+int pqueue_init_alloc(struct pqueue *q, size_t width,
+		      int (*compar) (const void *, const void *, void *),
+		      void *context, const struct allocator *alloc);
 int pqueue_init_copy(struct pqueue *q, const struct pqueue *src);
 int pqueue_assign_copy(struct pqueue *q, const struct pqueue *src);
 void pqueue_destroy(struct pqueue *q);
@@ -0,0 +1,441 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "allocator.h"
+#include "rhset.h"
+
+/* How full we let the table get before we resize.  Robin Hood probing
+ * keeps the expected probe length short well past hashset's 80%.
+ */
+#define RH_OCCUPANCY_PCT 90	// (out of 100)
+
+/* Minimum size we're willing to let tables be; must be a power of two,
+ * big enough that a full table still has an empty bucket.
+ */
+#define RH_MIN_BUCKETS	4
+
+/* The largest value of dist; probes can be at most RH_MAX_DIST long */
+#define RH_MAX_DIST	UINT16_MAX
+
+#define RH_MAX_BUCKETS	((size_t)1 << (CHAR_BIT * sizeof(size_t) - 1))
+
+#define RH_NOT_FOUND	SIZE_MAX
+
+/* The following is more accurate than ((pct)/100.0 * (x)) when x is
+ * really big (> 2^52).
+ */
+#define PERCENT(pct,x) \
+	((pct) * ((x) / 100) \
+	 + (size_t)((pct) * (((x) % 100) / 100.0)))
+
+#define RH_MAX_COUNT	PERCENT(RH_OCCUPANCY_PCT, RH_MAX_BUCKETS)
+
+static size_t rh_min_buckets(size_t count, size_t nbucket0)
+{
+	size_t n = RH_MIN_BUCKETS;
+
+	assert(count <= RH_MAX_COUNT);
+
+	while (n < nbucket0 || count > PERCENT(RH_OCCUPANCY_PCT, n)) {
+		assert(2 * n > n);
+		n *= 2;
+	}
+
+	return n;
+}
+
+static inline void *rhset_bucket(const struct rhset *s, size_t i)
+{
+	return (char *)s->buckets + i * s->width;
+}
+
+/* Look for key, whose hash is given.  Returns the bucket holding it, or
+ * RH_NOT_FOUND.  In that case, *insert gets the bucket where key belongs,
+ * and *insert_dist the dist it would have there.
+ *
+ * An element that is dist - 1 buckets from its home has the same home as
+ * the key only if its dist matches the key's; and since richer elements
+ * never come before poorer ones, we can stop once we pass one whose dist
+ * is less than the key's.
+ */
+static size_t rhset_probe(const struct rhset *s, const void *key,
+			  size_t hash, size_t *insert, size_t *insert_dist)
+{
+	const uint16_t *dist = s->dist;
+	const size_t mask = s->nbucket - 1;
+	size_t i = hash & mask;
+	size_t d = 1;
+
+	for (;;) {
+		if (dist[i] < d) {
+			break;
+		}
+		if (dist[i] == d && !s->compar(key, rhset_bucket(s, i),
+					      s->context)) {
+			return i;
+		}
+		i = (i + 1) & mask;
+		d++;
+	}
+
+	*insert = i;
+	*insert_dist = d;
+	return RH_NOT_FOUND;
+}
+
+/* Put val in bucket i with the given dist, shifting the elements from i
+ * up to the next empty bucket over by one.  Returns ERANGE, without
+ * changing anything, if any of the dists would overflow.
+ */
+static int rhset_insert_at(struct rhset *s, size_t i, size_t d,
+			   const void *val)
+{
+	uint16_t *dist = s->dist;
+	const size_t mask = s->nbucket - 1;
+	const size_t width = s->width;
+	size_t j, prev;
+
+	assert(s->count < s->count_max);
+
+	if (d > RH_MAX_DIST) {
+		return ERANGE;
+	}
+
+	for (j = i; dist[j]; j = (j + 1) & mask) {
+		if (dist[j] == RH_MAX_DIST) {
+			return ERANGE;
+		}
+	}
+
+	for (; j != i; j = prev) {
+		prev = (j - 1) & mask;
+		memcpy(rhset_bucket(s, j), rhset_bucket(s, prev), width);
+		dist[j] = dist[prev] + 1;
+	}
+
+	memcpy(rhset_bucket(s, i), val, width);
+	dist[i] = (uint16_t)d;
+	s->count++;
+	return 0;
+}
+
+/* Add val, which must not already be in the table */
+static int rhset_insert_new(struct rhset *s, const void *val)
+{
+	const uint16_t *dist = s->dist;
+	const size_t mask = s->nbucket - 1;
+	size_t i = s->hash(val, s->context) & mask;
+	size_t d = 1;
+
+	while (dist[i] >= d) {
+		i = (i + 1) & mask;
+		d++;
+	}
+
+	return rhset_insert_at(s, i, d, val);
+}
+
+/* Remove the element in bucket i, and shift back the elements after it
+ * until we reach one that is in its home bucket (or an empty bucket).
+ */
+static void rhset_erase(struct rhset *s, size_t i)
+{
+	uint16_t *dist = s->dist;
+	const size_t mask = s->nbucket - 1;
+	const size_t width = s->width;
+	size_t next = (i + 1) & mask;
+
+	while (dist[next] > 1) {
+		memcpy(rhset_bucket(s, i), rhset_bucket(s, next), width);
+		dist[i] = dist[next] - 1;
+		i = next;
+		next = (next + 1) & mask;
+	}
+
+	dist[i] = 0;
+	s->count--;
+}
+
+/* Move the elements of s to a new table with nbucket buckets */
+static int rhset_rehash(struct rhset *s, size_t nbucket)
+{
+	struct rhset snew;
+	size_t i;
+	int err;
+
+	assert(nbucket >= RH_MIN_BUCKETS);
+	assert(s->count <= PERCENT(RH_OCCUPANCY_PCT, nbucket));
+
+	rhset_init_alloc(&snew, s->width, s->hash, s->compar, s->context,
+			 s->alloc);
+	snew.buckets = allocator_malloc(s->alloc, nbucket * s->width);
+	snew.dist = allocator_calloc(s->alloc, nbucket, sizeof(snew.dist[0]));
+	if (!snew.buckets || !snew.dist) {
+		rhset_destroy(&snew);
+		return ENOMEM;
+	}
+	snew.nbucket = nbucket;
+	snew.count_max = PERCENT(RH_OCCUPANCY_PCT, nbucket);
+
+	for (i = 0; i < s->nbucket; i++) {
+		if (s->dist[i]) {
+			if ((err = rhset_insert_new(&snew,
+						    rhset_bucket(s, i)))) {
+				rhset_destroy(&snew);
+				return err;
+			}
+		}
+	}
+
+	rhset_destroy(s);
+	*s = snew;
+	return 0;
+}
+
+int rhset_init(struct rhset *s, size_t width,
+	       size_t (*hash) (const void *, void *),
+	       int (*compar) (const void *, const void *, void *),
+	       void *context)
+{
+	return rhset_init_alloc(s, width, hash, compar, context, NULL);
+}
+
+int rhset_init_alloc(struct rhset *s, size_t width,
+		     size_t (*hash) (const void *, void *),
+		     int (*compar) (const void *, const void *, void *),
+		     void *context, const struct allocator *alloc)
+{
+	assert(s);
+	assert(hash);
+	assert(compar);
+
+	s->width = width;
+	s->hash = hash;
+	s->compar = compar;
+	s->context = context;
+	s->alloc = alloc;
+	s->nbucket = 0;
+	s->buckets = NULL;
+	s->dist = NULL;
+	s->count = 0;
+	s->count_max = 0;
+	return 0;
+}
+
+int rhset_init_copy(struct rhset *s, const struct rhset *src)
+{
+	assert(s);
+	assert(src);
+	assert(s != src);
+
+	rhset_init_alloc(s, src->width, src->hash, src->compar, src->context,
+			 src->alloc);
+	if (!src->nbucket) {
+		return 0;
+	}
+
+	s->buckets = allocator_malloc(s->alloc, src->nbucket * src->width);
+	s->dist = allocator_malloc(s->alloc,
+				   src->nbucket * sizeof(s->dist[0]));
+	if (!s->buckets || !s->dist) {
+		rhset_destroy(s);
+		return ENOMEM;
+	}
+
+	memcpy(s->buckets, src->buckets, src->nbucket * src->width);
+	memcpy(s->dist, src->dist, src->nbucket * sizeof(s->dist[0]));
+	s->nbucket = src->nbucket;
+	s->count = src->count;
+	s->count_max = src->count_max;
+	return 0;
+}
+
+int rhset_assign_copy(struct rhset *s, const struct rhset *src)
+{
+	struct rhset snew;
+	int err;
+
+	assert(s);
+	assert(src);
+
+	if ((err = rhset_init_copy(&snew, src))) {
+		return err;
+	}
+
+	rhset_destroy(s);
+	*s = snew;
+	return 0;
+}
+
+void rhset_destroy(struct rhset *s)
+{
+	assert(s);
+
+	allocator_free(s->alloc, s->dist);
+	allocator_free(s->alloc, s->buckets);
+}
+
+int rhset_ensure_capacity(struct rhset *s, size_t n)
+{
+	assert(s);
+	assert(n >= s->count);
+	assert(n <= RH_MAX_COUNT);
+
+	if (n > s->count_max) {
+		return rhset_rehash(s, rh_min_buckets(n, s->nbucket));
+	}
+
+	return 0;
+}
+
+void *rhset_item(const struct rhset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	size_t i, insert, insert_dist;
+
+	if (!s->count) {
+		return NULL;
+	}
+
+	i = rhset_probe(s, key, s->hash(key, s->context), &insert,
+			&insert_dist);
+	if (i == RH_NOT_FOUND) {
+		return NULL;
+	}
+
+	return rhset_bucket(s, i);
+}
+
+int rhset_set_item(struct rhset *s, const void *val)
+{
+	assert(s);
+	assert(val);
+
+	size_t hash = s->hash(val, s->context);
+	size_t i, insert, insert_dist;
+	int err;
+
+	if (s->count) {
+		i = rhset_probe(s, val, hash, &insert, &insert_dist);
+		if (i != RH_NOT_FOUND) {
+			memcpy(rhset_bucket(s, i), val, s->width);
+			return 0;
+		}
+	}
+
+	if (s->count == s->count_max) {
+		if ((err = rhset_ensure_capacity(s, s->count + 1))) {
+			return err;
+		}
+		return rhset_insert_new(s, val);	// need to reprobe
+	} else if (!s->count) {
+		return rhset_insert_new(s, val);
+	}
+
+	return rhset_insert_at(s, insert, insert_dist, val);
+}
+
+int rhset_clear(struct rhset *s)
+{
+	assert(s);
+
+	if (s->dist) {
+		memset(s->dist, 0, s->nbucket * sizeof(s->dist[0]));
+	}
+	s->count = 0;
+	return 0;
+}
+
+int rhset_contains(const struct rhset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	return rhset_item(s, key) != NULL;
+}
+
+int rhset_remove(struct rhset *s, const void *key)
+{
+	assert(s);
+	assert(key);
+
+	size_t i, insert, insert_dist;
+
+	if (!s->count) {
+		return 0;
+	}
+
+	i = rhset_probe(s, key, s->hash(key, s->context), &insert,
+			&insert_dist);
+	if (i == RH_NOT_FOUND) {
+		return 0;
+	}
+
+	rhset_erase(s, i);
+	return 1;
+}
+
+int rhset_trim_excess(struct rhset *s)
+{
+	assert(s);
+
+	return rhset_rehash(s, rh_min_buckets(s->count, 0));
+}
+
+struct rhset_iter rhset_iter_make(const struct rhset *s)
+{
+	assert(s);
+
+	struct rhset_iter it;
+
+	it.s = s;
+	rhset_iter_reset(&it);
+	return it;
+}
+
+void rhset_iter_reset(struct rhset_iter *it)
+{
+	assert(it);
+
+	it->i = 0;
+	it->val = NULL;
+}
+
+void *rhset_iter_advance(struct rhset_iter *it)
+{
+	assert(it);
+
+	const struct rhset *s = it->s;
+	size_t i;
+
+	for (i = it->i; i < s->nbucket; i++) {
+		if (s->dist[i]) {
+			it->val = rhset_bucket(s, i);
+			it->i = i + 1;
+			return it->val;
+		}
+	}
+
+	it->val = NULL;
+	it->i = i;
+	return NULL;
+}
@@ -0,0 +1,106 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef RHSET_H
+#define RHSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct allocator;
+
+/* A hash set with linear probing and Robin Hood displacement: on insert,
+ * an element that is farther from its home bucket takes the place of one
+ * that is closer.  This keeps probe lengths short and even, so the table
+ * can run at a higher load than hashset.  Removal shifts the following
+ * elements back instead of leaving a tombstone.
+ *
+ * Probe lengths are stored in 16 bits; set_item fails with ERANGE if one
+ * would overflow, which only happens with a very poor hash function.
+ */
+struct rhset {
+	size_t width;
+	size_t (*hash) (const void *, void *);
+	int (*compar) (const void *, const void *, void *);
+	void *context;
+	const struct allocator *alloc;	// NULL for the C library
+
+	size_t nbucket;
+	void *buckets;
+	uint16_t *dist;		// 0 if empty, else 1 + distance from home
+
+	size_t count;
+	size_t count_max;
+};
+
+struct rhset_iter {
+	const struct rhset *s;
+	size_t i;
+	void *val;
+};
+
+#define RHSET_VAL(it) ((it).val)
+#define RHSET_FOREACH(it, set) \
+	for ((it) = rhset_iter_make(set); rhset_iter_advance(&(it));)
+
+// create, destroy
+int rhset_init(struct rhset *s, size_t width,
+	       size_t (*hash) (const void *, void *),
+	       int (*compar) (const void *, const void *, void *),
+	       void *context);
+int rhset_init_alloc(struct rhset *s, size_t width,
+		     size_t (*hash) (const void *, void *),
+		     int (*compar) (const void *, const void *, void *),
+		     void *context, const struct allocator *alloc);
+int rhset_init_copy(struct rhset *s, const struct rhset *src);
+int rhset_assign_copy(struct rhset *s, const struct rhset *src);
+void rhset_destroy(struct rhset *s);
+
+// properties
+static inline size_t rhset_count(const struct rhset *s);
+static inline size_t rhset_width(const struct rhset *s);
+static inline size_t rhset_capacity(const struct rhset *s);
+int rhset_ensure_capacity(struct rhset *s, size_t n);
+
+void *rhset_item(const struct rhset *s, const void *key);
+int rhset_set_item(struct rhset *s, const void *val);
+
+// methods
+int rhset_clear(struct rhset *s);
+int rhset_contains(const struct rhset *s, const void *key);
+int rhset_remove(struct rhset *s, const void *key);
+int rhset_trim_excess(struct rhset *s);
+
+// iteration
+struct rhset_iter rhset_iter_make(const struct rhset *s);
+void rhset_iter_reset(struct rhset_iter *it);
+void *rhset_iter_advance(struct rhset_iter *it);
+
+// static method definitions
+size_t rhset_count(const struct rhset *s)
+{
+	return s->count;
+}
+
+size_t rhset_width(const struct rhset *s)
+{
+	return s->width;
+}
+
+size_t rhset_capacity(const struct rhset *s)
+{
+	return s->count_max;
+}
+
+#endif // RHSET_H
@@ -0,0 +1,316 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rmset.h"
+
+/* A published or retired table.  retired is the epoch in which it stopped
+ * being published; a reader that announced a later epoch can't see it.
+ */
+struct rmset_table {
+	struct hashset set;
+	size_t retired;
+	struct rmset_table *next;
+};
+
+
+static void rmset_table_free(struct rmset_table *t)
+{
+	hashset_destroy(&t->set);
+	free(t);
+}
+
+/* Free the retired tables that no reader can still see.  Called with the
+ * writer mutex held.
+ */
+static void rmset_reclaim_locked(struct rmset *s)
+{
+	struct rmset_reader *r;
+	struct rmset_table **link, *t, *next;
+	size_t e, min = SIZE_MAX;
+
+	// pairs with the fence in rmset_enter; see rmset_update_locked
+	atomic_thread_fence(memory_order_seq_cst);
+
+	for (r = s->readers; r; r = r->next) {
+		e = atomic_load_explicit(&r->epoch, memory_order_acquire);
+		if (e && e < min) {
+			min = e;
+		}
+	}
+
+	// the list is newest first, so once one goes, the rest do too
+	for (link = &s->retired; *link; link = &(*link)->next) {
+		if ((*link)->retired < min) {
+			break;
+		}
+	}
+
+	for (t = *link, *link = NULL; t; t = next) {
+		next = t->next;
+		rmset_table_free(t);
+	}
+}
+
+/* Apply fn to a copy of the published table, then publish the copy.  If
+ * fn fails, the copy is dropped and nothing changes.
+ */
+static int rmset_update_locked(struct rmset *s,
+			       int (*fn) (struct hashset *set, void *context),
+			       void *context)
+{
+	struct rmset_table *old, *t;
+	size_t e;
+	int err;
+
+	// only writers store the table, and they hold the mutex
+	old = atomic_load_explicit(&s->table, memory_order_relaxed);
+
+	if (!(t = malloc(sizeof(*t)))) {
+		return ENOMEM;
+	}
+	if ((err = hashset_init_copy(&t->set, &old->set))) {
+		free(t);
+		return err;
+	}
+	if ((err = fn(&t->set, context))) {
+		rmset_table_free(t);
+		return err;
+	}
+
+	atomic_store_explicit(&s->table, t, memory_order_release);
+
+	// A reader that loaded old had announced its epoch before its fence.
+	// Either that fence comes first, and the scan below sees the
+	// announcement (at most e), or ours does, and the reader loads t.
+	atomic_thread_fence(memory_order_seq_cst);
+	e = atomic_load_explicit(&s->epoch, memory_order_relaxed);
+	old->retired = e;
+	old->next = s->retired;
+	s->retired = old;
+	atomic_store_explicit(&s->epoch, e + 1, memory_order_release);
+
+	rmset_reclaim_locked(s);
+	return 0;
+}
+
+int rmset_init(struct rmset *s, size_t width,
+	       size_t (*hash) (const void *, void *),
+	       int (*compar) (const void *, const void *, void *),
+	       void *context)
+{
+	assert(s);
+	assert(hash);
+	assert(compar);
+
+	struct rmset_table *t;
+	int err;
+
+	if (!(t = malloc(sizeof(*t)))) {
+		return ENOMEM;
+	}
+	if ((err = hashset_init(&t->set, width, hash, compar, context))) {
+		free(t);
+		return err;
+	}
+	if ((err = pthread_mutex_init(&s->lock, NULL))) {
+		rmset_table_free(t);
+		return err;
+	}
+
+	t->retired = 0;
+	t->next = NULL;
+	atomic_init(&s->table, t);
+	atomic_init(&s->epoch, 1);	// 0 marks an idle reader
+	s->readers = NULL;
+	s->retired = NULL;
+	return 0;
+}
+
+/* No reader may be inside rmset_enter/rmset_exit */
+void rmset_destroy(struct rmset *s)
+{
+	assert(s);
+
+	struct rmset_table *t, *next;
+
+	for (t = s->retired; t; t = next) {
+		next = t->next;
+		rmset_table_free(t);
+	}
+	rmset_table_free(atomic_load_explicit(&s->table,
+					      memory_order_relaxed));
+	pthread_mutex_destroy(&s->lock);
+}
+
+void rmset_reader_add(struct rmset *s, struct rmset_reader *r)
+{
+	assert(s);
+	assert(r);
+
+	atomic_init(&r->epoch, 0);
+	r->s = s;
+
+	pthread_mutex_lock(&s->lock);
+	r->next = s->readers;
+	s->readers = r;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void rmset_reader_remove(struct rmset_reader *r)
+{
+	assert(r);
+	assert(!atomic_load_explicit(&r->epoch, memory_order_relaxed));
+
+	struct rmset *s = r->s;
+	struct rmset_reader **link;
+
+	pthread_mutex_lock(&s->lock);
+	for (link = &s->readers; *link != r; link = &(*link)->next) {
+		assert(*link);
+	}
+	*link = r->next;
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* Announce the epoch, then load the table; the fence keeps a writer from
+ * missing the announcement while we load a table it is retiring.
+ */
+const struct hashset *rmset_enter(struct rmset_reader *r)
+{
+	assert(r);
+	assert(!atomic_load_explicit(&r->epoch, memory_order_relaxed));
+
+	struct rmset *s = r->s;
+	size_t e = atomic_load_explicit(&s->epoch, memory_order_acquire);
+	struct rmset_table *t;
+
+	atomic_store_explicit(&r->epoch, e, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&s->table, memory_order_acquire);
+	return &t->set;
+}
+
+void rmset_exit(struct rmset_reader *r)
+{
+	assert(r);
+
+	atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+/* dst, if non-NULL, gets a copy of the element found */
+int rmset_lookup(struct rmset_reader *r, const void *key, void *dst)
+{
+	assert(r);
+	assert(key);
+
+	const struct hashset *set = rmset_enter(r);
+	const void *item = hashset_item(set, key);
+
+	if (item && dst) {
+		memcpy(dst, item, hashset_width(set));
+	}
+	rmset_exit(r);
+
+	return item != NULL;
+}
+
+int rmset_contains(struct rmset_reader *r, const void *key)
+{
+	return rmset_lookup(r, key, NULL);
+}
+
+size_t rmset_count(struct rmset_reader *r)
+{
+	assert(r);
+
+	size_t n = hashset_count(rmset_enter(r));
+
+	rmset_exit(r);
+	return n;
+}
+
+/* fn gets a private copy of the table to change with the hashset
+ * functions, and returns 0 to publish it or an error code to drop it */
+int rmset_update(struct rmset *s,
+		 int (*fn) (struct hashset *set, void *context),
+		 void *context)
+{
+	assert(s);
+	assert(fn);
+
+	int err;
+
+	pthread_mutex_lock(&s->lock);
+	err = rmset_update_locked(s, fn, context);
+	pthread_mutex_unlock(&s->lock);
+
+	return err;
+}
+
+static int rmset_set_item_fn(struct hashset *set, void *context)
+{
+	return hashset_set_item(set, context);
+}
+
+int rmset_set_item(struct rmset *s, const void *val)
+{
+	assert(s);
+	assert(val);
+
+	return rmset_update(s, rmset_set_item_fn, (void *)val);
+}
+
+static int rmset_remove_fn(struct hashset *set, void *context)
+{
+	hashset_remove(set, context);
+	return 0;
+}
+
+/* *removed, if non-NULL, says whether key was there */
+int rmset_remove(struct rmset *s, const void *key, int *removed)
+{
+	assert(s);
+	assert(key);
+
+	const struct rmset_table *t;
+	int err = 0, found;
+
+	pthread_mutex_lock(&s->lock);
+	t = atomic_load_explicit(&s->table, memory_order_relaxed);
+	// don't copy the table just to find the key isn't there
+	if ((found = hashset_contains(&t->set, key))) {
+		err = rmset_update_locked(s, rmset_remove_fn, (void *)key);
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	if (removed) {
+		*removed = found && !err;
+	}
+	return err;
+}
+
+/* Free what rmset_update couldn't, once the readers have moved on */
+void rmset_reclaim(struct rmset *s)
+{
+	assert(s);
+
+	pthread_mutex_lock(&s->lock);
+	rmset_reclaim_locked(s);
+	pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,81 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef RMSET_H
+#define RMSET_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "hashset.h"
+
+/* A read-mostly hash set, for tables that see many lookups from many
+ * threads and only occasional updates.  Readers take no locks and do no
+ * atomic read-modify-write: they announce the current epoch in their own
+ * reader slot, load the published table, and search it with the ordinary
+ * hashset functions.  The published table is never modified.
+ *
+ * Writers take a mutex, apply their changes to a copy of the table, and
+ * publish the copy.  The old table is retired and freed once every reader
+ * that might still see it has moved on (epoch-based reclamation).  An
+ * update costs a copy of the whole table, so batch changes with
+ * rmset_update where you can.
+ *
+ * Each reading thread registers an rmset_reader of its own.  Between
+ * rmset_enter and rmset_exit, the table rmset_enter returned stays valid;
+ * keep that section short, since it holds back reclamation.
+ */
+struct rmset_table;
+
+struct rmset_reader {
+	atomic_size_t epoch;		// 0 when not reading
+	struct rmset *s;
+	struct rmset_reader *next;	// guarded by the writer mutex
+};
+
+struct rmset {
+	_Atomic(struct rmset_table *) table;	// the published table
+	atomic_size_t epoch;
+
+	pthread_mutex_t lock;		// serializes writers
+	struct rmset_reader *readers;
+	struct rmset_table *retired;	// newest first
+};
+
+// create, destroy
+int rmset_init(struct rmset *s, size_t width,
+	       size_t (*hash) (const void *, void *),
+	       int (*compar) (const void *, const void *, void *),
+	       void *context);
+void rmset_destroy(struct rmset *s);
+
+// readers
+void rmset_reader_add(struct rmset *s, struct rmset_reader *r);
+void rmset_reader_remove(struct rmset_reader *r);
+const struct hashset *rmset_enter(struct rmset_reader *r);
+void rmset_exit(struct rmset_reader *r);
+
+int rmset_lookup(struct rmset_reader *r, const void *key, void *dst);
+int rmset_contains(struct rmset_reader *r, const void *key);
+size_t rmset_count(struct rmset_reader *r);
+
+// writers
+int rmset_update(struct rmset *s,
+		 int (*fn) (struct hashset *set, void *context),
+		 void *context);
+int rmset_set_item(struct rmset *s, const void *val);
+int rmset_remove(struct rmset *s, const void *key, int *removed);
+void rmset_reclaim(struct rmset *s);
+
+#endif // RMSET_H
@@ -0,0 +1,372 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hashset.h"
+#include "shardset.h"
+
+#define SS_MAX_SHARDS	((size_t)1 << 16)
+
+/* Bytes kept between one shard's set and the next shard's lock, so that
+ * threads on neighboring shards don't share a cache line */
+#define SS_CACHE_LINE	64
+
+/* The shard comes from the high bits of a multiplicative mix of the hash,
+ * since for simple hashes (like the identity on integers) the high bits
+ * themselves are often all zero.  hashset takes its 7-bit tags from the
+ * top of the same mix, so the shard bits start just below those; if they
+ * overlapped, every key in a shard would share part of its tag, and the
+ * tags would stop ruling out non-matching buckets.
+ */
+#if SIZE_MAX > 0xffffffffUL
+# define SS_MIX_MULT	((size_t)0x9e3779b97f4a7c15ULL)
+#else
+# define SS_MIX_MULT	((size_t)0x9e3779b9UL)
+#endif
+#define SS_TAG_BITS	7
+
+struct shardset_shard {
+	pthread_mutex_t lock;
+	struct hashset set;
+	char pad[SS_CACHE_LINE];
+};
+
+
+static inline size_t shardset_hash(const struct shardset *s, const void *key)
+{
+	return s->hash(key, s->context);
+}
+
+static inline struct shardset_shard *shardset_shard(const struct shardset *s,
+						     size_t hash)
+{
+	// two shifts, since shift is the full width when there's one shard
+	size_t mix = (hash * SS_MIX_MULT) << SS_TAG_BITS;
+	size_t i = (mix >> (s->shift - 1)) >> 1;
+	return &s->shards[i];
+}
+
+static void shardset_lock(struct shardset_shard *sh)
+{
+	int err = pthread_mutex_lock(&sh->lock);
+	assert(!err);
+	(void)err;
+}
+
+static void shardset_unlock(struct shardset_shard *sh)
+{
+	int err = pthread_mutex_unlock(&sh->lock);
+	assert(!err);
+	(void)err;
+}
+
+static void shardset_lock_all(const struct shardset *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->nshard; i++) {
+		shardset_lock(&s->shards[i]);
+	}
+}
+
+static void shardset_unlock_all(const struct shardset *s)
+{
+	size_t i = s->nshard;
+
+	while (i-- > 0) {
+		shardset_unlock(&s->shards[i]);
+	}
+}
+
+/* nshard is rounded up to a power of two */
+int shardset_init(struct shardset *s, size_t nshard, size_t width,
+		  size_t (*hash) (const void *, void *),
+		  int (*compar) (const void *, const void *, void *),
+		  void *context)
+{
+	assert(s);
+	assert(nshard > 0);
+	assert(nshard <= SS_MAX_SHARDS);
+	assert(hash);
+	assert(compar);
+
+	size_t n = 1, i;
+	unsigned bits = 0;
+	int err;
+
+	while (n < nshard) {
+		n *= 2;
+		bits++;
+	}
+
+	s->width = width;
+	s->hash = hash;
+	s->context = context;
+	s->nshard = n;
+	s->shift = CHAR_BIT * sizeof(size_t) - bits;
+
+	if (!(s->shards = malloc(n * sizeof(s->shards[0])))) {
+		return ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((err = pthread_mutex_init(&s->shards[i].lock, NULL))) {
+			goto fail;
+		}
+		if ((err = hashset_init(&s->shards[i].set, width, hash,
+					compar, context))) {
+			pthread_mutex_destroy(&s->shards[i].lock);
+			goto fail;
+		}
+	}
+
+	return 0;
+
+fail:
+	while (i-- > 0) {
+		hashset_destroy(&s->shards[i].set);
+		pthread_mutex_destroy(&s->shards[i].lock);
+	}
+	free(s->shards);
+	return err;
+}
+
+void shardset_destroy(struct shardset *s)
+{
+	assert(s);
+
+	size_t i;
+
+	for (i = 0; i < s->nshard; i++) {
+		hashset_destroy(&s->shards[i].set);
+		pthread_mutex_destroy(&s->shards[i].lock);
+	}
+	free(s->shards);
+}
+
+/* The set behind shard i, for inspecting (with hashset_stats, say) while
+ * no other thread is using s */
+const struct hashset *shardset_shard_set(const struct shardset *s, size_t i)
+{
+	assert(s);
+	assert(i < s->nshard);
+
+	return &s->shards[i].set;
+}
+
+/* The sum of the shard counts, each taken at a different moment */
+size_t shardset_count(const struct shardset *s)
+{
+	assert(s);
+
+	struct shardset_shard *sh;
+	size_t i, n = 0;
+
+	for (i = 0; i < s->nshard; i++) {
+		sh = &s->shards[i];
+		shardset_lock(sh);
+		n += hashset_count(&sh->set);
+		shardset_unlock(sh);
+	}
+
+	return n;
+}
+
+/* Make room for n elements spread evenly, with some slack for the spread
+ * being uneven */
+int shardset_ensure_capacity(struct shardset *s, size_t n)
+{
+	assert(s);
+
+	struct shardset_shard *sh;
+	size_t per = n / s->nshard;
+	size_t i;
+	int err = 0;
+
+	per += per / 8 + 1;
+
+	for (i = 0; i < s->nshard && !err; i++) {
+		sh = &s->shards[i];
+		shardset_lock(sh);
+		if (per > hashset_count(&sh->set)) {
+			err = hashset_ensure_capacity(&sh->set, per);
+		}
+		shardset_unlock(sh);
+	}
+
+	return err;
+}
+
+int shardset_lookup(const struct shardset *s, const void *key, void *dst)
+{
+	assert(s);
+	assert(key);
+
+	size_t hash = shardset_hash(s, key);
+	struct shardset_shard *sh = shardset_shard(s, hash);
+	const void *item;
+
+	shardset_lock(sh);
+	item = hashset_item_hashed(&sh->set, key, hash);
+	if (item && dst) {
+		memcpy(dst, item, s->width);
+	}
+	shardset_unlock(sh);
+
+	return item != NULL;
+}
+
+int shardset_contains(const struct shardset *s, const void *key)
+{
+	return shardset_lookup(s, key, NULL);
+}
+
+/* Add val, or replace the element equal to it */
+int shardset_set_item(struct shardset *s, const void *val)
+{
+	assert(s);
+	assert(val);
+
+	size_t hash = shardset_hash(s, val);
+	struct shardset_shard *sh = shardset_shard(s, hash);
+	struct hashset_pos pos;
+	void *item;
+	int err = 0;
+
+	shardset_lock(sh);
+	if ((item = hashset_find_hashed(&sh->set, val, hash, &pos))) {
+		memcpy(item, val, s->width);
+	} else {
+		err = hashset_insert(&sh->set, &pos, val);
+	}
+	shardset_unlock(sh);
+
+	return err;
+}
+
+/* Add val unless an element equal to it is there already, which is left
+ * alone; *added, if non-NULL, says which */
+int shardset_insert(struct shardset *s, const void *val, int *added)
+{
+	assert(s);
+	assert(val);
+
+	size_t hash = shardset_hash(s, val);
+	struct shardset_shard *sh = shardset_shard(s, hash);
+	struct hashset_pos pos;
+	int err = 0, add = 0;
+
+	shardset_lock(sh);
+	if (!hashset_find_hashed(&sh->set, val, hash, &pos)) {
+		if (!(err = hashset_insert(&sh->set, &pos, val))) {
+			add = 1;
+		}
+	}
+	shardset_unlock(sh);
+
+	if (added) {
+		*added = add;
+	}
+	return err;
+}
+
+/* Returns 1 if key was there; dst, if non-NULL, gets the removed element */
+int shardset_remove(struct shardset *s, const void *key, void *dst)
+{
+	assert(s);
+	assert(key);
+
+	size_t hash = shardset_hash(s, key);
+	struct shardset_shard *sh = shardset_shard(s, hash);
+	struct hashset_pos pos;
+	void *item;
+
+	shardset_lock(sh);
+	if ((item = hashset_find_hashed(&sh->set, key, hash, &pos))) {
+		if (dst) {
+			memcpy(dst, item, s->width);
+		}
+		hashset_remove_at(&sh->set, &pos);
+	}
+	shardset_unlock(sh);
+
+	return item != NULL;
+}
+
+int shardset_clear(struct shardset *s)
+{
+	assert(s);
+
+	size_t i;
+
+	shardset_lock_all(s);
+	for (i = 0; i < s->nshard; i++) {
+		hashset_clear(&s->shards[i].set);
+	}
+	shardset_unlock_all(s);
+
+	return 0;
+}
+
+/* dst must have room for the count, which a caller can only bound (with
+ * shardset_count and a margin) unless it stops the writers first */
+size_t shardset_copy_to(const struct shardset *s, void *dst)
+{
+	assert(s);
+
+	char *out = dst;
+	size_t i, n = 0;
+
+	shardset_lock_all(s);
+	for (i = 0; i < s->nshard; i++) {
+		n += hashset_copy_to(&s->shards[i].set,
+				     out ? out + n * s->width : NULL);
+	}
+	shardset_unlock_all(s);
+
+	return n;
+}
+
+/* Call fn on each element until it returns nonzero, and return that.  fn
+ * runs with every shard locked, so it must not use the set.
+ */
+int shardset_foreach(const struct shardset *s,
+		     int (*fn) (const void *val, void *context),
+		     void *context)
+{
+	assert(s);
+	assert(fn);
+
+	struct hashset_iter it;
+	size_t i;
+	int ret = 0;
+
+	shardset_lock_all(s);
+	for (i = 0; i < s->nshard && !ret; i++) {
+		HASHSET_FOREACH(it, &s->shards[i].set) {
+			if ((ret = fn(HASHSET_VAL(it), context))) {
+				break;
+			}
+		}
+	}
+	shardset_unlock_all(s);
+
+	return ret;
+}
@@ -0,0 +1,79 @@
+//  Copyright 2015 Patrick O. Perry.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef SHARDSET_H
+#define SHARDSET_H
+
+#include <stddef.h>
+
+struct hashset;
+
+/* A hash set that many threads can use at once.  Keys go by the high bits
+ * of their (mixed) hash to one of nshard independent hashsets, each with
+ * its own mutex, so threads working on different shards don't contend,
+ * and each shard grows on its own.  The low bits of the hash still pick
+ * the bucket within a shard.
+ *
+ * Since another thread may remove an element at any time, lookups copy
+ * it out instead of returning a pointer.  Operations on single keys are
+ * atomic.  shardset_foreach and shardset_copy_to hold every shard's lock
+ * (taken in order, so they don't deadlock with each other) and see a
+ * consistent snapshot; shardset_count does not.
+ */
+struct shardset_shard;
+
+struct shardset {
+	size_t width;
+	size_t (*hash) (const void *, void *);
+	void *context;
+
+	struct shardset_shard *shards;
+	size_t nshard;		// a power of two
+	unsigned shift;		// of the mixed hash, to get the shard
+};
+
+// create, destroy
+int shardset_init(struct shardset *s, size_t nshard, size_t width,
+		  size_t (*hash) (const void *, void *),
+		  int (*compar) (const void *, const void *, void *),
+		  void *context);
+void shardset_destroy(struct shardset *s);
+
+// properties
+static inline size_t shardset_width(const struct shardset *s);
+size_t shardset_count(const struct shardset *s);
+int shardset_ensure_capacity(struct shardset *s, size_t n);
+const struct hashset *shardset_shard_set(const struct shardset *s, size_t i);
+
+// methods; dst, if non-NULL, gets a copy of the element found
+int shardset_lookup(const struct shardset *s, const void *key, void *dst);
+int shardset_contains(const struct shardset *s, const void *key);
+int shardset_set_item(struct shardset *s, const void *val);
+int shardset_insert(struct shardset *s, const void *val, int *added);
+int shardset_remove(struct shardset *s, const void *key, void *dst);
+int shardset_clear(struct shardset *s);
+
+// whole-set operations, on a consistent snapshot
+size_t shardset_copy_to(const struct shardset *s, void *dst);
+int shardset_foreach(const struct shardset *s,
+		     int (*fn) (const void *val, void *context),
+		     void *context);
+
+// static method definitions
+size_t shardset_width(const struct shardset *s)
+{
+	return s->width;
+}
+
+#endif // SHARDSET_H
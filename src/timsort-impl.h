@@ -35,7 +35,8 @@ static int NAME(mergeLo) (struct timsort * ts, void *base1, size_t len1,
 static int NAME(mergeHi) (struct timsort * ts, void *base1, size_t len1,
 			  void *base2, size_t len2, size_t width);
 
-static int NAME(timsort) (void *a, size_t nel, size_t width, CMPPARAMS(c, carg))
+static int NAME(timsort) (void *a, size_t nel, size_t width, CMPPARAMS(c, carg),
+			  const struct allocator *alloc)
 {
 	int err = SUCCESS;
 	struct timsort ts;
@@ -60,7 +61,7 @@ static int NAME(timsort) (void *a, size_t nel, size_t width, CMPPARAMS(c, carg))
          * extending short natural runs to minRun elements, and merging runs
          * to maintain stack invariant.
          */
-	if ((err = timsort_init(&ts, a, nel, CMPARGS(c, carg), width)))
+	if ((err = timsort_init(&ts, a, nel, CMPARGS(c, carg), width, alloc)))
 		return err;
 
 	minRun = minRunLength(nel);
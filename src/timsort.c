@@ -21,8 +21,8 @@
 # include <malloc.h>		// _alloca
 #endif
 #include <stddef.h>		// size_t, NULL
-#include <stdlib.h>		// malloc, free
 #include <string.h>		// memcpy, memmove
+#include "allocator.h"
 #include "timsort.h"
 
 /**
@@ -103,6 +103,7 @@ typedef int (*comparator) (const void *x, const void *y, void *thunk);
 #define CMPARGS(compar, thunk) (compar), (thunk)
 #define CMP(compar, thunk, x, y) (compar((x), (y), (thunk)))
 #define TIMSORT timsort_r
+#define TIMSORT_ALLOC timsort_r_alloc
 
 #else
 
@@ -111,6 +112,7 @@ typedef int (*comparator) (const void *x, const void *y);
 #define CMPARGS(compar, thunk) (compar)
 #define CMP(compar, thunk, x, y) (compar((x), (y)))
 #define TIMSORT timsort
+#define TIMSORT_ALLOC timsort_alloc
 
 #endif /* IS_TIMSORT_R */
 
@@ -134,6 +136,11 @@ struct timsort {
 	void *carg;
 #endif
 
+	/**
+	 * The allocator for the temp storage (NULL for the C library).
+	 */
+	const struct allocator *alloc;
+
 	/**
 	 * This controls when we get *into* galloping mode.  It is initialized
 	 * to MIN_GALLOP.  The mergeLo and mergeHi methods nudge it higher for
@@ -168,7 +175,7 @@ struct timsort {
 
 static int timsort_init(struct timsort *ts, void *a, size_t len,
 			CMPPARAMS(c, carg),
-			size_t width);
+			size_t width, const struct allocator *alloc);
 static void timsort_deinit(struct timsort *ts);
 static size_t minRunLength(size_t n);
 static void pushRun(struct timsort *ts, void *runBase, size_t runLen);
@@ -182,10 +189,11 @@ static void *ensureCapacity(struct timsort *ts, size_t minCapacity,
  * @param nel the length of the array
  * @param c the comparator to determine the order of the sort
  * @param width the element width
+ * @param alloc the allocator for temp storage
  */
 static int timsort_init(struct timsort *ts, void *a, size_t len,
 			CMPPARAMS(c, carg),
-			size_t width)
+			size_t width, const struct allocator *alloc)
 {
 	int err = 0;
 
@@ -202,11 +210,12 @@ static int timsort_init(struct timsort *ts, void *a, size_t len,
 #ifdef IS_TIMSORT_R
 	ts->carg = carg;
 #endif
+	ts->alloc = alloc;
 
 	// Allocate temp storage (which may be increased later if necessary)
 	ts->tmp_length = (len < 2 * INITIAL_TMP_STORAGE_LENGTH ?
 			  len >> 1 : INITIAL_TMP_STORAGE_LENGTH);
-	ts->tmp = malloc(ts->tmp_length * width);
+	ts->tmp = allocator_malloc(alloc, ts->tmp_length * width);
 	err |= ts->tmp == NULL;
 
 	/*
@@ -282,7 +291,7 @@ static int timsort_init(struct timsort *ts, void *a, size_t len,
 	 */
 	//stackLen = (len < 120 ? 5 : len < 1542 ? 10 : len < 119151 ? 19 : 40);
 
-	ts->run = malloc(ts->stackLen * sizeof(ts->run[0]));
+	ts->run = allocator_malloc(alloc, ts->stackLen * sizeof(ts->run[0]));
 	err |= ts->run == NULL;
 #else
 	ts->stackLen = MAX_STACK;
@@ -298,9 +307,9 @@ static int timsort_init(struct timsort *ts, void *a, size_t len,
 
 static void timsort_deinit(struct timsort *ts)
 {
-	free(ts->tmp);
+	allocator_free(ts->alloc, ts->tmp);
 #ifdef MALLOC_STACK
-	free(ts->run);
+	allocator_free(ts->alloc, ts->run);
 #endif
 }
 
@@ -374,9 +383,9 @@ static void *ensureCapacity(struct timsort *ts, size_t minCapacity,
 			newSize = minCapacity;
 		}
 
-		free(ts->tmp);
+		allocator_free(ts->alloc, ts->tmp);
 		ts->tmp_length = newSize;
-		ts->tmp = malloc(ts->tmp_length * width);
+		ts->tmp = allocator_malloc(ts->alloc, ts->tmp_length * width);
 	}
 
 	return ts->tmp;
@@ -400,15 +409,21 @@ static void *ensureCapacity(struct timsort *ts, size_t minCapacity,
 
 
 int TIMSORT(void *a, size_t nel, size_t width, CMPPARAMS(c, carg))
+{
+	return TIMSORT_ALLOC(a, nel, width, CMPARGS(c, carg), NULL);
+}
+
+int TIMSORT_ALLOC(void *a, size_t nel, size_t width, CMPPARAMS(c, carg),
+		  const struct allocator *alloc)
 {
 	switch (width) {
 	case 4:
-		return timsort_4(a, nel, width, CMPARGS(c, carg));
+		return timsort_4(a, nel, width, CMPARGS(c, carg), alloc);
 	case 8:
-		return timsort_8(a, nel, width, CMPARGS(c, carg));
+		return timsort_8(a, nel, width, CMPARGS(c, carg), alloc);
 	case 16:
-		return timsort_16(a, nel, width, CMPARGS(c, carg));
+		return timsort_16(a, nel, width, CMPARGS(c, carg), alloc);
 	default:
-		return timsort_width(a, nel, width, CMPARGS(c, carg));
+		return timsort_width(a, nel, width, CMPARGS(c, carg), alloc);
 	}
 }
@@ -62,4 +62,18 @@ int timsort_r(void *base, size_t nel, size_t width,
                 int (*compar) (const void *, const void *, void *),
 		void *context);
 
+/**
+ * Variants that get their temporary storage from an allocator (see
+ * allocator.h) rather than from malloc.  A NULL allocator means malloc.
+ */
+struct allocator;
+
+int timsort_alloc(void *base, size_t nel, size_t width,
+		  int (*compar) (const void *, const void *),
+		  const struct allocator *alloc);
+
+int timsort_r_alloc(void *base, size_t nel, size_t width,
+		    int (*compar) (const void *, const void *, void *),
+		    void *context, const struct allocator *alloc);
+
 #endif /* CORE_TIMSORT_H */
@@ -0,0 +1,49 @@
+#ifndef COUNTING_ALLOC_H
+#define COUNTING_ALLOC_H
+
+/* An allocator that counts its live blocks in nblock, for checking that a
+ * container allocates through the hooks it was given and frees everything
+ * it allocated.  Include after cmockery.h and allocator.h.
+ */
+
+static size_t nblock;
+
+static void *counting_malloc(size_t size, void *context)
+{
+	void *ptr = malloc(size);
+	if (ptr)
+		(*(size_t *)context)++;
+	return ptr;
+}
+
+static void *counting_calloc(size_t nmemb, size_t size, void *context)
+{
+	void *ptr = calloc(nmemb, size);
+	if (ptr)
+		(*(size_t *)context)++;
+	return ptr;
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *context)
+{
+	(void)ptr;
+	(void)size;
+	(void)context;
+	fail();		// the hash containers never reallocate
+	return NULL;
+}
+
+static void counting_free(void *ptr, void *context)
+{
+	if (ptr) {
+		(*(size_t *)context)--;
+		free(ptr);
+	}
+}
+
+static const struct allocator counting_allocator = {
+	counting_malloc, counting_calloc, counting_realloc, counting_free,
+	&nblock
+};
+
+#endif // COUNTING_ALLOC_H
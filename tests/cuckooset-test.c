@@ -0,0 +1,403 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "cuckooset.h"
+
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static size_t int_mix_hash(const void *x, void *context)
+{
+	(void)context;
+	return (size_t)*(int *)x * 2654435761U;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+static size_t int_bad_hash(const void *x, void *context)
+{
+	(void)context;
+	(void)x;
+	return 1337;
+}
+
+static struct cuckooset set;
+static int *vals;
+static size_t count;
+
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void fill(size_t (*hash) (const void *, void *), size_t n)
+{
+	size_t i;
+
+	cuckooset_init(&set, sizeof(int), hash, int_compar, NULL);
+
+	count = n;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		cuckooset_set_item(&set, &vals[i]);
+	}
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty cuckooset\n");
+	print_message("---------------\n");
+}
+
+static void empty_setup()
+{
+	fill(int_hash, 0);
+}
+
+static void teardown()
+{
+	free(vals);
+	cuckooset_destroy(&set);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big cuckooset\n");
+	print_message("-------------\n");
+}
+
+static void big_setup()
+{
+	fill(int_mix_hash, 555);
+}
+
+static void bad_setup_fixture()
+{
+	print_message("small cuckooset (bad hash)\n");
+	print_message("--------------------------\n");
+}
+
+static void bad_setup()
+{
+	fill(int_bad_hash, CUCKOOSET_SLOTS);
+}
+
+static void test_count()
+{
+	assert_int_equal(cuckooset_count(&set), count);
+}
+
+static void test_clear()
+{
+	cuckooset_clear(&set);
+	assert_int_equal(cuckooset_count(&set), 0);
+	if (count) {
+		assert_false(cuckooset_contains(&set, &vals[0]));
+	}
+}
+
+static void test_lookup()
+{
+	size_t i;
+	const int *val;
+
+	for (i = 0; i < count; i++) {
+		assert_true(cuckooset_contains(&set, &vals[i]));
+		val = cuckooset_item(&set, &vals[i]);
+		assert_true(val);
+		assert_int_equal(*val, vals[i]);
+	}
+}
+
+static void test_add()
+{
+	int val = 31337;
+
+	cuckooset_set_item(&set, &val);
+	assert_int_equal(cuckooset_count(&set), count + 1);
+	assert_true(cuckooset_contains(&set, &val));
+	assert_int_equal(*(int *)cuckooset_item(&set, &val), val);
+	test_lookup();
+}
+
+static void test_add_existing()
+{
+	int val = 88888;
+
+	cuckooset_set_item(&set, &val);
+	cuckooset_set_item(&set, &val);
+	assert_int_equal(cuckooset_count(&set), count + 1);
+	assert_true(cuckooset_contains(&set, &val));
+}
+
+static void test_remove()
+{
+	int val = -1;
+
+	cuckooset_set_item(&set, &val);
+	assert_true(cuckooset_remove(&set, &val));
+	assert_false(cuckooset_remove(&set, &val));
+	assert_int_equal(cuckooset_count(&set), count);
+	assert_false(cuckooset_contains(&set, &val));
+	test_lookup();
+}
+
+static void test_remove_hard()
+{
+	size_t i, j;
+
+	for (i = 0; i < count; i++) {
+		cuckooset_remove(&set, &vals[i]);
+		assert_int_equal(cuckooset_count(&set), count - i - 1);
+		for (j = 0; j <= i; j++) {
+			assert_false(cuckooset_contains(&set, &vals[j]));
+		}
+		for (; j < count; j++) {
+			assert_true(cuckooset_contains(&set, &vals[j]));
+		}
+	}
+	assert_int_equal(cuckooset_count(&set), 0);
+}
+
+static void test_iter()
+{
+	struct cuckooset_iter it;
+	size_t n = 0;
+
+	CUCKOOSET_FOREACH(it, &set) {
+		assert_true(cuckooset_contains(&set, CUCKOOSET_VAL(it)));
+		n++;
+	}
+	assert_int_equal(n, count);
+}
+
+static void test_copy()
+{
+	struct cuckooset copy;
+	size_t i;
+
+	cuckooset_init_copy(&copy, &set);
+	assert_int_equal(cuckooset_count(&copy), count);
+	for (i = 0; i < count; i++) {
+		assert_true(cuckooset_contains(&copy, &vals[i]));
+	}
+	cuckooset_destroy(&copy);
+}
+
+static void test_copy_to()
+{
+	int *buf = malloc((count + 1) * sizeof(*buf));
+	struct cuckooset_iter it;
+	size_t i, n;
+
+	for (i = 0; i < count; i += 3) {
+		cuckooset_remove(&set, &vals[i]);
+	}
+	n = cuckooset_copy_to(&set, buf);
+	assert_int_equal(n, cuckooset_count(&set));
+
+	i = 0;
+	CUCKOOSET_FOREACH(it, &set) {
+		assert_int_equal(buf[i], *(int *)CUCKOOSET_VAL(it));
+		i++;
+	}
+	assert_int_equal(i, n);
+	free(buf);
+}
+
+/* no bucket of a table, or of its copy, straddles a cache line */
+static void test_layout()
+{
+	struct cuckooset copy;
+	const struct cuckooset *t;
+
+	cuckooset_init_copy(&copy, &set);
+	for (t = &set; t; t = t == &set ? &copy : NULL) {
+		assert_int_equal(64 % t->stride, 0);
+		assert_int_equal((uintptr_t)t->buckets % 64, 0);
+	}
+	cuckooset_destroy(&copy);
+}
+
+static void test_trim_excess()
+{
+	size_t i;
+
+	for (i = 0; i < count; i += 2) {
+		cuckooset_remove(&set, &vals[i]);
+	}
+	cuckooset_trim_excess(&set);
+	assert_true(cuckooset_capacity(&set) >= cuckooset_count(&set));
+
+	for (i = 0; i < count; i++) {
+		assert_int_equal(cuckooset_contains(&set, &vals[i]), i % 2);
+	}
+}
+
+static void test_pos()
+{
+	struct cuckooset_pos pos;
+	int val = 4242;
+	int *item;
+
+	assert_false(cuckooset_find(&set, &val, &pos));
+	assert_int_equal(cuckooset_insert(&set, &pos, &val), 0);
+	assert_int_equal(cuckooset_count(&set), count + 1);
+
+	item = cuckooset_find(&set, &val, &pos);
+	assert_true(item);
+	assert_int_equal(*item, val);
+
+	cuckooset_remove_at(&set, &pos);
+	assert_int_equal(cuckooset_count(&set), count);
+	assert_false(cuckooset_contains(&set, &val));
+	test_lookup();
+}
+
+static void test_fill()
+{
+	size_t nbucket;
+	int lo, hi, val;
+
+	// the table fills to capacity without growing
+	cuckooset_ensure_capacity(&set, count + 1000);
+	nbucket = set.nbucket;
+
+	lo = hi = 1000000;
+	while (cuckooset_count(&set) < cuckooset_capacity(&set)) {
+		assert_int_equal(cuckooset_set_item(&set, &hi), 0);
+		hi++;
+	}
+	assert_int_equal(set.nbucket, nbucket);
+
+	for (val = lo; val < hi; val++) {
+		assert_true(cuckooset_contains(&set, &val));
+	}
+	test_lookup();
+}
+
+static void test_churn()
+{
+	size_t i, nbucket;
+	int lo, hi, val;
+
+	cuckooset_ensure_capacity(&set, 1000);
+	nbucket = set.nbucket;
+
+	// fill to capacity, then slide a window of keys [lo, hi)
+	lo = hi = 1000000;
+	while (cuckooset_count(&set) < cuckooset_capacity(&set)) {
+		cuckooset_set_item(&set, &hi);
+		hi++;
+	}
+	for (i = 0; i < 10 * nbucket; i++) {
+		cuckooset_remove(&set, &lo);
+		lo++;
+		cuckooset_set_item(&set, &hi);
+		hi++;
+	}
+
+	// removal leaves no tombstones, so the table never needs to grow
+	assert_int_equal(set.nbucket, nbucket);
+	for (val = lo - 100; val < lo; val++) {
+		assert_false(cuckooset_contains(&set, &val));
+	}
+	for (val = lo; val < hi; val++) {
+		assert_true(cuckooset_contains(&set, &val));
+	}
+	test_lookup();
+}
+
+static void test_bad_hash()
+{
+	size_t n = cuckooset_count(&set);
+	int val = 1000000;
+	int err;
+
+	// equal hashes share two buckets; past those, insertion fails
+	while (!(err = cuckooset_set_item(&set, &val))) {
+		n++;
+		val++;
+	}
+	assert_int_equal(err, ERANGE);
+	assert_true(n <= 2 * CUCKOOSET_SLOTS);
+	assert_int_equal(cuckooset_count(&set), n);
+	assert_false(cuckooset_contains(&set, &val));
+	for (val--; val >= 1000000; val--) {
+		assert_true(cuckooset_contains(&set, &val));
+	}
+	test_lookup();
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_clear, empty_setup, teardown),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_add, empty_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_iter, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, empty_setup, teardown),
+		unit_test_setup_teardown(test_layout, empty_setup, teardown),
+		unit_test_setup_teardown(test_trim_excess, empty_setup, teardown),
+		unit_test_setup_teardown(test_pos, empty_setup, teardown),
+		unit_test_setup_teardown(test_fill, empty_setup, teardown),
+		unit_test_setup_teardown(test_churn, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_add, big_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_remove_hard, big_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, big_setup, teardown),
+		unit_test_setup_teardown(test_layout, big_setup, teardown),
+		unit_test_setup_teardown(test_trim_excess, big_setup, teardown),
+		unit_test_setup_teardown(test_pos, big_setup, teardown),
+		unit_test_setup_teardown(test_fill, big_setup, teardown),
+		unit_test_setup_teardown(test_churn, big_setup, teardown),
+		unit_test_teardown(big_suite, teardown_fixture),
+
+		unit_test_setup(bad_suite, bad_setup_fixture),
+		unit_test_setup_teardown(test_count, bad_setup, teardown),
+		unit_test_setup_teardown(test_clear, bad_setup, teardown),
+		unit_test_setup_teardown(test_lookup, bad_setup, teardown),
+		unit_test_setup_teardown(test_add, bad_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, bad_setup, teardown),
+		unit_test_setup_teardown(test_remove, bad_setup, teardown),
+		unit_test_setup_teardown(test_remove_hard, bad_setup, teardown),
+		unit_test_setup_teardown(test_iter, bad_setup, teardown),
+		unit_test_setup_teardown(test_copy, bad_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, bad_setup, teardown),
+		unit_test_setup_teardown(test_trim_excess, bad_setup, teardown),
+		unit_test_setup_teardown(test_pos, bad_setup, teardown),
+		unit_test_setup_teardown(test_bad_hash, bad_setup, teardown),
+		unit_test_teardown(bad_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
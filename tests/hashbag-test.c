@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "allocator.h"
+#include "hashbag.h"
+#include "counting-alloc.h"
+
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+static struct hashbag bag;
+static int nkey;
+
+/* key k goes in k % 7 + 1 times */
+static size_t want_count(int key)
+{
+	return key >= 0 && key < nkey ? (size_t)(key % 7 + 1) : 0;
+}
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void setup(int n)
+{
+	int key, i;
+
+	hashbag_init(&bag, sizeof(int), int_hash, int_compar, NULL);
+
+	nkey = n;
+	for (i = 0; i < 7; i++) {
+		for (key = 0; key < nkey; key++) {
+			if (i < key % 7 + 1) {
+				hashbag_add(&bag, &key, 1);
+			}
+		}
+	}
+}
+
+static void teardown()
+{
+	hashbag_destroy(&bag);
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty hashbag\n");
+	print_message("-------------\n");
+}
+
+static void empty_setup()
+{
+	setup(0);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big hashbag\n");
+	print_message("-----------\n");
+}
+
+static void big_setup()
+{
+	setup(555);
+}
+
+static size_t want_total(void)
+{
+	size_t total = 0;
+	int key;
+
+	for (key = 0; key < nkey; key++) {
+		total += want_count(key);
+	}
+	return total;
+}
+
+static void test_count()
+{
+	int key;
+
+	assert_int_equal(hashbag_distinct(&bag), (size_t)nkey);
+	assert_int_equal(hashbag_total(&bag), want_total());
+	for (key = -10; key < nkey + 10; key++) {
+		assert_int_equal(hashbag_count(&bag, &key), want_count(key));
+	}
+}
+
+static void test_add()
+{
+	int key;
+
+	for (key = 0; key < nkey + 10; key++) {
+		assert_int_equal(hashbag_add(&bag, &key, 100), 0);
+	}
+	assert_int_equal(hashbag_add(&bag, &key, 0), 0);
+	assert_int_equal(hashbag_count(&bag, &key), 0);
+
+	assert_int_equal(hashbag_distinct(&bag), (size_t)nkey + 10);
+	assert_int_equal(hashbag_total(&bag),
+			 want_total() + 100 * ((size_t)nkey + 10));
+	for (key = 0; key < nkey + 10; key++) {
+		assert_int_equal(hashbag_count(&bag, &key),
+				 want_count(key) + 100);
+	}
+}
+
+static void test_add_overflow()
+{
+	size_t total = hashbag_total(&bag);
+	int key = -1;
+
+	assert_int_equal(hashbag_add(&bag, &key, SIZE_MAX - total), 0);
+	assert_int_equal(hashbag_add(&bag, &key, 1), ERANGE);
+	assert_int_equal(hashbag_count(&bag, &key), SIZE_MAX - total);
+	assert_int_equal(hashbag_total(&bag), SIZE_MAX);
+}
+
+static void test_remove()
+{
+	size_t nleft = 0;
+	int key;
+
+	for (key = -10; key < nkey; key++) {
+		assert_int_equal(hashbag_remove(&bag, &key, 3),
+				 want_count(key) < 3 ? want_count(key) : 3);
+	}
+	for (key = 0; key < nkey; key++) {
+		assert_int_equal(hashbag_count(&bag, &key),
+				 want_count(key) < 3 ? 0 : want_count(key) - 3);
+		nleft += want_count(key) > 3;
+	}
+	assert_int_equal(hashbag_distinct(&bag), nleft);
+
+	for (key = 0; key < nkey; key++) {
+		hashbag_remove(&bag, &key, SIZE_MAX);
+	}
+	assert_int_equal(hashbag_distinct(&bag), 0);
+	assert_int_equal(hashbag_total(&bag), 0);
+}
+
+static void test_iter()
+{
+	struct hashbag_iter it;
+	size_t n = 0, total = 0;
+	int key;
+
+	HASHBAG_FOREACH(it, &bag) {
+		key = *(int *)HASHBAG_KEY(it);
+		assert_int_equal(HASHBAG_COUNT(it), want_count(key));
+		total += HASHBAG_COUNT(it);
+		n++;
+	}
+	assert_int_equal(n, (size_t)nkey);
+	assert_int_equal(total, hashbag_total(&bag));
+}
+
+static void test_clear()
+{
+	int key = 0;
+
+	hashbag_clear(&bag);
+	assert_int_equal(hashbag_distinct(&bag), 0);
+	assert_int_equal(hashbag_total(&bag), 0);
+	assert_int_equal(hashbag_count(&bag, &key), 0);
+
+	// removed keys don't leave their old counts behind
+	assert_int_equal(hashbag_add(&bag, &key, 2), 0);
+	assert_int_equal(hashbag_count(&bag, &key), 2);
+}
+
+static void test_copy()
+{
+	struct hashbag copy;
+
+	hashbag_init_copy(&copy, &bag);
+	hashbag_destroy(&bag);
+	bag = copy;
+	test_count();
+}
+
+static void test_alloc()
+{
+	struct hashbag b, copy;
+	int key;
+
+	nblock = 0;
+	assert_int_equal(hashbag_init_alloc(&b, sizeof(int), int_hash,
+					    int_compar, NULL,
+					    &counting_allocator), 0);
+	assert_true(nblock > 0);	// the scratch record
+	for (key = 0; key < 555; key++) {
+		hashbag_add(&b, &key, (size_t)key + 1);
+	}
+
+	hashbag_init_copy(&copy, &b);
+	hashbag_assign_copy(&b, &copy);
+	hashbag_destroy(&copy);
+	for (key = 0; key < 555; key++) {
+		assert_int_equal(hashbag_count(&b, &key), (size_t)key + 1);
+	}
+	hashbag_destroy(&b);
+	assert_int_equal(nblock, 0);
+}
+
+/* 3-byte keys, so the count sits after some padding */
+static size_t str3_hash(const void *x, void *context)
+{
+	const unsigned char *s = x;
+	(void)context;
+	return s[0] | s[1] << 8 | s[2] << 16;
+}
+
+static int str3_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return memcmp(x, y, 3);
+}
+
+static void test_odd_width()
+{
+	static const char words[][3] = {
+		"the", "cat", "sat", "the", "mat", "the", "cat"
+	};
+	struct hashbag b;
+	struct hashbag_iter it;
+	size_t i, n = 0;
+
+	hashbag_init(&b, 3, str3_hash, str3_compar, NULL);
+	for (i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+		assert_int_equal(hashbag_add(&b, words[i], 1), 0);
+	}
+
+	assert_int_equal(hashbag_distinct(&b), 4);
+	assert_int_equal(hashbag_total(&b), 7);
+	assert_int_equal(hashbag_count(&b, "the"), 3);
+	assert_int_equal(hashbag_count(&b, "cat"), 2);
+	assert_int_equal(hashbag_count(&b, "sat"), 1);
+	assert_int_equal(hashbag_count(&b, "dog"), 0);
+	HASHBAG_FOREACH(it, &b) {
+		assert_int_equal(HASHBAG_COUNT(it),
+				 hashbag_count(&b, HASHBAG_KEY(it)));
+		n++;
+	}
+	assert_int_equal(n, 4);
+	hashbag_destroy(&b);
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_add, empty_setup, teardown),
+		unit_test_setup_teardown(test_add_overflow, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_iter, empty_setup, teardown),
+		unit_test_setup_teardown(test_clear, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_add, big_setup, teardown),
+		unit_test_setup_teardown(test_add_overflow, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_setup, teardown),
+		unit_test(test_alloc),
+		unit_test(test_odd_width),
+		unit_test_teardown(big_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
@@ -0,0 +1,253 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "allocator.h"
+#include "hashmap.h"
+#include "counting-alloc.h"
+
+
+struct record {
+	int key;
+	int data[29];
+};
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+static struct hashmap map;
+static size_t count;
+
+
+static struct record make_record(int key, int salt)
+{
+	struct record r;
+	int i;
+
+	r.key = key;
+	for (i = 0; i < 29; i++) {
+		r.data[i] = key * 31 + i + salt;
+	}
+	return r;
+}
+
+static void check_record(int key, int salt)
+{
+	struct record *r = hashmap_item(&map, &key);
+	struct record want = make_record(key, salt);
+	int i;
+
+	assert_true(r);
+	assert_int_equal(r->key, key);
+	for (i = 0; i < 29; i++) {
+		assert_int_equal(r->data[i], want.data[i]);
+	}
+}
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void setup(size_t n)
+{
+	struct record r;
+	int key;
+
+	hashmap_init(&map, sizeof(int), sizeof(struct record), int_hash,
+		     int_compar, NULL);
+
+	count = n;
+	for (key = 0; key < (int)count; key++) {
+		r = make_record(key, 0);
+		hashmap_set_item(&map, &key, &r);
+	}
+}
+
+static void teardown()
+{
+	hashmap_destroy(&map);
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty hashmap\n");
+	print_message("-------------\n");
+}
+
+static void empty_setup()
+{
+	setup(0);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big hashmap\n");
+	print_message("-----------\n");
+}
+
+static void big_setup()
+{
+	setup(555);
+}
+
+static void test_lookup()
+{
+	int key;
+
+	assert_int_equal(hashmap_count(&map), count);
+	for (key = 0; key < (int)count; key++) {
+		assert_true(hashmap_contains(&map, &key));
+		check_record(key, 0);
+	}
+	key = -1;
+	assert_false(hashmap_item(&map, &key));
+}
+
+static void test_replace()
+{
+	struct record r;
+	int key;
+
+	for (key = 0; key < (int)count; key += 2) {
+		r = make_record(key, 1);
+		hashmap_set_item(&map, &key, &r);
+	}
+	assert_int_equal(hashmap_count(&map), count);
+	for (key = 0; key < (int)count; key++) {
+		check_record(key, key % 2 ? 0 : 1);
+	}
+}
+
+static void test_remove()
+{
+	int key;
+
+	for (key = 0; key < (int)count; key += 2) {
+		assert_true(hashmap_remove(&map, &key));
+	}
+	for (key = 0; key < (int)count; key++) {
+		if (key % 2) {
+			check_record(key, 0);
+		} else {
+			assert_false(hashmap_contains(&map, &key));
+		}
+	}
+}
+
+static void test_iter()
+{
+	struct hashmap_iter it;
+	size_t n = 0;
+	int key;
+
+	HASHMAP_FOREACH(it, &map) {
+		key = *(int *)HASHMAP_KEY(it);
+		assert_int_equal(((struct record *)HASHMAP_VAL(it))->key, key);
+		n++;
+	}
+	assert_int_equal(n, count);
+}
+
+static void test_churn()
+{
+	struct record r;
+	size_t i;
+	int lo, hi, key;
+
+	// slide a window of keys, so that the table purges its tombstones
+	lo = hi = 1000000;
+	while (hashmap_count(&map) < hashmap_capacity(&map)
+	       || hashmap_count(&map) < 100) {
+		r = make_record(hi, 2);
+		hashmap_set_item(&map, &hi, &r);
+		hi++;
+	}
+	for (i = 0; i < 20 * map.set.nbucket; i++) {
+		r = make_record(hi, 2);
+		hashmap_set_item(&map, &hi, &r);
+		hi++;
+		hashmap_remove(&map, &lo);
+		lo++;
+	}
+
+	for (key = lo; key < hi; key++) {
+		check_record(key, 2);
+	}
+	for (key = 0; key < (int)count; key++) {
+		check_record(key, 0);
+	}
+}
+
+static void test_copy()
+{
+	struct hashmap copy;
+
+	hashmap_init_copy(&copy, &map);
+	hashmap_destroy(&map);
+	map = copy;
+	test_lookup();
+}
+
+static void test_alloc()
+{
+	struct hashmap m, copy;
+	struct record r;
+	int key;
+
+	nblock = 0;
+	assert_int_equal(hashmap_init_alloc(&m, sizeof(int),
+					    sizeof(struct record), int_hash,
+					    int_compar, NULL,
+					    &counting_allocator), 0);
+	for (key = 0; key < 555; key++) {
+		r = make_record(key, 0);
+		hashmap_set_item(&m, &key, &r);
+	}
+	assert_true(nblock > 0);
+
+	hashmap_init_copy(&copy, &m);
+	hashmap_destroy(&m);
+	map = copy;
+	count = 555;
+	test_lookup();
+	hashmap_destroy(&map);
+	assert_int_equal(nblock, 0);
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_replace, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_iter, empty_setup, teardown),
+		unit_test_setup_teardown(test_churn, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_replace, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_setup, teardown),
+		unit_test_setup_teardown(test_churn, big_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_setup, teardown),
+		unit_test(test_alloc),
+		unit_test_teardown(big_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
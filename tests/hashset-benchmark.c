@@ -29,10 +29,19 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/resource.h>
+#include "cuckooset.h"
+#include "hashbag.h"
+#include "hashmap.h"
 #include "hashset.h"
+#include "intern.h"
+#include "ohashset.h"
+#include "rhset.h"
+#include "rmset.h"
 
 #define DEFAULT_ITERS 10000000
 
@@ -57,6 +66,33 @@ static int pair_kcompar(const void *x1, const void *x2, void *context)
 	return key1 - key2;
 }
 
+#define HASHSET_NAME pair_hashset
+#define HASHSET_TYPE struct pair
+#define HASHSET_HASH(x) ((size_t)(x).key)
+#define HASHSET_EQUAL(x, y) ((x).key == (y).key)
+#include "hashset-impl.h"
+#undef HASHSET_EQUAL
+#undef HASHSET_HASH
+#undef HASHSET_TYPE
+#undef HASHSET_NAME
+
+struct wide {
+	int key;
+	int data[31];
+};
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(const int *)x;
+}
+
+static int int_compar(const void *x1, const void *x2, void *context)
+{
+	(void)context;
+	return *(const int *)x1 - *(const int *)x2;
+}
+
 static void report(char const* title, int iters,
 		   const struct rusage *start, const struct rusage *finish)
 {
@@ -90,6 +126,50 @@ static void time_map_grow(int iters)
 	hashset_destroy(&set);
 }
 
+static void time_map_grow_incremental(int iters)
+{
+	struct hashset set;
+	struct rusage start, finish;
+	struct pair pair;
+
+	hashset_init_flags(&set, sizeof(struct pair), pair_khash, pair_kcompar,
+			   NULL, HASHSET_INCREMENTAL);
+	getrusage(RUSAGE_SELF, &start);
+
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		hashset_set_item(&set, &pair);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+
+	report("map_grow_incremental", iters, &start, &finish);
+	hashset_destroy(&set);
+}
+
+static void time_map_assign_array(int iters)
+{
+	struct hashset set;
+	struct rusage start, finish;
+	struct pair *pairs = malloc(iters * sizeof(pairs[0]));
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		pairs[i].key = i;
+		pairs[i].val = i + 1;
+	}
+
+	hashset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	getrusage(RUSAGE_SELF, &start);
+
+	hashset_assign_array(&set, pairs, iters);
+
+	getrusage(RUSAGE_SELF, &finish);
+	report("map_assign_array", iters, &start, &finish);
+	hashset_destroy(&set);
+	free(pairs);
+}
+
 static void time_map_grow_predicted(int iters)
 {
 	struct hashset set;
@@ -207,6 +287,318 @@ static void time_map_fetch_random(int iters)
 	free(v);
 }
 
+static void time_map_grow_specialized(int iters)
+{
+	struct pair_hashset set;
+	struct rusage start, finish;
+	struct pair pair;
+
+	pair_hashset_init(&set);
+	getrusage(RUSAGE_SELF, &start);
+
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		pair_hashset_set_item(&set, &pair);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	report("map_grow_specialized", iters, &start, &finish);
+	pair_hashset_destroy(&set);
+}
+
+static void time_map_fetch_random_specialized(int iters)
+{
+	struct pair_hashset set;
+	struct rusage start, finish;
+	struct pair pair;
+	int *v = malloc(iters * sizeof(v[0]));
+	int r, i;
+
+	pair_hashset_init(&set);
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		pair_hashset_set_item(&set, &pair);
+		v[pair.key] = pair.key;
+	}
+	shuffle(v, iters);
+
+	r = 1;
+
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		pair.key = v[i];
+		r ^= (int)(pair_hashset_item(&set, &pair) != NULL);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand(r);   // keep compiler from optimizing away r
+	report("map_fetch_random_specialized", iters, &start, &finish);
+	pair_hashset_destroy(&set);
+	free(v);
+}
+
+static void time_rhset_fetch_random(int iters)
+{
+	struct rhset set;
+	struct rusage start, finish;
+	struct pair pair;
+	int *v = malloc(iters * sizeof(v[0]));
+	int r, i;
+
+	rhset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		rhset_set_item(&set, &pair);
+		v[pair.key] = pair.key;
+	}
+	shuffle(v, iters);
+
+	r = 1;
+
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		r ^= (int)(rhset_item(&set, &v[i]) != NULL);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand(r);   // keep compiler from optimizing away r
+	report("rhset_fetch_random", iters, &start, &finish);
+	rhset_destroy(&set);
+	free(v);
+}
+
+static int rmset_fill(struct hashset *set, void *context)
+{
+	int iters = *(int *)context;
+	struct pair pair;
+	int err;
+
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		if ((err = hashset_set_item(set, &pair))) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+// the lock-free read path, one reader
+static void time_rmset_fetch_random(int iters)
+{
+	struct rmset set;
+	struct rmset_reader reader;
+	struct rusage start, finish;
+	int *v = malloc(iters * sizeof(v[0]));
+	int r, i;
+
+	rmset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	rmset_reader_add(&set, &reader);
+	rmset_update(&set, rmset_fill, &iters);
+	for (i = 0; i < iters; i++) {
+		v[i] = i;
+	}
+	shuffle(v, iters);
+
+	r = 1;
+
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		r ^= rmset_contains(&reader, &v[i]);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand(r);   // keep compiler from optimizing away r
+	report("rmset_fetch_random", iters, &start, &finish);
+	rmset_reader_remove(&reader);
+	rmset_destroy(&set);
+	free(v);
+}
+
+static void time_cuckooset_fetch_random(int iters)
+{
+	struct cuckooset set;
+	struct rusage start, finish;
+	struct pair pair;
+	int *v = malloc(iters * sizeof(v[0]));
+	int r, i;
+
+	cuckooset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		cuckooset_set_item(&set, &pair);
+		v[pair.key] = pair.key;
+	}
+	shuffle(v, iters);
+
+	r = 1;
+
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		r ^= (int)(cuckooset_item(&set, &v[i]) != NULL);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand(r);   // keep compiler from optimizing away r
+	report("cuckooset_fetch_random", iters, &start, &finish);
+	cuckooset_destroy(&set);
+	free(v);
+}
+
+// 128-byte records, stored whole in a hashset or split by a hashmap
+/* Keys for counting: each of iters / 8 keys about 8 times, shuffled */
+static int *count_keys(int iters)
+{
+	int *v = malloc(iters * sizeof(v[0]));
+	int nkey = iters / 8 + 1;
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		v[i] = i % nkey;
+	}
+	shuffle(v, iters);
+	return v;
+}
+
+/* Counting the way callers did before hashbag: a pair, find, then insert
+ * or bump */
+static void time_map_count(int iters)
+{
+	struct hashset set;
+	struct hashset_pos pos;
+	struct rusage start, finish;
+	struct pair pair, *item;
+	int *v = count_keys(iters);
+	int i;
+
+	hashset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		if ((item = hashset_find(&set, &v[i], &pos))) {
+			item->val++;
+		} else {
+			pair.key = v[i];
+			pair.val = 1;
+			hashset_insert(&set, &pos, &pair);
+		}
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	report("map_count", iters, &start, &finish);
+	hashset_destroy(&set);
+	free(v);
+}
+
+static void time_hashbag_count(int iters)
+{
+	struct hashbag bag;
+	struct rusage start, finish;
+	int *v = count_keys(iters);
+	int i;
+
+	hashbag_init(&bag, sizeof(int), int_hash, int_compar, NULL);
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		hashbag_add(&bag, &v[i], 1);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	report("hashbag_count", iters, &start, &finish);
+	hashbag_destroy(&bag);
+	free(v);
+}
+
+static void time_map_fetch_random_wide(int iters, int split)
+{
+	struct hashset set;
+	struct hashmap map;
+	struct rusage start, finish;
+	struct wide w;
+	int *v = malloc(iters * sizeof(v[0]));
+	int r, i;
+
+	memset(&w, 0, sizeof(w));
+	if (split) {
+		hashmap_init(&map, sizeof(int), sizeof(w), int_hash,
+			     int_compar, NULL);
+	} else {
+		hashset_init(&set, sizeof(w), int_hash, int_compar, NULL);
+	}
+	for (w.key = 0; w.key < iters; w.key++) {
+		if (split) {
+			hashmap_set_item(&map, &w.key, &w);
+		} else {
+			hashset_set_item(&set, &w);
+		}
+		v[w.key] = w.key;
+	}
+	shuffle(v, iters);
+
+	r = 1;
+
+	getrusage(RUSAGE_SELF, &start);
+
+	if (split) {
+		for (i = 0; i < iters; i++) {
+			r ^= (int)(hashmap_item(&map, &v[i]) != NULL);
+		}
+	} else {
+		for (i = 0; i < iters; i++) {
+			r ^= (int)(hashset_item(&set, &v[i]) != NULL);
+		}
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand(r);   // keep compiler from optimizing away r
+	if (split) {
+		report("hashmap_fetch_random_wide", iters, &start, &finish);
+		hashmap_destroy(&map);
+	} else {
+		report("map_fetch_random_wide", iters, &start, &finish);
+		hashset_destroy(&set);
+	}
+	free(v);
+}
+
+static void time_map_fetch_many_random(int iters)
+{
+	struct hashset set;
+	struct rusage start, finish;
+	struct pair pair;
+	int *v = malloc(iters * sizeof(v[0]));
+	int found[64];
+	int r, i, n;
+
+	hashset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		hashset_set_item(&set, &pair);
+		v[pair.key] = pair.key;
+	}
+	shuffle(v, iters);
+
+	r = 1;
+
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i += n) {
+		n = iters - i < 64 ? iters - i : 64;
+		hashset_contains_many(&set, &v[i], n, sizeof(v[0]), found);
+		r ^= found[n - 1];
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand(r);   // keep compiler from optimizing away r
+	report("map_fetch_many_random", iters, &start, &finish);
+	hashset_destroy(&set);
+	free(v);
+}
+
 static void time_map_fetch_empty(int iters) {
 	struct hashset set;
 	struct rusage start, finish;
@@ -253,6 +645,94 @@ static void time_map_remove(int iters)
 }
 
 
+static void time_map_iterate(int iters)
+{
+	struct hashset set;
+	struct hashset_iter it;
+	struct rusage start, finish;
+	struct pair pair;
+	long sum = 0;
+
+	// a sparse table, as right after a grow
+	hashset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar, NULL);
+	hashset_ensure_capacity(&set, 2 * (size_t)iters);
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		hashset_set_item(&set, &pair);
+	}
+
+	getrusage(RUSAGE_SELF, &start);
+
+	HASHSET_FOREACH(it, &set) {
+		sum += ((struct pair *)HASHSET_VAL(it))->val;
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	assert(sum == (long)iters * (iters + 1) / 2);
+	report("map_iterate", iters, &start, &finish);
+	hashset_destroy(&set);
+}
+
+static void time_ohashset_iterate(int iters)
+{
+	struct ohashset set;
+	struct ohashset_iter it;
+	struct rusage start, finish;
+	struct pair pair;
+	long sum = 0;
+
+	ohashset_init(&set, sizeof(struct pair), pair_khash, pair_kcompar,
+		      NULL);
+	ohashset_ensure_capacity(&set, 2 * (size_t)iters);
+	for (pair.key = 0; pair.key < iters; pair.key++) {
+		pair.val = pair.key + 1;
+		ohashset_set_item(&set, &pair);
+	}
+
+	getrusage(RUSAGE_SELF, &start);
+
+	OHASHSET_FOREACH(it, &set) {
+		sum += ((struct pair *)OHASHSET_VAL(it))->val;
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	assert(sum == (long)iters * (iters + 1) / 2);
+	report("ohashset_iterate", iters, &start, &finish);
+	ohashset_destroy(&set);
+}
+
+// a stream of tokens from a vocabulary a sixteenth its length
+static void time_intern(int iters)
+{
+	struct intern table;
+	struct rusage start, finish;
+	char (*tokens)[16] = malloc(iters * sizeof(tokens[0]));
+	size_t *lens = malloc(iters * sizeof(lens[0]));
+	size_t sum = 0;
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		lens[i] = (size_t)sprintf(tokens[i], "tok%d",
+					  (int)(((unsigned)i * 2654435761U)
+						% (unsigned)(iters / 16 + 1)));
+	}
+
+	intern_init(&table);
+
+	getrusage(RUSAGE_SELF, &start);
+
+	for (i = 0; i < iters; i++) {
+		sum += intern_id(&table, tokens[i], lens[i]);
+	}
+
+	getrusage(RUSAGE_SELF, &finish);
+	srand((unsigned)sum);	// keep compiler from optimizing away sum
+	report("intern", iters, &start, &finish);
+	intern_destroy(&table);
+	free(lens);
+	free(tokens);
+}
+
 static void time_map_toggle(int iters)
 {
 	struct hashset set;
@@ -298,13 +778,28 @@ int main(int argc, char** argv)
 	}
 
 	time_map_grow(iters);
+	time_map_grow_incremental(iters);
+	time_map_grow_specialized(iters);
 	time_map_grow_predicted(iters);
+	time_map_assign_array(iters);
 	time_map_replace(iters);
 	time_map_fetch_random(iters);
+	time_map_fetch_random_specialized(iters);
+	time_map_fetch_many_random(iters);
+	time_map_fetch_random_wide(iters, 0);
+	time_map_fetch_random_wide(iters, 1);
+	time_rhset_fetch_random(iters);
+	time_cuckooset_fetch_random(iters);
+	time_rmset_fetch_random(iters);
 	time_map_fetch_sequential(iters);
 	time_map_fetch_empty(iters);
 	time_map_remove(iters);
+	time_map_iterate(iters);
+	time_ohashset_iterate(iters);
+	time_intern(iters);
 	time_map_toggle(iters);
+	time_map_count(iters);
+	time_hashbag_count(iters);
 
 	return 0;
 }
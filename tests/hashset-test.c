@@ -1,11 +1,28 @@
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include <setjmp.h>
+#include <unistd.h>
 #include "cmockery.h"
 
+#include "allocator.h"
 #include "hashset.h"
+#include "counting-alloc.h"
+
+#define HASHSET_NAME int_hashset
+#define HASHSET_TYPE int
+#define HASHSET_HASH(x) ((size_t)(x))
+#define HASHSET_EQUAL(x, y) ((x) == (y))
+#include "hashset-impl.h"
+#undef HASHSET_EQUAL
+#undef HASHSET_HASH
+#undef HASHSET_TYPE
+#undef HASHSET_NAME
 
 
 static size_t int_hash(const void *x, void *context)
@@ -14,6 +31,12 @@ static size_t int_hash(const void *x, void *context)
 	return *(int *)x;
 }
 
+static size_t int_counting_hash(const void *x, void *context)
+{
+	(*(size_t *)context)++;
+	return *(int *)x;
+}
+
 static int int_compar(const void *x, const void *y, void *context)
 {
 	(void)context;
@@ -32,6 +55,7 @@ static size_t (*hash) (const void *, void *);
 static int (*compar) (const void *, const void *, void *);
 static int *vals;
 static size_t count;
+static size_t nhash;
 
 
 static void empty_setup_fixture()
@@ -116,6 +140,227 @@ static void big_bad_teardown()
 	empty_teardown();
 }
 
+static void big_cached_setup_fixture()
+{
+	print_message("big hashset (cached hash)\n");
+	print_message("-------------------------\n");
+}
+
+static void big_cached_setup()
+{
+	hash = int_counting_hash;
+	compar = int_compar;
+	nhash = 0;
+	hashset_init_flags(&set, sizeof(int), hash, compar, &nhash,
+			   HASHSET_CACHE_HASH);
+
+	count = 555;
+	vals = malloc(count * sizeof(*vals));
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+}
+
+static void big_cached_teardown()
+{
+	free(vals);
+	empty_teardown();
+}
+
+static void options_setup(unsigned load_pct, unsigned probe)
+{
+	struct hashset_options opts = { 0 };
+	size_t i;
+
+	opts.load_pct = load_pct;
+	opts.probe = probe;
+	opts.capacity = 100;
+
+	hash = int_hash;
+	compar = int_compar;
+	hashset_init_options(&set, sizeof(int), hash, compar, NULL, &opts);
+	assert_true(hashset_capacity(&set) >= 100);
+	assert_true(hashset_capacity(&set) <= set.nbucket * load_pct / 100);
+
+	count = 555;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+	assert_true(hashset_count(&set) <= set.nbucket * load_pct / 100);
+}
+
+static void options_teardown()
+{
+	free(vals);
+	empty_teardown();
+}
+
+#define NSMALL 8
+
+static int small_buf[NSMALL];
+
+static void small_buffer_setup(size_t n)
+{
+	struct hashset_options opts = { 0 };
+	size_t i;
+
+	opts.small = small_buf;
+	opts.nsmall = NSMALL;
+
+	hash = int_counting_hash;
+	compar = int_compar;
+	nhash = 0;
+	hashset_init_options(&set, sizeof(int), hash, compar, &nhash, &opts);
+	assert_int_equal(hashset_capacity(&set), NSMALL);
+
+	count = n;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+	assert_int_equal(set.nbucket == 0, count <= NSMALL);
+}
+
+static void small_setup_fixture()
+{
+	print_message("small hashset\n");
+	print_message("-------------\n");
+}
+
+static void small_setup()
+{
+	small_buffer_setup(6);
+}
+
+static void big_small_setup_fixture()
+{
+	print_message("big hashset (outgrown small buffer)\n");
+	print_message("-----------------------------------\n");
+}
+
+static void big_small_setup()
+{
+	small_buffer_setup(555);
+}
+
+static void big_linear_setup_fixture()
+{
+	print_message("big hashset (linear probing, 50% load)\n");
+	print_message("--------------------------------------\n");
+}
+
+static void big_linear_setup()
+{
+	options_setup(50, HASHSET_PROBE_LINEAR);
+}
+
+static void big_double_setup_fixture()
+{
+	print_message("big hashset (double hashing, 95% load)\n");
+	print_message("--------------------------------------\n");
+}
+
+static void big_double_setup()
+{
+	options_setup(95, HASHSET_PROBE_DOUBLE);
+}
+
+static void big_sparse_setup_fixture()
+{
+	print_message("big hashset (sparse clear)\n");
+	print_message("--------------------------\n");
+}
+
+static void big_sparse_setup()
+{
+	hash = int_hash;
+	compar = int_compar;
+	hashset_init_flags(&set, sizeof(int), hash, compar, NULL,
+			   HASHSET_SPARSE_CLEAR);
+
+	count = 555;
+	vals = malloc(count * sizeof(*vals));
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+}
+
+static void big_sparse_teardown()
+{
+	free(vals);
+	empty_teardown();
+}
+
+static void big_stats_setup_fixture()
+{
+	print_message("big hashset (stats)\n");
+	print_message("-------------------\n");
+}
+
+static void big_stats_setup()
+{
+	hash = int_hash;
+	compar = int_compar;
+	hashset_init_flags(&set, sizeof(int), hash, compar, NULL,
+			   HASHSET_STATS);
+
+	count = 555;
+	vals = malloc(count * sizeof(*vals));
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+}
+
+static void big_stats_teardown()
+{
+	free(vals);
+	empty_teardown();
+}
+
+static void big_alloc_setup_fixture()
+{
+	print_message("big hashset (allocator)\n");
+	print_message("-----------------------\n");
+}
+
+static void big_alloc_setup()
+{
+	hash = int_hash;
+	compar = int_compar;
+	nblock = 0;
+	hashset_init_alloc(&set, sizeof(int), hash, compar, NULL,
+			   &counting_allocator);
+
+	count = 555;
+	vals = malloc(count * sizeof(*vals));
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+	assert_true(nblock > 0);
+}
+
+static void big_alloc_teardown()
+{
+	free(vals);
+	empty_teardown();
+	assert_int_equal(nblock, 0);
+}
+
 
 static void test_count()
 {
@@ -191,6 +436,731 @@ static void test_remove_hard()
 	assert_true(hashset_count(&set) == 0);
 }
 
+static void test_purge()
+{
+	size_t i;
+
+	for (i = 0; i < count; i += 2) {
+		hashset_remove(&set, &vals[i]);
+	}
+	hashset_purge(&set);
+	assert_int_equal(set.ndeleted, 0);
+	assert_int_equal(hashset_count(&set), count / 2);
+
+	for (i = 0; i < count; i++) {
+		if (i % 2) {
+			assert_true(hashset_contains(&set, &vals[i]));
+			assert_int_equal(*(int *)hashset_item(&set, &vals[i]),
+					 vals[i]);
+		} else {
+			assert_false(hashset_contains(&set, &vals[i]));
+		}
+	}
+}
+
+static void test_churn()
+{
+	size_t i, n, nbucket;
+	int lo, hi, val;
+
+	// fill to capacity with a window [lo, hi) of keys
+	lo = 1000000;
+	for (hi = lo; hashset_count(&set) < hashset_capacity(&set) ||
+	     hashset_count(&set) < 100; hi++) {
+		hashset_set_item(&set, &hi);
+	}
+	n = hashset_count(&set);
+	nbucket = set.nbucket;
+
+	// slide the window, leaving tombstones behind
+	for (i = 0; i < 20 * nbucket; i++) {
+		hashset_set_item(&set, &hi);
+		hi++;
+		hashset_remove(&set, &lo);
+		lo++;
+		assert_int_equal(hashset_count(&set), n);
+		assert_true(set.count + set.ndeleted <= set.count_max);
+	}
+
+	assert_true(set.nbucket <= 2 * nbucket);
+	for (val = lo - 100; val < lo; val++) {
+		assert_false(hashset_contains(&set, &val));
+	}
+	for (val = lo; val < hi; val++) {
+		assert_true(hashset_contains(&set, &val));
+	}
+}
+
+static void test_hashed()
+{
+	struct hashset_pos pos;
+	size_t i, hash;
+	int val = 424242;
+
+	for (i = 0; i < count; i++) {
+		hash = hashset_hash(&set, &vals[i]);
+		assert_true(hashset_contains_hashed(&set, &vals[i], hash));
+		assert_int_equal(*(int *)hashset_item_hashed(&set, &vals[i],
+							     hash), vals[i]);
+	}
+
+	hash = hashset_hash(&set, &val);
+	assert_false(hashset_item_hashed(&set, &val, hash));
+	assert_false(hashset_find_hashed(&set, &val, hash, &pos));
+	assert_int_equal(pos.hash, hash);
+	hashset_insert(&set, &pos, &val);
+	assert_int_equal(hashset_count(&set), count + 1);
+	assert_true(hashset_contains(&set, &val));
+
+	assert_true(hashset_remove_hashed(&set, &val, hash));
+	assert_false(hashset_remove_hashed(&set, &val, hash));
+	assert_int_equal(hashset_count(&set), count);
+	test_lookup();
+}
+
+static void test_save_map()
+{
+	char path[] = "/tmp/hashset-test-XXXXXX";
+	struct hashset map, copy;
+	struct hashset_iter it;
+	size_t i, n;
+	int fd, val = 424242;
+
+	fd = mkstemp(path);
+	assert_true(fd >= 0);
+	assert_int_equal(hashset_save(&set, fd), 0);
+	close(fd);
+
+	assert_int_equal(hashset_map(&map, path, set.hash, set.compar,
+				     set.context), 0);
+	assert_int_equal(hashset_count(&map), count);
+	for (i = 0; i < count; i++) {
+		assert_int_equal(*(int *)hashset_item(&map, &vals[i]), vals[i]);
+	}
+	assert_false(hashset_contains(&map, &val));
+	n = 0;
+	HASHSET_FOREACH(it, &map) {
+		assert_true(hashset_contains(&set, HASHSET_VAL(it)));
+		n++;
+	}
+	assert_int_equal(n, count);
+
+	// a copy is an ordinary set
+	assert_int_equal(hashset_init_copy(&copy, &map), 0);
+	hashset_set_item(&copy, &val);
+	assert_int_equal(hashset_count(&copy), count + 1);
+	assert_false(hashset_contains(&map, &val));
+	hashset_destroy(&copy);
+	hashset_destroy(&map);
+
+	// a file that isn't a saved set is rejected
+	fd = open(path, O_WRONLY | O_TRUNC);
+	assert_true(fd >= 0);
+	assert_int_equal(write(fd, path, sizeof(path)), sizeof(path));
+	close(fd);
+	assert_int_equal(hashset_map(&map, path, set.hash, set.compar,
+				     set.context), EINVAL);
+
+	unlink(path);
+}
+
+/* removed elements don't end up in the file */
+static void test_save_wipes()
+{
+	char path[] = "/tmp/hashset-test-XXXXXX";
+	struct hashset s;
+	char buf[4096];
+	size_t i, j;
+	ssize_t n;
+	int fd, val;
+
+	hashset_init(&s, sizeof(int), int_hash, int_compar, NULL);
+	for (i = 0; i < 100; i++) {
+		val = 0x5a5a0000 + (int)i;
+		hashset_set_item(&s, &val);
+	}
+	for (i = 0; i < 100; i += 2) {
+		val = 0x5a5a0000 + (int)i;
+		hashset_remove(&s, &val);
+	}
+
+	fd = mkstemp(path);
+	assert_true(fd >= 0);
+	assert_int_equal(hashset_save(&s, fd), 0);
+	assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (j = 0; j + sizeof(int) <= (size_t)n; j += sizeof(int)) {
+			memcpy(&val, buf + j, sizeof(int));
+			assert_false((val & ~0xffff) == 0x5a5a0000
+				     && val % 2 == 0);
+		}
+	}
+	close(fd);
+	unlink(path);
+	hashset_destroy(&s);
+}
+
+static void test_small()
+{
+	struct hashset other, copy;
+	size_t i;
+	int val;
+
+	// only a table needs hashes
+	nhash = 0;
+	test_lookup();
+	assert_int_equal(nhash == 0, count <= NSMALL);
+
+	// outgrow the buffer
+	for (val = -1; hashset_count(&set) <= NSMALL; val--) {
+		hashset_set_item(&set, &val);
+	}
+	assert_true(set.nbucket > 0);
+	test_lookup();
+
+	// get down to three elements, and move back into the buffer
+	hashset_clear(&set);
+	for (val = 1; val <= 3; val++) {
+		hashset_set_item(&set, &val);
+	}
+	hashset_trim_excess(&set);
+	assert_int_equal(set.nbucket, 0);
+	assert_int_equal(hashset_capacity(&set), NSMALL);
+	assert_int_equal(hashset_count(&set), 3);
+	for (val = 0; val <= 4; val++) {
+		assert_int_equal(hashset_contains(&set, &val),
+				 val >= 1 && val <= 3);
+	}
+
+	// copies get a table of their own
+	hashset_init_copy(&copy, &set);
+	assert_true(copy.nbucket > 0);
+	assert_true(hashset_set_equals(&copy, &set));
+	hashset_destroy(&copy);
+
+	// set operations that remove from a small set
+	hashset_init(&other, sizeof(int), hash, compar, set.context);
+	val = 2;
+	hashset_set_item(&other, &val);
+	val = 3;
+	hashset_set_item(&other, &val);
+	hashset_intersect_with(&set, &other);
+	assert_int_equal(hashset_count(&set), 2);
+	hashset_except_with(&set, &other);
+	assert_int_equal(hashset_count(&set), 0);
+	hashset_union_with(&set, &other);
+	assert_int_equal(set.nbucket, 0);
+	assert_true(hashset_set_equals(&set, &other));
+	hashset_destroy(&other);
+
+	// removal fills the gap from the end
+	for (val = 10; val < 14; val++) {
+		hashset_set_item(&set, &val);
+	}
+	val = 2;
+	assert_true(hashset_remove(&set, &val));
+	for (i = 0, val = 3; val < 14; val++) {
+		i += hashset_contains(&set, &val);
+	}
+	assert_int_equal(i, 5);
+	assert_int_equal(hashset_count(&set), 5);
+}
+
+static void test_find_many()
+{
+	size_t i, n = 2 * count + 1;
+	int *keys = malloc(n * sizeof(*keys));
+	void **items = malloc(n * sizeof(*items));
+	int *found = malloc(n * sizeof(*found));
+	struct hashset_pos *pos = malloc(n * sizeof(*pos));
+	int val = 777777;
+
+	// interleave present and missing keys
+	for (i = 0; i < count; i++) {
+		keys[2 * i] = vals[i];
+		keys[2 * i + 1] = -1000 - (int)i;
+	}
+	keys[n - 1] = val;
+
+	assert_int_equal(hashset_find_many(&set, keys, n, sizeof(*keys),
+					   items, pos), count);
+	assert_int_equal(hashset_contains_many(&set, keys, n, sizeof(*keys),
+					       found), count);
+	for (i = 0; i < n; i++) {
+		if (i % 2 == 0 && i < n - 1) {
+			assert_true(items[i]);
+			assert_int_equal(*(int *)items[i], keys[i]);
+			assert_true(found[i]);
+		} else {
+			assert_false(items[i]);
+			assert_false(found[i]);
+		}
+	}
+
+	// the positions are good for inserting
+	hashset_insert(&set, &pos[n - 1], &val);
+	assert_int_equal(hashset_count(&set), count + 1);
+	assert_true(hashset_contains(&set, &val));
+
+	free(pos);
+	free(found);
+	free(items);
+	free(keys);
+}
+
+static void test_set_ops()
+{
+	struct hashset other, small, tmp;
+	struct hashset_options opts = { 0 };
+	int buf[2];
+	size_t i, nodd = count / 2;
+	int val;
+
+	// other has the odd-numbered vals, and ten values not in set
+	hashset_init(&other, sizeof(int), hash, compar, set.context);
+	for (i = 1; i < count; i += 2) {
+		hashset_set_item(&other, &vals[i]);
+	}
+	for (val = -10; val < 0; val++) {
+		hashset_set_item(&other, &val);
+	}
+	opts.small = buf;
+	opts.nsmall = 2;
+	hashset_init_options(&small, sizeof(int), hash, compar, set.context,
+			     &opts);
+	val = -1;
+	hashset_set_item(&small, &val);
+	if (count) {
+		hashset_set_item(&small, &vals[count / 2]);
+	}
+
+	assert_true(hashset_is_subset_of(&set, &set));
+	assert_false(hashset_is_proper_subset_of(&set, &set));
+	assert_true(hashset_set_equals(&set, &set));
+	assert_false(hashset_set_equals(&set, &other));
+	assert_false(hashset_is_subset_of(&other, &set));
+	assert_false(hashset_is_superset_of(&set, &other));
+	assert_int_equal(hashset_overlaps(&set, &other), nodd > 0);
+	assert_int_equal(hashset_overlaps(&other, &set), nodd > 0);
+
+	hashset_init_copy(&tmp, &set);
+	hashset_union_with(&tmp, &other);
+	assert_int_equal(hashset_count(&tmp), count + 10);
+	assert_true(hashset_is_proper_superset_of(&tmp, &set));
+	assert_true(hashset_is_superset_of(&tmp, &other));
+	hashset_destroy(&tmp);
+
+	hashset_init_copy(&tmp, &set);
+	hashset_intersect_with(&tmp, &other);
+	assert_int_equal(hashset_count(&tmp), nodd);
+	for (i = 0; i < count; i++) {
+		assert_int_equal(hashset_contains(&tmp, &vals[i]), i % 2);
+	}
+	assert_true(hashset_is_subset_of(&tmp, &set));
+	assert_true(hashset_is_subset_of(&tmp, &other));
+	hashset_intersect_with(&tmp, &small);	// smaller: rebuilds tmp
+	assert_int_equal(hashset_count(&tmp), (count / 2) % 2);
+	hashset_destroy(&tmp);
+
+	hashset_init_copy(&tmp, &set);
+	hashset_except_with(&tmp, &other);
+	assert_int_equal(hashset_count(&tmp), count - nodd);
+	for (i = 0; i < count; i++) {
+		assert_int_equal(hashset_contains(&tmp, &vals[i]), !(i % 2));
+	}
+	assert_false(hashset_overlaps(&tmp, &other));
+	hashset_except_with(&other, &tmp);	// larger: scans other
+	assert_int_equal(hashset_count(&other), nodd + 10);
+	hashset_except_with(&tmp, &tmp);
+	assert_int_equal(hashset_count(&tmp), 0);
+	hashset_destroy(&tmp);
+
+	hashset_init_copy(&tmp, &set);
+	hashset_symmetric_except_with(&tmp, &other);
+	assert_int_equal(hashset_count(&tmp), count - nodd + 10);
+	for (i = 0; i < count; i++) {
+		assert_int_equal(hashset_contains(&tmp, &vals[i]), !(i % 2));
+	}
+	for (val = -10; val < 0; val++) {
+		assert_true(hashset_contains(&tmp, &val));
+	}
+	hashset_destroy(&tmp);
+
+	hashset_destroy(&small);
+	hashset_destroy(&other);
+	test_lookup();
+}
+
+static void test_assign_array()
+{
+	size_t i, n = 2 * count + 3;
+	int *array = malloc(n * sizeof(*array));
+
+	// every val twice, plus a few new ones
+	for (i = 0; i < count; i++) {
+		array[i] = vals[i];
+		array[count + i] = vals[count - i - 1];
+	}
+	array[2 * count] = -1;
+	array[2 * count + 1] = -2;
+	array[2 * count + 2] = -1;
+
+	assert_int_equal(hashset_assign_array(&set, array, n), 0);
+	assert_int_equal(hashset_count(&set), count + 2);
+	assert_int_equal(set.ndeleted, 0);
+	test_lookup();
+	assert_true(hashset_contains(&set, &array[2 * count]));
+	assert_true(hashset_contains(&set, &array[2 * count + 1]));
+
+	assert_int_equal(hashset_assign_array(&set, array, 0), 0);
+	assert_int_equal(hashset_count(&set), 0);
+	free(array);
+}
+
+static void test_iter()
+{
+	struct hashset_iter it;
+	size_t n = 0;
+
+	HASHSET_FOREACH(it, &set) {
+		assert_true(hashset_contains(&set, HASHSET_VAL(it)));
+		n++;
+	}
+	assert_int_equal(n, hashset_count(&set));
+}
+
+static int int_cmp(const void *x, const void *y)
+{
+	return *(int *)x - *(int *)y;
+}
+
+static void test_copy_to()
+{
+	int *dst = malloc((count + 1) * sizeof(*dst));
+	size_t i;
+
+	assert_int_equal(hashset_copy_to(&set, dst), count);
+	qsort(dst, count, sizeof(*dst), int_cmp);
+	for (i = 0; i < count; i++) {
+		assert_int_equal(dst[i], vals[i]);
+	}
+	free(dst);
+}
+
+static void test_grow_cached()
+{
+	size_t nhash0 = nhash;
+
+	hashset_ensure_capacity(&set, 10 * count);
+	assert_int_equal(nhash, nhash0);
+	hashset_trim_excess(&set);
+	assert_int_equal(nhash, nhash0);
+	test_lookup();
+}
+
+static void big_incremental_setup_fixture()
+{
+	print_message("big hashset (incremental resize)\n");
+	print_message("--------------------------------\n");
+}
+
+static void big_incremental_setup()
+{
+	hash = int_hash;
+	compar = int_compar;
+	hashset_init_flags(&set, sizeof(int), hash, compar, NULL,
+			   HASHSET_INCREMENTAL);
+
+	count = 555;
+	vals = malloc(count * sizeof(*vals));
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		hashset_set_item(&set, &vals[i]);
+	}
+}
+
+static void big_incremental_teardown()
+{
+	free(vals);
+	empty_teardown();
+}
+
+static void test_resize_in_progress()
+{
+	struct hashset copy;
+	struct hashset_iter it;
+	size_t n;
+	int val = (int)count;
+
+	// add until a resize starts, then check while it is in progress
+	while (!set.ext || !set.ext->old) {
+		hashset_set_item(&set, &val);
+		val++;
+	}
+	assert_int_equal(hashset_count(&set), (size_t)val);
+
+	n = 0;
+	HASHSET_FOREACH(it, &set) {
+		n++;
+	}
+	assert_int_equal(n, (size_t)val);
+
+	test_iter();
+	hashset_init_copy(&copy, &set);
+	assert_int_equal(hashset_count(&copy), (size_t)val);
+	assert_true(hashset_contains(&copy, &vals[0]));
+	hashset_destroy(&copy);
+
+	test_lookup();
+
+	// remove the extra values; the resize finishes along the way
+	while (val > (int)count) {
+		val--;
+		assert_true(hashset_remove(&set, &val));
+		assert_false(hashset_contains(&set, &val));
+	}
+	assert_false(set.ext && set.ext->old);
+	test_remove_hard();
+}
+
+static void test_sparse_clear()
+{
+	size_t i, nbucket;
+	int batch, n, val;
+
+	hashset_ensure_capacity(&set, 10000);
+	nbucket = set.nbucket;
+
+	// small batches, then one that touches most of the groups
+	for (batch = 0; batch <= 50; batch++) {
+		n = batch < 50 ? 5 : 5000;
+		for (val = 0; val < n; val++) {
+			hashset_set_item(&set, &(int){ batch * 10000 + val });
+		}
+		if (batch % 3 == 0) {
+			val = batch * 10000;
+			hashset_remove(&set, &val);
+		}
+		if (batch == 21) {
+			hashset_purge(&set);
+		}
+		hashset_clear(&set);
+		assert_int_equal(hashset_count(&set), 0);
+		for (val = 0; val < n; val++) {
+			assert_false(hashset_contains(&set,
+						      &(int){ batch * 10000
+							      + val }));
+		}
+	}
+	assert_int_equal(set.nbucket, nbucket);
+	for (i = 0; i < nbucket; i++) {
+		assert_int_equal(set.status[i], 0);
+	}
+
+	for (i = 0; i < count; i++) {
+		hashset_set_item(&set, &vals[i]);
+	}
+	test_lookup();
+}
+
+static size_t stats_total(const size_t *hist)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < HASHSET_STATS_NPROBE; i++) {
+		n += hist[i];
+	}
+	return n;
+}
+
+static void test_stats()
+{
+	struct hashset_stats st0, st;
+	size_t i, nresize;
+	int val = -1;
+
+	hashset_stats(&set, &st0);
+	assert_int_equal(st0.count, count);
+	assert_int_equal(st0.nbucket, set.nbucket);
+	assert_true(st0.load > 0 && st0.load < 1);
+	assert_true(st0.nresize > 0);
+	assert_true(st0.grow_time >= 0);
+
+	for (i = 0; i < count; i++) {
+		assert_true(hashset_contains(&set, &vals[i]));
+	}
+	assert_false(hashset_contains(&set, &val));
+
+	hashset_stats(&set, &st);
+	assert_int_equal(stats_total(st.hit), stats_total(st0.hit) + count);
+	assert_int_equal(stats_total(st.miss), stats_total(st0.miss) + 1);
+	assert_true(st.ncompar >= st0.ncompar + count);
+
+	// the counters survive a rebuild
+	nresize = st.nresize;
+	hashset_ensure_capacity(&set, 10 * count);
+	hashset_stats(&set, &st);
+	assert_int_equal(st.nresize, nresize + 1);
+	assert_int_equal(stats_total(st.miss), stats_total(st0.miss) + 1);
+
+	hashset_set_item(&set, &val);
+	hashset_remove(&set, &val);
+	hashset_stats(&set, &st);
+	assert_true(st.deleted_ratio >= 0);
+	assert_int_equal(st.ndeleted, set.ndeleted);
+	test_lookup();
+}
+
+static void specialized_setup_fixture()
+{
+	print_message("specialized hashset\n");
+	print_message("-------------------\n");
+}
+
+static void test_specialized_lookup()
+{
+	struct int_hashset s;
+	struct int_hashset_iter it;
+	int val, n = 555;
+	size_t nit;
+
+	int_hashset_init(&s);
+	val = 0;
+	assert_false(int_hashset_contains(&s, &val));
+	assert_false(int_hashset_remove(&s, &val));
+
+	for (val = 0; val < n; val++) {
+		assert_int_equal(int_hashset_set_item(&s, &val), 0);
+		assert_int_equal(int_hashset_set_item(&s, &val), 0);
+	}
+	assert_int_equal(int_hashset_count(&s), (size_t)n);
+
+	for (val = -n; val < 2 * n; val++) {
+		if (val >= 0 && val < n) {
+			assert_int_equal(*int_hashset_item(&s, &val), val);
+		} else {
+			assert_false(int_hashset_contains(&s, &val));
+		}
+	}
+
+	for (val = 0; val < n; val += 2) {
+		assert_true(int_hashset_remove(&s, &val));
+	}
+	assert_int_equal(int_hashset_count(&s), (size_t)n / 2);
+
+	nit = 0;
+	it = int_hashset_iter_make(&s);
+	while (int_hashset_iter_advance(&it)) {
+		assert_true(*it.val % 2);
+		nit++;
+	}
+	assert_int_equal(nit, (size_t)n / 2);
+
+	int_hashset_clear(&s);
+	assert_int_equal(int_hashset_count(&s), 0);
+	val = 1;
+	assert_false(int_hashset_contains(&s, &val));
+	int_hashset_destroy(&s);
+}
+
+static void test_specialized_churn()
+{
+	struct int_hashset s;
+	size_t i, nbucket;
+	int lo, hi, val;
+
+	int_hashset_init(&s);
+	int_hashset_ensure_capacity(&s, 1000);
+	nbucket = s.nbucket;
+
+	// fill to capacity, then slide the window of keys
+	for (lo = hi = 0; int_hashset_count(&s) < int_hashset_capacity(&s);
+	     hi++) {
+		int_hashset_set_item(&s, &hi);
+	}
+	for (i = 0; i < 20 * nbucket; i++) {
+		int_hashset_set_item(&s, &hi);
+		hi++;
+		int_hashset_remove(&s, &lo);
+		lo++;
+		assert_true(s.count + s.ndeleted <= s.count_max);
+	}
+
+	assert_true(s.nbucket <= 2 * nbucket);
+	for (val = lo - 100; val < lo; val++) {
+		assert_false(int_hashset_contains(&s, &val));
+	}
+	for (val = lo; val < hi; val++) {
+		assert_true(int_hashset_contains(&s, &val));
+	}
+	int_hashset_destroy(&s);
+}
+
+static void parallel_setup_fixture()
+{
+	print_message("parallel rehash\n");
+	print_message("---------------\n");
+}
+
+static void check_parallel(unsigned flags)
+{
+	struct hashset s, copy;
+	struct hashset_options opts = { 0 };
+	int val, n = 300000;
+
+	opts.flags = flags;
+	opts.nthread = 4;
+	assert_int_equal(hashset_init_options(&s, sizeof(int), int_hash,
+					      int_compar, NULL, &opts), 0);
+
+	// grows through several tables big enough to rebuild in parallel
+	for (val = 0; val < n; val++) {
+		assert_int_equal(hashset_set_item(&s, &val), 0);
+	}
+	assert_int_equal(hashset_count(&s), (size_t)n);
+	for (val = -10; val < n + 10; val++) {
+		assert_int_equal(hashset_contains(&s, &val),
+				 val >= 0 && val < n);
+	}
+
+	for (val = 0; val < n; val += 2) {
+		assert_true(hashset_remove(&s, &val));
+	}
+	assert_int_equal(hashset_init_copy(&copy, &s), 0);
+	assert_int_equal(hashset_count(&copy), (size_t)n / 2);
+	for (val = 0; val < n; val++) {
+		assert_int_equal(hashset_contains(&copy, &val), val % 2);
+	}
+
+	// the copy has no room to spare, so this grows it again
+	for (val = 0; val < n; val += 2) {
+		assert_int_equal(hashset_set_item(&copy, &val), 0);
+	}
+	assert_int_equal(hashset_count(&copy), (size_t)n);
+	assert_true(hashset_is_proper_superset_of(&copy, &s));
+
+	hashset_clear(&copy);
+	assert_int_equal(hashset_count(&copy), 0);
+	val = 1;
+	assert_false(hashset_contains(&copy, &val));
+
+	hashset_destroy(&copy);
+	hashset_destroy(&s);
+}
+
+static void test_parallel_grow()
+{
+	check_parallel(0);
+}
+
+static void test_parallel_grow_cached()
+{
+	check_parallel(HASHSET_CACHE_HASH | HASHSET_SPARSE_CLEAR);
+}
+
+
 int main()
 {
 	UnitTest tests[] = {
@@ -201,6 +1171,16 @@ int main()
 		unit_test_setup_teardown(test_add, empty_setup, empty_teardown),
 		unit_test_setup_teardown(test_add_existing, empty_setup, empty_teardown),
 		unit_test_setup_teardown(test_remove, empty_setup, empty_teardown),		
+		unit_test_setup_teardown(test_purge, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_churn, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_find_many, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_set_ops, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_assign_array, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_iter, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_copy_to, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_hashed, empty_setup, empty_teardown),
+		unit_test_setup_teardown(test_save_map, empty_setup, empty_teardown),
+		unit_test(test_save_wipes),
 		unit_test_teardown(empty_suite, teardown_fixture),
 
 		unit_test_setup(big_suite, big_setup_fixture),
@@ -211,6 +1191,15 @@ int main()
 		unit_test_setup_teardown(test_add_existing, big_setup, big_teardown),
 		unit_test_setup_teardown(test_remove, big_setup, big_teardown),		
 		unit_test_setup_teardown(test_remove_hard, big_setup, big_teardown),
+		unit_test_setup_teardown(test_purge, big_setup, big_teardown),
+		unit_test_setup_teardown(test_churn, big_setup, big_teardown),
+		unit_test_setup_teardown(test_find_many, big_setup, big_teardown),
+		unit_test_setup_teardown(test_set_ops, big_setup, big_teardown),
+		unit_test_setup_teardown(test_assign_array, big_setup, big_teardown),
+		unit_test_setup_teardown(test_iter, big_setup, big_teardown),
+		unit_test_setup_teardown(test_copy_to, big_setup, big_teardown),
+		unit_test_setup_teardown(test_hashed, big_setup, big_teardown),
+		unit_test_setup_teardown(test_save_map, big_setup, big_teardown),
 		unit_test_teardown(big_suite, teardown_fixture),
 
 		unit_test_setup(big_bad_suite, big_bad_setup_fixture),
@@ -221,7 +1210,165 @@ int main()
 		unit_test_setup_teardown(test_add_existing, big_bad_setup, big_bad_teardown),
 		unit_test_setup_teardown(test_remove, big_bad_setup, big_bad_teardown),		
 		unit_test_setup_teardown(test_remove_hard, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_purge, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_churn, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_find_many, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_set_ops, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_assign_array, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_iter, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_copy_to, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_hashed, big_bad_setup, big_bad_teardown),
+		unit_test_setup_teardown(test_save_map, big_bad_setup, big_bad_teardown),
 		unit_test_teardown(big_bad_suite, teardown_fixture),
+
+		unit_test_setup(big_cached_suite, big_cached_setup_fixture),
+		unit_test_setup_teardown(test_count, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_clear, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_lookup, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_add, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_add_existing, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_remove, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_grow_cached, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_purge, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_churn, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_find_many, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_set_ops, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_assign_array, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_iter, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_copy_to, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_hashed, big_cached_setup, big_cached_teardown),
+		unit_test_setup_teardown(test_save_map, big_cached_setup, big_cached_teardown),
+		unit_test_teardown(big_cached_suite, teardown_fixture),
+
+		unit_test_setup(big_incremental_suite, big_incremental_setup_fixture),
+		unit_test_setup_teardown(test_count, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_clear, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_lookup, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_add, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_add_existing, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_remove, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_resize_in_progress, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_purge, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_churn, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_find_many, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_set_ops, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_assign_array, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_iter, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_copy_to, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_hashed, big_incremental_setup, big_incremental_teardown),
+		unit_test_setup_teardown(test_save_map, big_incremental_setup, big_incremental_teardown),
+		unit_test_teardown(big_incremental_suite, teardown_fixture),
+
+		unit_test_setup(small_suite, small_setup_fixture),
+		unit_test_setup_teardown(test_count, small_setup, options_teardown),
+		unit_test_setup_teardown(test_clear, small_setup, options_teardown),
+		unit_test_setup_teardown(test_lookup, small_setup, options_teardown),
+		unit_test_setup_teardown(test_add, small_setup, options_teardown),
+		unit_test_setup_teardown(test_add_existing, small_setup, options_teardown),
+		unit_test_setup_teardown(test_remove, small_setup, options_teardown),
+		unit_test_setup_teardown(test_remove_hard, small_setup, options_teardown),
+		unit_test_setup_teardown(test_purge, small_setup, options_teardown),
+		unit_test_setup_teardown(test_churn, small_setup, options_teardown),
+		unit_test_setup_teardown(test_find_many, small_setup, options_teardown),
+		unit_test_setup_teardown(test_set_ops, small_setup, options_teardown),
+		unit_test_setup_teardown(test_assign_array, small_setup, options_teardown),
+		unit_test_setup_teardown(test_iter, small_setup, options_teardown),
+		unit_test_setup_teardown(test_copy_to, small_setup, options_teardown),
+		unit_test_setup_teardown(test_hashed, small_setup, options_teardown),
+		unit_test_setup_teardown(test_save_map, small_setup, options_teardown),
+		unit_test_setup_teardown(test_small, small_setup, options_teardown),
+		unit_test_teardown(small_suite, teardown_fixture),
+
+		unit_test_setup(big_small_suite, big_small_setup_fixture),
+		unit_test_setup_teardown(test_count, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_clear, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_lookup, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_add, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_add_existing, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_remove, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_purge, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_churn, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_find_many, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_set_ops, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_assign_array, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_iter, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_copy_to, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_hashed, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_save_map, big_small_setup, options_teardown),
+		unit_test_setup_teardown(test_small, big_small_setup, options_teardown),
+		unit_test_teardown(big_small_suite, teardown_fixture),
+
+		unit_test_setup(big_linear_suite, big_linear_setup_fixture),
+		unit_test_setup_teardown(test_count, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_lookup, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_add, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_remove, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_purge, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_churn, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_find_many, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_set_ops, big_linear_setup, options_teardown),
+		unit_test_setup_teardown(test_assign_array, big_linear_setup, options_teardown),
+		unit_test_teardown(big_linear_suite, teardown_fixture),
+
+		unit_test_setup(big_double_suite, big_double_setup_fixture),
+		unit_test_setup_teardown(test_count, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_lookup, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_add, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_remove, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_purge, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_churn, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_find_many, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_set_ops, big_double_setup, options_teardown),
+		unit_test_setup_teardown(test_assign_array, big_double_setup, options_teardown),
+		unit_test_teardown(big_double_suite, teardown_fixture),
+
+		unit_test_setup(big_sparse_suite, big_sparse_setup_fixture),
+		unit_test_setup_teardown(test_count, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_clear, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_lookup, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_purge, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_churn, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_set_ops, big_sparse_setup, big_sparse_teardown),
+		unit_test_setup_teardown(test_sparse_clear, big_sparse_setup, big_sparse_teardown),
+		unit_test_teardown(big_sparse_suite, teardown_fixture),
+
+		unit_test_setup(big_stats_suite, big_stats_setup_fixture),
+		unit_test_setup_teardown(test_count, big_stats_setup, big_stats_teardown),
+		unit_test_setup_teardown(test_lookup, big_stats_setup, big_stats_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_stats_setup, big_stats_teardown),
+		unit_test_setup_teardown(test_churn, big_stats_setup, big_stats_teardown),
+		unit_test_setup_teardown(test_set_ops, big_stats_setup, big_stats_teardown),
+		unit_test_setup_teardown(test_assign_array, big_stats_setup, big_stats_teardown),
+		unit_test_setup_teardown(test_stats, big_stats_setup, big_stats_teardown),
+		unit_test_teardown(big_stats_suite, teardown_fixture),
+
+		unit_test_setup(big_alloc_suite, big_alloc_setup_fixture),
+		unit_test_setup_teardown(test_count, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_clear, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_lookup, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_add, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_remove_hard, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_purge, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_churn, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_set_ops, big_alloc_setup, big_alloc_teardown),
+		unit_test_setup_teardown(test_assign_array, big_alloc_setup, big_alloc_teardown),
+		unit_test_teardown(big_alloc_suite, teardown_fixture),
+
+		unit_test_setup(specialized_suite, specialized_setup_fixture),
+		unit_test(test_specialized_lookup),
+		unit_test(test_specialized_churn),
+		unit_test_teardown(specialized_suite, teardown_fixture),
+
+		unit_test_setup(parallel_suite, parallel_setup_fixture),
+		unit_test(test_parallel_grow),
+		unit_test(test_parallel_grow_cached),
+		unit_test_teardown(parallel_suite, teardown_fixture),
 	};
 	return run_tests(tests);
 }
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "hash.h"
+#include "intern.h"
+
+
+static struct intern table;
+static size_t count;
+
+
+static void make_string(char *buf, size_t i)
+{
+	sprintf(buf, "token-%zu", i);
+}
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void fill(size_t n)
+{
+	char buf[64];
+	size_t i;
+
+	intern_init(&table);
+
+	count = n;
+	for (i = 0; i < count; i++) {
+		make_string(buf, i);
+		intern_id(&table, buf, strlen(buf));
+	}
+}
+
+static void teardown()
+{
+	intern_destroy(&table);
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty intern\n");
+	print_message("------------\n");
+}
+
+static void empty_setup()
+{
+	fill(0);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big intern\n");
+	print_message("----------\n");
+}
+
+static void big_setup()
+{
+	fill(5555);
+}
+
+static void test_count()
+{
+	assert_int_equal(intern_count(&table), count);
+}
+
+static void test_lookup()
+{
+	char buf[64];
+	size_t i, id;
+
+	for (i = 0; i < count; i++) {
+		make_string(buf, i);
+		assert_true(intern_find(&table, buf, strlen(buf), &id));
+		assert_int_equal(id, i);
+		assert_int_equal(intern_len(&table, id), strlen(buf));
+		assert_string_equal(intern_ptr(&table, id), buf);
+		assert_int_equal(intern_hash(&table, id),
+				 bytes_hash(buf, strlen(buf)));
+	}
+	assert_false(intern_find(&table, "token", 5, NULL));
+	assert_false(intern_find(&table, "token-0", 6, NULL));
+}
+
+static void test_existing()
+{
+	char buf[64];
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		make_string(buf, i);
+		assert_int_equal(intern_id(&table, buf, strlen(buf)), i);
+	}
+	assert_int_equal(intern_count(&table), count);
+}
+
+static void test_stable()
+{
+	const char *first = NULL;
+	char buf[64];
+	size_t i, id0 = 0;
+
+	id0 = intern_id(&table, "first", 5);
+	first = intern_ptr(&table, id0);
+
+	// enough to fill several chunks and grow the set a few times
+	for (i = 0; i < 20000; i++) {
+		sprintf(buf, "more-%zu", i);
+		intern_id(&table, buf, strlen(buf));
+	}
+
+	assert_true(intern_ptr(&table, id0) == first);
+	assert_string_equal(first, "first");
+	assert_int_equal(intern_id(&table, "first", 5), id0);
+}
+
+static void test_bytes()
+{
+	static const char nul[] = "a\0b";
+	char *big;
+	size_t id_nul, id_a, id_empty, id_big, n = 100000;
+
+	// lengths count, not NULs
+	id_nul = intern_id(&table, nul, 3);
+	id_a = intern_id(&table, nul, 1);
+	id_empty = intern_id(&table, nul, 0);
+	assert_true(id_nul != id_a);
+	assert_true(id_a != id_empty);
+	assert_int_equal(intern_len(&table, id_nul), 3);
+	assert_true(memcmp(intern_ptr(&table, id_nul), nul, 3) == 0);
+	assert_int_equal(intern_len(&table, id_empty), 0);
+	assert_string_equal(intern_ptr(&table, id_empty), "");
+
+	// bigger than a chunk
+	big = malloc(n);
+	memset(big, 'x', n);
+	id_big = intern_id(&table, big, n);
+	assert_int_equal(intern_len(&table, id_big), n);
+	assert_true(memcmp(intern_ptr(&table, id_big), big, n) == 0);
+	assert_int_equal(intern_id(&table, big, n), id_big);
+	big[n - 1] = 'y';
+	assert_false(intern_find(&table, big, n, NULL));
+	free(big);
+
+	test_lookup();
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_existing, empty_setup, teardown),
+		unit_test_setup_teardown(test_stable, empty_setup, teardown),
+		unit_test_setup_teardown(test_bytes, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_existing, big_setup, teardown),
+		unit_test_setup_teardown(test_stable, big_setup, teardown),
+		unit_test_setup_teardown(test_bytes, big_setup, teardown),
+		unit_test_teardown(big_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
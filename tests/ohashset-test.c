@@ -0,0 +1,360 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "ohashset.h"
+
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static size_t int_mix_hash(const void *x, void *context)
+{
+	(void)context;
+	return (size_t)*(int *)x * 2654435761U;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+static size_t int_bad_hash(const void *x, void *context)
+{
+	(void)context;
+	(void)x;
+	return 1337;
+}
+
+static struct ohashset set;
+static int *vals;
+static size_t count;
+
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void fill(size_t (*hash) (const void *, void *), size_t n)
+{
+	size_t i;
+
+	ohashset_init(&set, sizeof(int), hash, int_compar, NULL);
+
+	count = n;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		ohashset_set_item(&set, &vals[i]);
+	}
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty ohashset\n");
+	print_message("--------------\n");
+}
+
+static void empty_setup()
+{
+	fill(int_hash, 0);
+}
+
+static void teardown()
+{
+	free(vals);
+	ohashset_destroy(&set);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big ohashset\n");
+	print_message("------------\n");
+}
+
+static void big_setup()
+{
+	fill(int_mix_hash, 555);
+}
+
+static void big_bad_setup_fixture()
+{
+	print_message("big ohashset (bad hash)\n");
+	print_message("-----------------------\n");
+}
+
+static void big_bad_setup()
+{
+	fill(int_bad_hash, 151);
+}
+
+static void test_count()
+{
+	assert_int_equal(ohashset_count(&set), count);
+}
+
+static void test_clear()
+{
+	ohashset_clear(&set);
+	assert_int_equal(ohashset_count(&set), 0);
+	if (count) {
+		assert_false(ohashset_contains(&set, &vals[0]));
+	}
+}
+
+static void test_lookup()
+{
+	size_t i;
+	const int *val;
+
+	for (i = 0; i < count; i++) {
+		assert_true(ohashset_contains(&set, &vals[i]));
+		val = ohashset_item(&set, &vals[i]);
+		assert_true(val);
+		assert_int_equal(*val, vals[i]);
+	}
+}
+
+static void test_add()
+{
+	int val = 31337;
+
+	ohashset_set_item(&set, &val);
+	assert_int_equal(ohashset_count(&set), count + 1);
+	assert_true(ohashset_contains(&set, &val));
+	assert_int_equal(*(int *)ohashset_item(&set, &val), val);
+	test_lookup();
+}
+
+static void test_add_existing()
+{
+	int val = 88888;
+
+	ohashset_set_item(&set, &val);
+	ohashset_set_item(&set, &val);
+	assert_int_equal(ohashset_count(&set), count + 1);
+	assert_true(ohashset_contains(&set, &val));
+}
+
+static void test_remove()
+{
+	int val = -1;
+
+	ohashset_set_item(&set, &val);
+	assert_true(ohashset_remove(&set, &val));
+	assert_false(ohashset_remove(&set, &val));
+	assert_int_equal(ohashset_count(&set), count);
+	assert_false(ohashset_contains(&set, &val));
+	test_lookup();
+}
+
+static void test_remove_hard()
+{
+	size_t i, j;
+
+	for (i = 0; i < count; i++) {
+		ohashset_remove(&set, &vals[i]);
+		assert_int_equal(ohashset_count(&set), count - i - 1);
+		for (j = 0; j <= i; j++) {
+			assert_false(ohashset_contains(&set, &vals[j]));
+		}
+		for (; j < count; j++) {
+			assert_true(ohashset_contains(&set, &vals[j]));
+		}
+	}
+	assert_int_equal(ohashset_count(&set), 0);
+}
+
+static void test_iter()
+{
+	struct ohashset_iter it;
+	size_t n = 0;
+
+	OHASHSET_FOREACH(it, &set) {
+		assert_true(ohashset_contains(&set, OHASHSET_VAL(it)));
+		n++;
+	}
+	assert_int_equal(n, count);
+}
+
+static void test_copy()
+{
+	struct ohashset copy;
+	size_t i;
+
+	ohashset_init_copy(&copy, &set);
+	assert_int_equal(ohashset_count(&copy), count);
+	for (i = 0; i < count; i++) {
+		assert_true(ohashset_contains(&copy, &vals[i]));
+	}
+	ohashset_destroy(&copy);
+}
+
+static void test_order()
+{
+	struct ohashset_iter it;
+	int *want = malloc((count + 1) * sizeof(*want));
+	size_t i, n;
+
+	// removing and re-adding moves an element to the end; replacing doesn't
+	for (i = 0; i < count; i += 2) {
+		ohashset_remove(&set, &vals[i]);
+	}
+	for (i = 0; i < count; i += 4) {
+		ohashset_set_item(&set, &vals[i]);
+	}
+	for (i = 1; i < count; i += 2) {
+		ohashset_set_item(&set, &vals[i]);
+	}
+
+	n = 0;
+	for (i = 1; i < count; i += 2) {
+		want[n++] = vals[i];
+	}
+	for (i = 0; i < count; i += 4) {
+		want[n++] = vals[i];
+	}
+	assert_int_equal(ohashset_count(&set), n);
+
+	i = 0;
+	OHASHSET_FOREACH(it, &set) {
+		assert_int_equal(*(int *)OHASHSET_VAL(it), want[i]);
+		i++;
+	}
+	assert_int_equal(i, n);
+	free(want);
+}
+
+static void test_copy_to()
+{
+	int *buf = malloc((count + 1) * sizeof(*buf));
+	struct ohashset_iter it;
+	size_t i, n;
+
+	for (i = 0; i < count; i += 3) {
+		ohashset_remove(&set, &vals[i]);
+	}
+	n = ohashset_copy_to(&set, buf);
+	assert_int_equal(n, ohashset_count(&set));
+
+	i = 0;
+	OHASHSET_FOREACH(it, &set) {
+		assert_int_equal(buf[i], *(int *)OHASHSET_VAL(it));
+		i++;
+	}
+	assert_int_equal(i, n);
+	free(buf);
+}
+
+static void test_trim_excess()
+{
+	size_t i, j;
+
+	for (i = 0; i < count; i += 2) {
+		ohashset_remove(&set, &vals[i]);
+	}
+	ohashset_trim_excess(&set);
+	assert_int_equal(set.nentry, ohashset_count(&set));
+	assert_true(ohashset_capacity(&set) >= ohashset_count(&set));
+
+	for (i = 0; i < count; i++) {
+		assert_int_equal(ohashset_contains(&set, &vals[i]), i % 2);
+	}
+	j = 1;
+	for (i = 0; i < set.nentry; i++) {
+		assert_int_equal(((int *)set.entries)[i], vals[j]);
+		j += 2;
+	}
+}
+
+static void test_churn()
+{
+	size_t i, nbucket;
+	int lo, hi, val;
+
+	ohashset_ensure_capacity(&set, 1000);
+	nbucket = set.nbucket;
+
+	// fill to capacity, then slide a window of keys [lo, hi)
+	lo = hi = 1000000;
+	while (ohashset_count(&set) < ohashset_capacity(&set)) {
+		ohashset_set_item(&set, &hi);
+		hi++;
+	}
+	for (i = 0; i < 10 * nbucket; i++) {
+		ohashset_remove(&set, &lo);
+		lo++;
+		ohashset_set_item(&set, &hi);
+		hi++;
+	}
+
+	// rebuilds compact the holes away, so the table grows at most once
+	assert_true(set.nbucket <= 2 * nbucket);
+	for (val = lo - 100; val < lo; val++) {
+		assert_false(ohashset_contains(&set, &val));
+	}
+	for (val = lo; val < hi; val++) {
+		assert_true(ohashset_contains(&set, &val));
+	}
+	test_lookup();
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_clear, empty_setup, teardown),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_add, empty_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_iter, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy, empty_setup, teardown),
+		unit_test_setup_teardown(test_churn, empty_setup, teardown),
+		unit_test_setup_teardown(test_order, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, empty_setup, teardown),
+		unit_test_setup_teardown(test_trim_excess, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_add, big_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_remove_hard, big_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_setup, teardown),
+		unit_test_setup_teardown(test_churn, big_setup, teardown),
+		unit_test_setup_teardown(test_order, big_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, big_setup, teardown),
+		unit_test_setup_teardown(test_trim_excess, big_setup, teardown),
+		unit_test_teardown(big_suite, teardown_fixture),
+
+		unit_test_setup(big_bad_suite, big_bad_setup_fixture),
+		unit_test_setup_teardown(test_count, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_add, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_remove_hard, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_order, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_trim_excess, big_bad_setup, teardown),
+		unit_test_teardown(big_bad_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
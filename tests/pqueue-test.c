@@ -177,6 +177,25 @@ static void test_push_existing()
 	}
 }
 
+static void test_assign_copy()
+{
+	size_t j;
+	struct pqueue pq;
+	int elt = -1;
+
+	pqueue_init(&pq, sizeof(int), compar, NULL);
+	pqueue_push(&pq, &elt);
+	assert_int_equal(pqueue_assign_copy(&pq, &pqueue), 0);
+	assert_int_equal(pqueue_count(&pq), count);
+
+	for (j = 0; j < count; j++) {
+		assert_int_equal(*(int *)pqueue_top(&pq), elts[j]);
+		pqueue_pop(&pq);
+	}
+
+	pqueue_destroy(&pq);
+}
+
 int main()
 {
 	UnitTest tests[] = {
@@ -198,6 +217,8 @@ int main()
 					 singleton_setup, teardown),
 		unit_test_setup_teardown(test_push_existing, singleton_setup,
 					 teardown),
+		unit_test_setup_teardown(test_assign_copy, singleton_setup,
+					 teardown),
 		unit_test_teardown(singleton_suite, teardown_fixture),
 
 		unit_test_setup(sorted5_suite, sorted5_setup_fixture),
@@ -214,6 +235,8 @@ int main()
 					 teardown),
 		unit_test_setup_teardown(test_push_existing, sorted5_setup,
 					 teardown),
+		unit_test_setup_teardown(test_assign_copy, sorted5_setup,
+					 teardown),
 		unit_test_teardown(sorted5_suite, teardown_fixture),
 
 		unit_test_setup(unsorted7_suite, unsorted7_setup_fixture),
@@ -230,6 +253,8 @@ int main()
 					 unsorted7_setup, teardown),
 		unit_test_setup_teardown(test_push_existing, unsorted7_setup,
 					 teardown),
+		unit_test_setup_teardown(test_assign_copy, unsorted7_setup,
+					 teardown),
 		unit_test_teardown(unsorted7_suite, teardown_fixture),
 
 	};
@@ -0,0 +1,278 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "rhset.h"
+
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static size_t int_mix_hash(const void *x, void *context)
+{
+	(void)context;
+	return (size_t)*(int *)x * 2654435761U;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+static size_t int_bad_hash(const void *x, void *context)
+{
+	(void)context;
+	(void)x;
+	return 1337;
+}
+
+#define PCT90(n) ((n) / 10 * 9)
+
+static struct rhset set;
+static int *vals;
+static size_t count;
+
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void fill(size_t (*hash) (const void *, void *), size_t n)
+{
+	size_t i;
+
+	rhset_init(&set, sizeof(int), hash, int_compar, NULL);
+
+	count = n;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		rhset_set_item(&set, &vals[i]);
+	}
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty rhset\n");
+	print_message("-----------\n");
+}
+
+static void empty_setup()
+{
+	fill(int_hash, 0);
+}
+
+static void teardown()
+{
+	free(vals);
+	rhset_destroy(&set);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big rhset\n");
+	print_message("---------\n");
+}
+
+static void big_setup()
+{
+	fill(int_mix_hash, 555);
+}
+
+static void big_bad_setup_fixture()
+{
+	print_message("big rhset (bad hash)\n");
+	print_message("--------------------\n");
+}
+
+static void big_bad_setup()
+{
+	fill(int_bad_hash, 151);
+}
+
+static void test_count()
+{
+	assert_int_equal(rhset_count(&set), count);
+}
+
+static void test_clear()
+{
+	rhset_clear(&set);
+	assert_int_equal(rhset_count(&set), 0);
+	if (count) {
+		assert_false(rhset_contains(&set, &vals[0]));
+	}
+}
+
+static void test_lookup()
+{
+	size_t i;
+	const int *val;
+
+	for (i = 0; i < count; i++) {
+		assert_true(rhset_contains(&set, &vals[i]));
+		val = rhset_item(&set, &vals[i]);
+		assert_true(val);
+		assert_int_equal(*val, vals[i]);
+	}
+}
+
+static void test_add()
+{
+	int val = 31337;
+
+	rhset_set_item(&set, &val);
+	assert_int_equal(rhset_count(&set), count + 1);
+	assert_true(rhset_contains(&set, &val));
+	assert_int_equal(*(int *)rhset_item(&set, &val), val);
+	test_lookup();
+}
+
+static void test_add_existing()
+{
+	int val = 88888;
+
+	rhset_set_item(&set, &val);
+	rhset_set_item(&set, &val);
+	assert_int_equal(rhset_count(&set), count + 1);
+	assert_true(rhset_contains(&set, &val));
+}
+
+static void test_remove()
+{
+	int val = -1;
+
+	rhset_set_item(&set, &val);
+	assert_true(rhset_remove(&set, &val));
+	assert_false(rhset_remove(&set, &val));
+	assert_int_equal(rhset_count(&set), count);
+	assert_false(rhset_contains(&set, &val));
+	test_lookup();
+}
+
+static void test_remove_hard()
+{
+	size_t i, j;
+
+	for (i = 0; i < count; i++) {
+		rhset_remove(&set, &vals[i]);
+		assert_int_equal(rhset_count(&set), count - i - 1);
+		for (j = 0; j <= i; j++) {
+			assert_false(rhset_contains(&set, &vals[j]));
+		}
+		for (; j < count; j++) {
+			assert_true(rhset_contains(&set, &vals[j]));
+		}
+	}
+	assert_int_equal(rhset_count(&set), 0);
+}
+
+static void test_iter()
+{
+	struct rhset_iter it;
+	size_t n = 0;
+
+	RHSET_FOREACH(it, &set) {
+		assert_true(rhset_contains(&set, RHSET_VAL(it)));
+		n++;
+	}
+	assert_int_equal(n, count);
+}
+
+static void test_copy()
+{
+	struct rhset copy;
+	size_t i;
+
+	rhset_init_copy(&copy, &set);
+	assert_int_equal(rhset_count(&copy), count);
+	for (i = 0; i < count; i++) {
+		assert_true(rhset_contains(&copy, &vals[i]));
+	}
+	rhset_destroy(&copy);
+}
+
+static void test_full_load()
+{
+	size_t i, nbucket;
+	int lo, hi, val;
+
+	rhset_ensure_capacity(&set, 1000);
+	nbucket = set.nbucket;
+	assert_true(rhset_capacity(&set) >= PCT90(nbucket));
+
+	// fill to capacity, then slide a window of keys [lo, hi)
+	lo = hi = 1000000;
+	while (rhset_count(&set) < rhset_capacity(&set)) {
+		rhset_set_item(&set, &hi);
+		hi++;
+	}
+	for (i = 0; i < 10 * nbucket; i++) {
+		rhset_remove(&set, &lo);
+		lo++;
+		rhset_set_item(&set, &hi);
+		hi++;
+	}
+
+	// no tombstones, so the table never needs to grow
+	assert_int_equal(set.nbucket, nbucket);
+	assert_int_equal(rhset_count(&set), rhset_capacity(&set));
+	for (val = lo - 100; val < lo; val++) {
+		assert_false(rhset_contains(&set, &val));
+	}
+	for (val = lo; val < hi; val++) {
+		assert_true(rhset_contains(&set, &val));
+	}
+	test_lookup();
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_clear, empty_setup, teardown),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_add, empty_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_iter, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy, empty_setup, teardown),
+		unit_test_setup_teardown(test_full_load, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_add, big_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_remove_hard, big_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_setup, teardown),
+		unit_test_setup_teardown(test_full_load, big_setup, teardown),
+		unit_test_teardown(big_suite, teardown_fixture),
+
+		unit_test_setup(big_bad_suite, big_bad_setup_fixture),
+		unit_test_setup_teardown(test_count, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_add, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_add_existing, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_remove_hard, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_iter, big_bad_setup, teardown),
+		unit_test_setup_teardown(test_copy, big_bad_setup, teardown),
+		unit_test_teardown(big_bad_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
@@ -0,0 +1,266 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "rmset.h"
+
+#define NREADER 4
+
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+static struct rmset set;
+static struct rmset_reader reader;
+static int *vals;
+static size_t count;
+
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static int fill_fn(struct hashset *s, void *context)
+{
+	size_t i;
+	int err;
+
+	(void)context;
+	for (i = 0; i < count; i++) {
+		if ((err = hashset_set_item(s, &vals[i]))) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+static void fill(size_t n)
+{
+	size_t i;
+
+	rmset_init(&set, sizeof(int), int_hash, int_compar, NULL);
+	rmset_reader_add(&set, &reader);
+
+	count = n;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+	}
+	rmset_update(&set, fill_fn, NULL);
+}
+
+static void teardown()
+{
+	free(vals);
+	rmset_reader_remove(&reader);
+	rmset_destroy(&set);
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty rmset\n");
+	print_message("-----------\n");
+}
+
+static void empty_setup()
+{
+	fill(0);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big rmset\n");
+	print_message("---------\n");
+}
+
+static void big_setup()
+{
+	fill(5555);
+}
+
+static void test_count()
+{
+	assert_int_equal(rmset_count(&reader), count);
+}
+
+static void test_lookup()
+{
+	size_t i;
+	int val;
+
+	for (i = 0; i < count; i++) {
+		assert_true(rmset_contains(&reader, &vals[i]));
+		val = -1;
+		assert_true(rmset_lookup(&reader, &vals[i], &val));
+		assert_int_equal(val, vals[i]);
+	}
+}
+
+static void test_add()
+{
+	int val = 31337;
+
+	assert_int_equal(rmset_set_item(&set, &val), 0);
+	assert_int_equal(rmset_set_item(&set, &val), 0);
+	assert_int_equal(rmset_count(&reader), count + 1);
+	assert_true(rmset_contains(&reader, &val));
+	test_lookup();
+}
+
+static void test_remove()
+{
+	int val = -1;
+	int removed;
+
+	rmset_set_item(&set, &val);
+	assert_int_equal(rmset_remove(&set, &val, &removed), 0);
+	assert_true(removed);
+	assert_int_equal(rmset_remove(&set, &val, &removed), 0);
+	assert_false(removed);
+	assert_int_equal(rmset_count(&reader), count);
+	assert_false(rmset_contains(&reader, &val));
+	test_lookup();
+}
+
+static int fail_fn(struct hashset *s, void *context)
+{
+	int val = 777777;
+
+	(void)context;
+	hashset_clear(s);
+	hashset_set_item(s, &val);
+	return EINVAL;
+}
+
+static void test_update_fails()
+{
+	int val = 777777;
+
+	// a failed update publishes nothing
+	assert_int_equal(rmset_update(&set, fail_fn, NULL), EINVAL);
+	assert_false(rmset_contains(&reader, &val));
+	test_count();
+	test_lookup();
+}
+
+static void test_snapshot()
+{
+	const struct hashset *snap;
+	struct hashset_iter it;
+	int val = 424242;
+	size_t n = 0;
+
+	// a reader's table doesn't change under it, and isn't freed
+	snap = rmset_enter(&reader);
+	rmset_set_item(&set, &val);
+	rmset_set_item(&set, &val);
+	assert_true(set.retired != NULL);
+	assert_false(hashset_contains(snap, &val));
+	HASHSET_FOREACH(it, snap) {
+		n++;
+	}
+	assert_int_equal(n, count);
+	rmset_exit(&reader);
+
+	rmset_reclaim(&set);
+	assert_true(set.retired == NULL);
+	assert_true(rmset_contains(&reader, &val));
+}
+
+static int stop;
+
+/* Readers check that the keys in [0, count) are always there, while a
+ * writer adds and removes others */
+static void *read_work(void *arg)
+{
+	struct rmset_reader r;
+	size_t i, n = 0;
+	int *bad = arg;
+
+	rmset_reader_add(&set, &r);
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED) || n < 1000) {
+		for (i = 0; i < count; i += 7) {
+			if (!rmset_contains(&r, &vals[i])) {
+				(*bad)++;
+			}
+		}
+		if (rmset_count(&r) < count) {
+			(*bad)++;
+		}
+		n++;
+	}
+	rmset_reader_remove(&r);
+	return NULL;
+}
+
+static void test_threads()
+{
+	pthread_t threads[NREADER];
+	int bad[NREADER] = { 0 };
+	int i, key, removed;
+
+	stop = 0;
+	for (i = 0; i < NREADER; i++) {
+		pthread_create(&threads[i], NULL, read_work, &bad[i]);
+	}
+	for (key = 1000000; key < 1000200; key++) {
+		rmset_set_item(&set, &key);
+		if (key % 2) {
+			rmset_remove(&set, &key, &removed);
+			assert_true(removed);
+		}
+	}
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < NREADER; i++) {
+		pthread_join(threads[i], NULL);
+		assert_int_equal(bad[i], 0);
+	}
+
+	rmset_reclaim(&set);
+	assert_true(set.retired == NULL);
+	assert_int_equal(rmset_count(&reader), count + 100);
+	test_lookup();
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_add, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_update_fails, empty_setup,
+					 teardown),
+		unit_test_setup_teardown(test_snapshot, empty_setup, teardown),
+		unit_test_setup_teardown(test_threads, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_add, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_update_fails, big_setup,
+					 teardown),
+		unit_test_setup_teardown(test_snapshot, big_setup, teardown),
+		unit_test_setup_teardown(test_threads, big_setup, teardown),
+		unit_test_teardown(big_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}
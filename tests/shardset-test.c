@@ -0,0 +1,365 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include "cmockery.h"
+
+#include "hashset.h"
+#include "shardset.h"
+
+#define NTHREAD 8
+
+
+static size_t int_hash(const void *x, void *context)
+{
+	(void)context;
+	return *(int *)x;
+}
+
+static int int_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return *(int *)x - *(int *)y;
+}
+
+struct pair {
+	int key;
+	int val;
+};
+
+static int pair_compar(const void *x, const void *y, void *context)
+{
+	(void)context;
+	return ((struct pair *)x)->key - ((struct pair *)y)->key;
+}
+
+static struct shardset set;
+static int *vals;
+static size_t count;
+
+
+static void teardown_fixture()
+{
+	print_message("\n\n");
+}
+
+static void fill(size_t nshard, size_t n)
+{
+	size_t i;
+
+	shardset_init(&set, nshard, sizeof(int), int_hash, int_compar, NULL);
+
+	count = n;
+	vals = malloc(count * sizeof(*vals));
+	for (i = 0; i < count; i++) {
+		vals[i] = (int)i;
+		shardset_set_item(&set, &vals[i]);
+	}
+}
+
+static void teardown()
+{
+	free(vals);
+	shardset_destroy(&set);
+}
+
+static void empty_setup_fixture()
+{
+	print_message("empty shardset\n");
+	print_message("--------------\n");
+}
+
+static void empty_setup()
+{
+	fill(8, 0);
+}
+
+static void big_setup_fixture()
+{
+	print_message("big shardset\n");
+	print_message("------------\n");
+}
+
+static void big_setup()
+{
+	fill(8, 5555);
+}
+
+static void one_setup_fixture()
+{
+	print_message("big shardset (one shard)\n");
+	print_message("------------------------\n");
+}
+
+static void one_setup()
+{
+	fill(1, 5555);
+}
+
+static void test_count()
+{
+	assert_int_equal(shardset_count(&set), count);
+}
+
+static void test_clear()
+{
+	shardset_clear(&set);
+	assert_int_equal(shardset_count(&set), 0);
+	if (count) {
+		assert_false(shardset_contains(&set, &vals[0]));
+	}
+}
+
+static void test_lookup()
+{
+	size_t i;
+	int val;
+
+	for (i = 0; i < count; i++) {
+		assert_true(shardset_contains(&set, &vals[i]));
+		val = -1;
+		assert_true(shardset_lookup(&set, &vals[i], &val));
+		assert_int_equal(val, vals[i]);
+	}
+}
+
+static void test_insert()
+{
+	int val = 31337;
+	int added;
+
+	assert_int_equal(shardset_insert(&set, &val, &added), 0);
+	assert_true(added);
+	assert_int_equal(shardset_insert(&set, &val, &added), 0);
+	assert_false(added);
+	assert_int_equal(shardset_count(&set), count + 1);
+	assert_true(shardset_contains(&set, &val));
+	test_lookup();
+}
+
+static void test_remove()
+{
+	size_t i;
+	int val;
+
+	for (i = 0; i < count; i += 2) {
+		val = -1;
+		assert_true(shardset_remove(&set, &vals[i], &val));
+		assert_int_equal(val, vals[i]);
+		assert_false(shardset_remove(&set, &vals[i], NULL));
+	}
+	for (i = 0; i < count; i++) {
+		assert_int_equal(shardset_contains(&set, &vals[i]), i % 2);
+	}
+	assert_int_equal(shardset_count(&set), count / 2);
+}
+
+static void test_set_item()
+{
+	struct shardset pairs;
+	struct pair p = { 7, 1 }, q = { 7, 2 }, r = { 7, 0 };
+	int added;
+
+	shardset_init(&pairs, 4, sizeof(struct pair), int_hash, pair_compar,
+		      NULL);
+
+	// insert keeps the old element; set_item replaces it
+	shardset_insert(&pairs, &p, &added);
+	shardset_insert(&pairs, &q, &added);
+	shardset_lookup(&pairs, &r, &r);
+	assert_int_equal(r.val, 1);
+	shardset_set_item(&pairs, &q);
+	shardset_lookup(&pairs, &r, &r);
+	assert_int_equal(r.val, 2);
+	assert_int_equal(shardset_count(&pairs), 1);
+
+	shardset_destroy(&pairs);
+}
+
+static int count_fn(const void *val, void *context)
+{
+	size_t *n = context;
+
+	assert_true(*(const int *)val >= 0);
+	(*n)++;
+	return 0;
+}
+
+static int stop_fn(const void *val, void *context)
+{
+	(void)val;
+	(void)context;
+	return 42;
+}
+
+static void test_foreach()
+{
+	size_t n = 0;
+
+	assert_int_equal(shardset_foreach(&set, count_fn, &n), 0);
+	assert_int_equal(n, count);
+	assert_int_equal(shardset_foreach(&set, stop_fn, NULL),
+			 count ? 42 : 0);
+}
+
+static void test_copy_to()
+{
+	int *buf = malloc((count + 1) * sizeof(*buf));
+	char *seen = calloc(count + 1, 1);
+	size_t i, n;
+
+	n = shardset_copy_to(&set, buf);
+	assert_int_equal(n, count);
+	for (i = 0; i < n; i++) {
+		assert_true(buf[i] >= 0 && (size_t)buf[i] < count);
+		assert_false(seen[buf[i]]);
+		seen[buf[i]] = 1;
+	}
+	free(seen);
+	free(buf);
+}
+
+static void test_ensure_capacity()
+{
+	assert_int_equal(shardset_ensure_capacity(&set, 100000), 0);
+	test_count();
+	test_lookup();
+}
+
+struct worker {
+	pthread_t thread;
+	int id;
+	size_t added;
+};
+
+/* Each thread adds the keys in [0, 20000) congruent to its id mod 4, so
+ * each key is added by two threads at once; then removes its odd ones.
+ * An odd key can come back after its other thread removes it, so only
+ * the even keys get exactly one successful add.
+ */
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	int key, added;
+
+	for (key = w->id % 4; key < 20000; key += 4) {
+		shardset_insert(&set, &key, &added);
+		if (key % 2 == 0) {
+			w->added += added;
+		}
+	}
+	for (key = w->id % 4; key < 20000; key += 4) {
+		if (key % 2) {
+			shardset_remove(&set, &key, NULL);
+		}
+	}
+	return NULL;
+}
+
+static void test_threads()
+{
+	struct worker w[NTHREAD];
+	size_t added = 0;
+	int i, key;
+
+	shardset_clear(&set);
+
+	for (i = 0; i < NTHREAD; i++) {
+		w[i].id = i;
+		w[i].added = 0;
+		pthread_create(&w[i].thread, NULL, work, &w[i]);
+	}
+	for (i = 0; i < NTHREAD; i++) {
+		pthread_join(w[i].thread, NULL);
+		added += w[i].added;
+	}
+
+	assert_int_equal(added, 10000);
+	assert_int_equal(shardset_count(&set), 10000);
+	for (key = 0; key < 20000; key++) {
+		assert_int_equal(shardset_contains(&set, &key), !(key % 2));
+	}
+}
+
+/* The shard comes from the hash, and so does the tag hashset keeps in each
+ * bucket's status byte; the keys of one shard should still get them all.
+ */
+static void test_tag_spread()
+{
+	struct shardset s;
+	const struct hashset *sh;
+	int seen[128];
+	size_t nshard, i, j;
+	int key, ntag;
+
+	for (nshard = 4; nshard <= 256; nshard *= 4) {
+		shardset_init(&s, nshard, sizeof(int), int_hash, int_compar,
+			      NULL);
+		for (key = 0; key < (int)(2000 * nshard); key++) {
+			shardset_set_item(&s, &key);
+		}
+
+		for (i = 0; i < nshard; i++) {
+			sh = shardset_shard_set(&s, i);
+			assert_true(hashset_count(sh) > 1000);
+			for (j = 0; j < 128; j++) {
+				seen[j] = 0;
+			}
+			for (j = 0; j < sh->nbucket; j++) {
+				if (sh->status[j] & 0x80) {
+					seen[sh->status[j] & 0x7f] = 1;
+				}
+			}
+			for (j = 0, ntag = 0; j < 128; j++) {
+				ntag += seen[j];
+			}
+			assert_true(ntag >= 120);
+		}
+		shardset_destroy(&s);
+	}
+}
+
+int main()
+{
+	UnitTest tests[] = {
+		unit_test_setup(empty_suite, empty_setup_fixture),
+		unit_test_setup_teardown(test_count, empty_setup, teardown),
+		unit_test_setup_teardown(test_clear, empty_setup, teardown),
+		unit_test_setup_teardown(test_lookup, empty_setup, teardown),
+		unit_test_setup_teardown(test_insert, empty_setup, teardown),
+		unit_test_setup_teardown(test_remove, empty_setup, teardown),
+		unit_test_setup_teardown(test_set_item, empty_setup, teardown),
+		unit_test_setup_teardown(test_foreach, empty_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, empty_setup, teardown),
+		unit_test_setup_teardown(test_ensure_capacity, empty_setup,
+					 teardown),
+		unit_test_setup_teardown(test_threads, empty_setup, teardown),
+		unit_test_teardown(empty_suite, teardown_fixture),
+
+		unit_test_setup(big_suite, big_setup_fixture),
+		unit_test_setup_teardown(test_count, big_setup, teardown),
+		unit_test_setup_teardown(test_clear, big_setup, teardown),
+		unit_test_setup_teardown(test_lookup, big_setup, teardown),
+		unit_test_setup_teardown(test_insert, big_setup, teardown),
+		unit_test_setup_teardown(test_remove, big_setup, teardown),
+		unit_test_setup_teardown(test_foreach, big_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, big_setup, teardown),
+		unit_test_setup_teardown(test_ensure_capacity, big_setup,
+					 teardown),
+		unit_test_setup_teardown(test_threads, big_setup, teardown),
+		unit_test(test_tag_spread),
+		unit_test_teardown(big_suite, teardown_fixture),
+
+		unit_test_setup(one_suite, one_setup_fixture),
+		unit_test_setup_teardown(test_count, one_setup, teardown),
+		unit_test_setup_teardown(test_lookup, one_setup, teardown),
+		unit_test_setup_teardown(test_insert, one_setup, teardown),
+		unit_test_setup_teardown(test_remove, one_setup, teardown),
+		unit_test_setup_teardown(test_copy_to, one_setup, teardown),
+		unit_test_setup_teardown(test_threads, one_setup, teardown),
+		unit_test_teardown(one_suite, teardown_fixture),
+	};
+	return run_tests(tests);
+}